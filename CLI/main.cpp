@@ -1,10 +1,22 @@
 #include <sstream>
+#include <iomanip>
+#include <limits>
 #include <string>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <cmath>
 
 #include "optionparser.h"
 #include "../FreewayAC/Auxiliar.h"
 #include "../FreewayAC/CellularAutomata.h"
+#include "../FreewayAC/StateCache.h"
+#include "../FreewayAC/ResultCache.h"
+#include "../FreewayAC/NpyReader.h"
+#include "../FreewayAC/AsyncObserver.h"
+#include "../FreewayAC/LiveSnapshot.h"
+#include "../FreewayAC/LargeCA.h"
+#include "../FreewayAC/Ensemble.h"
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -44,7 +56,14 @@ enum  OptionIndex { UNKNOWN, FWSIZE, ITERATIONS, VMAX, DENSITY, RAND_PROB, INIT_
                     PLOT_TRAFFIC, PLOT_FLOW,
                     CA_CIRCULAR, CA_OPEN, CA_AUTONOMOUS_CIRCULAR, CA_AUTONOMOUS_OPEN,
 					NEW_CAR_PROB, NEW_CAR_SPEED, AUT_DENSITY,
-					OUT_FILE_NAME, PATH, HELP };
+					OUT_FILE_NAME, PATH, SEED, RANDOM_ALGORITHM, BENCHMARK_RNG,
+                    RECORD_RANDOM, REPLAY_RANDOM, HISTORY, HISTORY_FILE,
+                    RECORD_FIRST, RECORD_CELLS, RECORD_START, RECORD_STRIDE, RECORD_RESERVOIR,
+                    KEYFRAME_INTERVAL, WINDOW_START, WINDOW_STEPS, EXPORT_NPY, EXPORT_CHUNK, STATS, BMP_FORMAT_OPT, TILES, TILE_SIZE, STREAM_PLOT,
+                    CHECKPOINT, CHECKPOINT_INTERVAL, CHECKPOINT_COMPRESS, RESUME,
+                    WARMUP, STATE_CACHE, DENSITY_SWEEP, SWEEP_POINTS, SWEEP_BACK, RESULT_CACHE, INIT, LATTICE, LATTICE_CLASSES,
+                    ASYNC_OUTPUT, ASYNC_QUEUE, ASYNC_POLICY_OPT, SNAPSHOT_SHM, SNAPSHOT_INTERVAL, VIEW_SNAPSHOT, VIEW_PERIOD,
+                    LARGE, EXPLICIT_HUGE_PAGES, ENSEMBLE, ENSEMBLE_THREADS, NO_PIN, HELP };
 
 const option::Descriptor usage[] =
 {
@@ -55,6 +74,8 @@ const option::Descriptor usage[] =
     {DENSITY,  0,"d", "density", Arg::Required, "  -d <arg>, \t--density=<arg>  \tDensidad de autos." },
     {RAND_PROB,  0,"r", "rand_prob", Arg::Required, "  -r <arg>, \t--rand_prob=<arg>  \tProbabilidad de descenso de velocidad." },
 	{INIT_VEL, 0, "i", "init_vel", Arg::Required, "  -i <arg>, \t--init_vel=<arg>  \tVelocidad inicial de los autos." },
+	{INIT, 0, "", "init", Arg::Required,
+	"  \t--init=<arg>  \tDisposicion inicial de los autos: random, megajam (todos juntos) o uniform (espaciado uniforme). Por defecto random." },
 
     {PLOT_TRAFFIC,  0,"p","plot_traffic", Arg::None,
     "  -p , \t--plot_traffic  \tCrea mapa de posicion de autos vs tiempo." },
@@ -72,6 +93,81 @@ const option::Descriptor usage[] =
 
 	{OUT_FILE_NAME,  0,"", "out_file_name", Arg::Required, "  \t--out_file_name=<arg>  \tCambia el nombre del archivo de salida al especificado." },
 	{PATH,  0,"", "path", Arg::Required, "  \t--path=<arg>  \tRuta donde guardar archivos de salida." },
+	{SEED,  0,"", "seed", Arg::Required, "  \t--seed=<arg>  \tSemilla del generador de aleatorios." },
+	{RANDOM_ALGORITHM,  0,"", "random_algorithm", Arg::Required,
+	"  \t--random_algorithm=<arg>  \tGenerador de aleatorios: mt19937, xoshiro256ss, pcg64, ranlux24, ranlux48 o lcg." },
+	{BENCHMARK_RNG,  0,"", "benchmark_rng", Arg::None, "  \t--benchmark_rng  \tCompara el tiempo de evolucion del AC con cada generador." },
+	{RECORD_RANDOM,  0,"", "record_random", Arg::Required, "  \t--record_random=<arg>  \tGraba las decisiones aleatorias en el archivo especificado." },
+	{REPLAY_RANDOM,  0,"", "replay_random", Arg::Required,
+	"  \t--replay_random=<arg>  \tToma las decisiones aleatorias del archivo especificado. Usar con la misma semilla." },
+	{HISTORY,  0,"", "history", Arg::Required, "  \t--history=<arg>  \tForma de guardar el historico: plain, packed, events, disk o none." },
+	{HISTORY_FILE,  0,"", "history_file", Arg::Required,
+	"  \t--history_file=<arg>  \tRuta base de los archivos de historico con --history=disk. Por defecto ca_history." },
+	{RECORD_FIRST,  0,"", "record_first", Arg::Required, "  \t--record_first=<arg>  \tPrimera casilla guardada en el historico." },
+	{RECORD_CELLS,  0,"", "record_cells", Arg::Required,
+	"  \t--record_cells=<arg>  \tCasillas guardadas en el historico a partir de record_first. 0 guarda hasta el final." },
+	{RECORD_START,  0,"", "record_start", Arg::Required, "  \t--record_start=<arg>  \tPrimer paso guardado en el historico." },
+	{RECORD_STRIDE,  0,"", "record_stride", Arg::Required, "  \t--record_stride=<arg>  \tGuarda en el historico un paso de cada record_stride." },
+	{RECORD_RESERVOIR,  0,"", "record_reservoir", Arg::Required,
+	"  \t--record_reservoir=<arg>  \tGuarda solo esta cantidad de pasos elegidos al azar. Requiere --history=plain." },
+	{KEYFRAME_INTERVAL,  0,"", "keyframe_interval", Arg::Required,
+	"  \t--keyframe_interval=<arg>  \tGuarda el estado completo del AC cada esta cantidad de pasos." },
+	{WINDOW_START,  0,"", "window_start", Arg::Required,
+	"  \t--window_start=<arg>  \tDibuja los pasos regenerados desde este paso. Requiere --keyframe_interval." },
+	{WINDOW_STEPS,  0,"", "window_steps", Arg::Required, "  \t--window_steps=<arg>  \tCantidad de pasos regenerados a dibujar." },
+	{EXPORT_NPY,  0,"", "export_npy", Arg::Required,
+	"  \t--export_npy=<arg>  \tExporta historico y observables a <arg>_ca.npy, <arg>_flow.npy y <arg>_obs.npy." },
+	{EXPORT_CHUNK,  0,"", "export_chunk", Arg::Required,
+	"  \t--export_chunk=<arg>  \tExporta cada esta cantidad de pasos y vacia el historico. Los mapas solo muestran el ultimo bloque." },
+	{STATS,  0,"", "stats", Arg::None,
+	"  \t--stats  \tCalcula ocupacion y flujo durante la evolucion. Con --history=none no se guarda historico." },
+	{BMP_FORMAT_OPT,  0,"", "bmp_format", Arg::Required,
+	"  \t--bmp_format=<arg>  \tFormato de los mapas: rgb, palette8, palette4, rle8 o rle4. Por defecto rgb." },
+	{TILES,  0,"", "tiles", Arg::None,
+	"  \t--tiles  \tDibuja los mapas elegidos como piramides Deep Zoom de teselas (ca.dzi y ca_flow.dzi) en vez de BMP." },
+	{TILE_SIZE,  0,"", "tile_size", Arg::Required, "  \t--tile_size=<arg>  \tLado de las teselas en pixeles. Por defecto 256." },
+	{STREAM_PLOT,  0,"", "stream_plot", Arg::None,
+	"  \t--stream_plot  \tDibuja los mapas durante la evolucion. Con --history=none no se guarda historico." },
+	{CHECKPOINT,  0,"", "checkpoint", Arg::Required,
+	"  \t--checkpoint=<arg>  \tGuarda el estado completo del AC en este archivo al terminar y cada --checkpoint_interval pasos." },
+	{CHECKPOINT_INTERVAL,  0,"", "checkpoint_interval", Arg::Required, "  \t--checkpoint_interval=<arg>  \tPasos entre checkpoints. Con --export_chunk se guardan al terminar de exportar un bloque." },
+	{CHECKPOINT_COMPRESS,  0,"", "checkpoint_compress", Arg::None, "  \t--checkpoint_compress  \tComprime los checkpoints." },
+	{RESUME,  0,"", "resume", Arg::Required,
+	"  \t--resume=<arg>  \tContinua la simulacion de un checkpoint hasta completar --iterations pasos. El tipo y parametros del AC se toman del checkpoint." },
+	{WARMUP,  0,"", "warmup", Arg::Required,
+	"  \t--warmup=<arg>  \tPasos de transitorio sin grabar antes de la evolucion (y antes de medir cada punto de --density_sweep)." },
+	{STATE_CACHE,  0,"", "state_cache", Arg::Required,
+	"  \t--state_cache=<arg>  \tDirectorio de estados estacionarios. Si existe uno con los mismos parametros, semilla y --warmup se usa en vez de repetir el transitorio." },
+	{DENSITY_SWEEP,  0,"", "density_sweep", Arg::Required,
+	"  \t--density_sweep=<arg>  \tBarre la densidad desde --density hasta este valor. Cada punto parte del estado del anterior agregando o quitando autos." },
+	{SWEEP_POINTS,  0,"", "sweep_points", Arg::Required, "  \t--sweep_points=<arg>  \tCantidad de densidades del barrido. Por defecto 10." },
+	{SWEEP_BACK,  0,"", "sweep_back", Arg::None, "  \t--sweep_back  \tAl terminar el barrido regresa a la densidad inicial, para estudiar histeresis." },
+	{RESULT_CACHE,  0,"", "result_cache", Arg::Required,
+	"  \t--result_cache=<arg>  \tDirectorio de resultados de --stats y --density_sweep. Si el experimento ya se calculo con la misma semilla se muestra sin simular." },
+	{LATTICE,  0,"", "lattice", Arg::Required,
+	"  \t--lattice=<arg>  \tCarga la pista inicial de un arreglo .npy de velocidades (-1 vacia). De un historico exportado se usa la ultima fila. El tamano se toma del archivo." },
+	{LATTICE_CLASSES,  0,"", "lattice_classes", Arg::Required,
+	"  \t--lattice_classes=<arg>  \tArreglo .npy con la clase de cada casilla de --lattice: 0 normal, otro valor autonomo." },
+	{ASYNC_OUTPUT,  0,"", "async_output", Arg::None,
+	"  \t--async_output  \tCalcula --stats y dibuja --stream_plot en hilos aparte. El hilo de simulacion solo copia cada fila a una cola." },
+	{ASYNC_QUEUE,  0,"", "async_queue", Arg::Required, "  \t--async_queue=<arg>  \tFilas en la cola de cada hilo de salida. Por defecto 64." },
+	{ASYNC_POLICY_OPT,  0,"", "async_policy", Arg::Required,
+	"  \t--async_policy=<arg>  \tCon la cola llena: wait espera al hilo de salida, drop descarta el paso. Por defecto wait." },
+	{SNAPSHOT_SHM,  0,"", "snapshot_shm", Arg::Required,
+	"  \t--snapshot_shm=<arg>  \tPublica la pista y las estadisticas durante la evolucion en memoria compartida con este nombre." },
+	{SNAPSHOT_INTERVAL,  0,"", "snapshot_interval", Arg::Required,
+	"  \t--snapshot_interval=<arg>  \tPasos entre copias de la pista en --snapshot_shm. Por defecto 1." },
+	{VIEW_SNAPSHOT,  0,"", "view_snapshot", Arg::Required,
+	"  \t--view_snapshot=<arg>  \tMuestra el estado publicado por otra simulacion con --snapshot_shm hasta que termine." },
+	{VIEW_PERIOD,  0,"", "view_period", Arg::Required, "  \t--view_period=<arg>  \tMilisegundos entre lecturas de --view_snapshot. Por defecto 500." },
+	{LARGE,  0,"", "large", Arg::None,
+	"  \t--large  \tAC circular de mas de 2^32 casillas: un byte por casilla, indices de 64 bits y paginas enormes. Sin historico, muestra las estadisticas." },
+	{EXPLICIT_HUGE_PAGES,  0,"", "explicit_huge_pages", Arg::None,
+	"  \t--explicit_huge_pages  \tCon --large usa paginas enormes reservadas del sistema si hay disponibles." },
+	{ENSEMBLE,  0,"", "ensemble", Arg::Required,
+	"  \t--ensemble=<arg>  \tEvoluciona esta cantidad de replicas en hilos fijos a CPU, cada una en la memoria de su nodo NUMA, y muestra sus estadisticas." },
+	{ENSEMBLE_THREADS,  0,"", "ensemble_threads", Arg::Required, "  \t--ensemble_threads=<arg>  \tHilos de --ensemble. Por defecto uno por CPU." },
+	{NO_PIN,  0,"", "no_pin", Arg::None, "  \t--no_pin  \tNo fija los hilos de --ensemble a CPU." },
     {HELP, 0,"", "help", Arg::None,    "  \t--help  \tMuestra instrucciones detalladas de cada experimento." },
     {0,0,0,0,0,0}
 };
@@ -92,10 +188,71 @@ void describe_experiments()
         "                          Parametros relevantes: NEW_CAR_PROB, NEW_CAR_SPEED, AUT_DENSITY.\n"
         "\n=== Experimentos ===\n"
         "PLOT_TRAFFIC           -> Descripcion: Evoluciona automata celular y grafica su representacion.\n"
-        "PLOT_FLOW              -> Descripcion: Evoluciona automata celular y grafica su flujo.\n";
+        "PLOT_FLOW              -> Descripcion: Evoluciona automata celular y grafica su flujo.\n"
+        "BENCHMARK_RNG          -> Descripcion: Mide el tiempo de evolucion del automata celular con cada\n"
+        "                                       generador de aleatorios.\n"
+        "                          Parametros relevantes: SEED.\n";
     cout << text << endl;
 }
 
+RandomAlgorithm parse_random_algorithm(const string &name)
+{
+    if (name == "lcg")
+        return LCG;
+    if (name == "ranlux24")
+        return RANLUX24;
+    if (name == "ranlux48")
+        return RANLUX48;
+    if (name == "xoshiro256ss")
+        return XOSHIRO256SS;
+    if (name == "pcg64")
+        return PCG64;
+    if (name != "mt19937")
+        cout << "Generador desconocido: " << name << ". Se usa mt19937." << endl;
+    return MT19937;
+}
+
+HISTORY_MODE parse_history_mode(const string &name)
+{
+    if (name == "packed")
+        return HISTORY_PACKED;
+    if (name == "events")
+        return HISTORY_EVENTS;
+    if (name == "disk")
+        return HISTORY_DISK;
+    if (name == "none")
+        return HISTORY_NONE;
+    if (name != "plain")
+        cout << "Modo de historico desconocido: " << name << ". Se usa plain." << endl;
+    return HISTORY_PLAIN;
+}
+
+INITIAL_CONDITION parse_initial_condition(const string &name)
+{
+    if (name == "megajam")
+        return INIT_MEGAJAM;
+    if (name == "uniform")
+        return INIT_UNIFORM;
+    if (name != "random")
+        cout << "Disposicion inicial desconocida: " << name << ". Se usa random." << endl;
+    return INIT_RANDOM;
+}
+
+BMP_FORMAT parse_bmp_format(const string &name)
+{
+    if (name == "palette8")
+        return BMP_PALETTE8;
+    if (name == "palette4")
+        return BMP_PALETTE4;
+    if (name == "rle8")
+        return BMP_RLE8;
+    if (name == "rle4")
+        return BMP_RLE4;
+    if (name != "rgb")
+        cout << "Formato de imagen desconocido: " << name << ". Se usa rgb." << endl;
+    return BMP_RGB24;
+}
+
 int main(int argc, char* argv[])
 {
     // Valores por defecto.
@@ -103,12 +260,42 @@ int main(int argc, char* argv[])
     int vmax = 5, init_vel = 1;
     double density = 0.2, rand_prob = 0.2;
 
-    bool plot_traffic = false, plot_flow = false;
+    bool plot_traffic = false, plot_flow = false, benchmark_rng = false, online_stats = false;
+    int seed = -1;
+    RandomAlgorithm random_algorithm = MT19937;
 
     CA_TYPE ca_type = CIRCULAR_CA;
+    INITIAL_CONDITION init = INIT_RANDOM;
     double new_car_prob = 0.1, aut_density = 0.1;
     int new_car_speed = 1;
     string out_file_name = "", path = "";
+    string record_random = "", replay_random = "";
+    HISTORY_MODE history_mode = HISTORY_PLAIN;
+    string history_file = "ca_history";
+    unsigned record_first = 0, record_cells = 0, record_start = 0, record_stride = 1, record_reservoir = 0;
+    unsigned keyframe_interval = 0, window_start = 0, window_steps = 0;
+    string export_npy = "";
+    unsigned export_chunk = 0;
+    BMP_FORMAT bmp_format = BMP_RGB24;
+    bool tiles = false, stream_plot = false;
+    string checkpoint = "", resume = "";
+    unsigned checkpoint_interval = 0;
+    bool checkpoint_compress = false;
+    unsigned warmup = 0, sweep_points = 10;
+    string state_cache = "", result_cache = "";
+    string lattice = "", lattice_classes = "";
+    bool async_output = false;
+    unsigned async_queue = 64;
+    ASYNC_POLICY async_policy = ASYNC_WAIT;
+    string snapshot_shm = "", view_snapshot = "";
+    unsigned snapshot_interval = 1, view_period = 500;
+    bool large = false, explicit_huge_pages = false;
+    uint64_t large_size = 100, large_iterations = 100, large_warmup = 0;
+    unsigned ensemble = 0, ensemble_threads = 0;
+    bool pin = true;
+    double density_sweep = -1.0;
+    bool sweep_back = false;
+    unsigned tile_size = 256;
 
     // Ejecuta parser de argumentos.
     argc -= (argc > 0); argv += (argc > 0);
@@ -138,10 +325,12 @@ int main(int argc, char* argv[])
         {
             case FWSIZE:
             size = aux_string_to_num<unsigned>(opt.arg);
+            large_size = aux_string_to_num<uint64_t>(opt.arg);
             break;
 
             case ITERATIONS:
             iterations = aux_string_to_num<unsigned>(opt.arg);
+            large_iterations = aux_string_to_num<uint64_t>(opt.arg);
             break;
 
             case VMAX:
@@ -199,6 +388,198 @@ int main(int argc, char* argv[])
             case PATH:
             path = opt.arg;
             break;
+
+            case SEED:
+            seed = aux_string_to_num<int>(opt.arg);
+            break;
+
+            case RANDOM_ALGORITHM:
+            random_algorithm = parse_random_algorithm(opt.arg);
+            break;
+
+            case BENCHMARK_RNG:
+            benchmark_rng = true;
+            break;
+
+            case RECORD_RANDOM:
+            record_random = opt.arg;
+            break;
+
+            case REPLAY_RANDOM:
+            replay_random = opt.arg;
+            break;
+
+            case HISTORY:
+            history_mode = parse_history_mode(opt.arg);
+            break;
+
+            case HISTORY_FILE:
+            history_file = opt.arg;
+            break;
+
+            case BMP_FORMAT_OPT:
+            bmp_format = parse_bmp_format(opt.arg);
+            break;
+
+            case TILES:
+            tiles = true;
+            break;
+
+            case TILE_SIZE:
+            tile_size = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case STREAM_PLOT:
+            stream_plot = true;
+            break;
+
+            case CHECKPOINT:
+            checkpoint = opt.arg;
+            break;
+
+            case CHECKPOINT_INTERVAL:
+            checkpoint_interval = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case CHECKPOINT_COMPRESS:
+            checkpoint_compress = true;
+            break;
+
+            case RESUME:
+            resume = opt.arg;
+            break;
+
+            case WARMUP:
+            warmup = aux_string_to_num<unsigned>(opt.arg);
+            large_warmup = aux_string_to_num<uint64_t>(opt.arg);
+            break;
+
+            case STATE_CACHE:
+            state_cache = opt.arg;
+            break;
+
+            case ASYNC_OUTPUT:
+            async_output = true;
+            break;
+
+            case ASYNC_QUEUE:
+            async_queue = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case ASYNC_POLICY_OPT:
+            if (string(opt.arg) == "drop")
+                async_policy = ASYNC_DROP;
+            else if (string(opt.arg) != "wait")
+                cout << "Politica de cola desconocida: " << opt.arg << ". Se usa wait." << endl;
+            break;
+
+            case SNAPSHOT_SHM:
+            snapshot_shm = opt.arg;
+            break;
+
+            case SNAPSHOT_INTERVAL:
+            snapshot_interval = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case VIEW_SNAPSHOT:
+            view_snapshot = opt.arg;
+            break;
+
+            case LARGE:
+            large = true;
+            break;
+
+            case EXPLICIT_HUGE_PAGES:
+            explicit_huge_pages = true;
+            break;
+
+            case ENSEMBLE:
+            ensemble = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case ENSEMBLE_THREADS:
+            ensemble_threads = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case NO_PIN:
+            pin = false;
+            break;
+
+            case VIEW_PERIOD:
+            view_period = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case LATTICE:
+            lattice = opt.arg;
+            break;
+
+            case LATTICE_CLASSES:
+            lattice_classes = opt.arg;
+            break;
+
+            case INIT:
+            init = parse_initial_condition(opt.arg);
+            break;
+
+            case RESULT_CACHE:
+            result_cache = opt.arg;
+            break;
+
+            case DENSITY_SWEEP:
+            density_sweep = aux_string_to_num<double>(opt.arg);
+            break;
+
+            case SWEEP_POINTS:
+            sweep_points = max(1u, aux_string_to_num<unsigned>(opt.arg));
+            break;
+
+            case SWEEP_BACK:
+            sweep_back = true;
+            break;
+
+            case RECORD_FIRST:
+            record_first = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case RECORD_CELLS:
+            record_cells = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case RECORD_START:
+            record_start = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case RECORD_STRIDE:
+            record_stride = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case RECORD_RESERVOIR:
+            record_reservoir = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case KEYFRAME_INTERVAL:
+            keyframe_interval = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case WINDOW_START:
+            window_start = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case WINDOW_STEPS:
+            window_steps = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case EXPORT_NPY:
+            export_npy = opt.arg;
+            break;
+
+            case EXPORT_CHUNK:
+            export_chunk = aux_string_to_num<unsigned>(opt.arg);
+            break;
+
+            case STATS:
+            online_stats = true;
+            break;
         }
     }
 
@@ -206,52 +587,531 @@ int main(int argc, char* argv[])
     delete[] buffer;
 
 
-    // Inicio de simulación
-    RandomGen::SetAlgorithm(MT19937);
-    RandomGen::Seed();
-    CellularAutomata *cellularAutomata;
+    // La pista cargada de archivo fija el tamaño y reemplaza la colocación de autos.
+    if (lattice != "")
+    {
+        NpyReader lattice_file;
+        if (!lattice_file.Open(path + lattice))
+            return 1;
+        size = (unsigned)lattice_file.Cols();
+        density = 0.0;
+        if (state_cache != "" || result_cache != "")
+        {
+            cout << "Error: Las caches no se usan con --lattice." << endl;
+            state_cache = result_cache = "";
+        }
+    }
 
     // Carga el autómata celular
+    auto create_ca = [&]() -> CellularAutomata*
+    {
+        CellularAutomata* ca;
+        switch (ca_type)
+        {
+            case OPEN_CA:
+                ca = new OpenCA(size, density, vmax, rand_prob, init_vel, new_car_prob, new_car_speed, init);
+                break;
+            case AUTONOMOUS_CIRCULAR_CA:
+                ca = new AutonomousCircularCA(size, density, vmax, rand_prob, init_vel, aut_density, init);
+                break;
+            case AUTONOMOUS_OPEN_CA:
+                ca = new AutonomousOpenCA(size, density, vmax, rand_prob, init_vel, aut_density, new_car_prob, new_car_speed, init);
+                break;
+            case CIRCULAR_CA:
+            default:
+                ca = new CircularCA(size, density, vmax, rand_prob, init_vel, init);
+                break;
+        }
+        if (lattice != "" && !ca->LoadLattice(path + lattice, lattice_classes != "" ? path + lattice_classes : ""))
+        {
+            delete ca;
+            return nullptr;
+        }
+        return ca;
+    };
+
+    if (view_snapshot != "")
+    {
+        // Solo lee la memoria compartida, así que no afecta a la simulación que la publica.
+        SnapshotReader reader;
+        if (!reader.Open(view_snapshot))
+            return 1;
+        LiveState state;
+        bool alive = true;
+        cout << "step\tcars\tocupancy\tmean_flow" << endl;
+        do
+        {
+            // Se consulta antes de leer, así que si el proceso ya terminó la lectura ve todo lo que publicó.
+            this_thread::sleep_for(chrono::milliseconds(view_period));
+            alive = reader.WriterAlive();
+            if (reader.Read(state))
+                cout << state.step << "\t" << state.cars << "\t" << state.ocupancy << "\t" << state.mean_flow << endl;
+        } while (!state.finished && alive);
+        if (!state.finished)
+        {
+            cout << "Error: La simulacion que publica " << view_snapshot << " termino sin completarla." << endl;
+            return 1;
+        }
+        cout << "Done" << endl;
+        return 0;
+    }
+
+    if (benchmark_rng)
+    {
+        // Evoluciona el mismo AC con cada generador y mide el tiempo.
+        const RandomAlgorithm algorithms[] = { MT19937, XOSHIRO256SS, PCG64, RANLUX24, RANLUX48, LCG };
+        const char* names[] = { "mt19937", "xoshiro256ss", "pcg64", "ranlux24", "ranlux48", "lcg" };
+        for (unsigned i = 0; i < 6; ++i)
+        {
+            RandomGen::SetAlgorithm(algorithms[i]);
+            RandomGen::Seed(seed == -1 ? 0 : seed);
+            CellularAutomata *bench_ca = create_ca();
+            if (!bench_ca)
+                return 1;
+
+            auto start = chrono::steady_clock::now();
+            bench_ca->Evolve(iterations);
+            auto end = chrono::steady_clock::now();
+            double ms = chrono::duration<double, milli>(end - start).count();
+
+            cout << names[i] << ": " << ms << " ms, " << (double)iterations*1000.0/ms << " pasos/s, "
+                 << bench_ca->CalculateMeanFlow() << " flujo medio" << endl;
+            delete bench_ca;
+        }
+        return 0;
+    }
+
+    if (large)
+    {
+        // Solo se acumulan las estadísticas: un histórico de esta pista no cabría en memoria.
+        if (ca_type != CIRCULAR_CA || lattice != "" || resume != "")
+        {
+            cout << "Error: --large solo admite AC circular, sin --lattice ni --resume." << endl;
+            return 1;
+        }
+        if (plot_traffic || plot_flow || stream_plot || export_npy != "" || checkpoint != "")
+            cout << "Con --large no hay historico. Solo se muestran las estadisticas." << endl;
+
+        RandomGen::SetAlgorithm(random_algorithm);
+        RandomGen::Seed(seed);
+        cout << "Creating large circular CA" << endl;
+        LargeCircularCA large_ca(large_size, density, vmax, rand_prob, init_vel, init, explicit_huge_pages);
+        if (!large_ca.IsValid())
+            return 1;
+        if (large_ca.Pages() == PAGES_NORMAL)
+            cout << "Huge pages not available" << endl;
+        if (large_warmup != 0)
+        {
+            cout << "Warming up " << large_warmup << " steps" << endl;
+            large_ca.Evolve(large_warmup);
+            large_ca.ClearStatistics();
+        }
+
+        auto start = chrono::steady_clock::now();
+        large_ca.Evolve(large_iterations);
+        auto end = chrono::steady_clock::now();
+        const double seconds = chrono::duration<double>(end - start).count();
+        cout << "Steps: " << large_ca.Rows() << endl;
+        cout << "Mean ocupancy: " << large_ca.MeanOcupancy() << endl;
+        cout << "Mean flow: " << large_ca.MeanFlow() << endl;
+        if (seconds > 0.0)
+            cout << "Cell updates per second: " << (double)large_size*(double)large_iterations/seconds << endl;
+        cout << "Done" << endl;
+        return 0;
+    }
+
+    if (ensemble != 0)
+    {
+        // Cada réplica usa la semilla seed + réplica con el generador elegido, en su propio hilo.
+        const int base_seed = (seed == -1) ? (int)(chrono::system_clock::now().time_since_epoch().count() & 0x3FFFFFFF) : seed;
+        Ensemble runner(ensemble_threads, pin);
+        cout << "Running " << ensemble << " replicas on " << runner.Workers() << " threads, " << runner.Nodes()
+             << " NUMA nodes" << (pin ? "" : ", not pinned") << endl;
+        auto start = chrono::steady_clock::now();
+        const vector<ReplicaResult> replicas = runner.Run(ensemble, [&](const unsigned replica) -> CellularAutomata*
+        {
+            RandomGen::SetAlgorithm(random_algorithm);
+            RandomGen::Seed(base_seed + (int)replica);
+            return create_ca();
+        }, warmup, iterations);
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "replica\tcpu\tnode\tmemory_node\tmean_ocupancy\tmean_flow\tseconds" << endl;
+        vector<double> flows;
+        unsigned local = 0, known = 0;
+        double updates = 0.0;
+        for (size_t i = 0; i < replicas.size(); ++i)
+        {
+            const ReplicaResult &r = replicas[i];
+            if (r.cells == 0)
+                continue;
+            cout << r.replica << "\t" << r.cpu << "\t" << r.node << "\t" << r.memory_node << "\t" << r.mean_ocupancy
+                 << "\t" << r.mean_flow << "\t" << r.seconds << endl;
+            flows.push_back(r.mean_flow);
+            updates += (double)r.cells*(double)(warmup + iterations);
+            if (r.memory_node >= 0)
+            {
+                ++known;
+                local += (r.memory_node == r.node);
+            }
+        }
+        if (!flows.empty())
+        {
+            const double mean = aux_mean(flows);
+            double variance = 0.0;
+            for (size_t i = 0; i < flows.size(); ++i)
+                variance += (flows[i] - mean)*(flows[i] - mean);
+            variance = (flows.size() > 1) ? variance/(double)(flows.size() - 1) : 0.0;
+            cout << "Ensemble mean flow: " << mean << " +- " << sqrt(variance/(double)flows.size()) << endl;
+        }
+        if (known != 0)
+            cout << "Replicas on local memory node: " << local << "/" << known << endl;
+        else
+            cout << "Memory placement not available" << endl;
+        cout << "Cell updates per second: " << updates/seconds << endl;
+        cout << "Done" << endl;
+        return 0;
+    }
+
+    // Parámetros que determinan el estado estacionario y los resultados.
+    EquilibriumKey key;
+    key.type = ca_type;
+    key.size = size;
+    key.vmax = vmax;
+    key.rand_prob = rand_prob;
+    key.density = density;
+    key.init_vel = init_vel;
+    key.aut_density = aut_density;
+    key.new_car_prob = new_car_prob;
+    key.new_car_speed = new_car_speed;
+    key.init = init;
+    key.seed = seed;
+    key.random_algorithm = random_algorithm;
+    key.warmup = warmup;
+
+    // Resultados ya calculados. Solo se usan si el experimento no pide otras salidas.
+    ResultKey result_key;
+    result_key.params = key;
+    result_key.iterations = iterations;
+    if (density_sweep >= 0.0)
+    {
+        ostringstream sweep;
+        sweep << setprecision(numeric_limits<double>::max_digits10) << "density_sweep(" << density_sweep << ","
+              << sweep_points << "," << sweep_back << ")";
+        result_key.experiment = sweep.str();
+        const unsigned points = sweep_back ? 2*sweep_points - 1 : sweep_points;
+        const char* columns[4] = { "density", "cars", "mean_ocupancy", "mean_flow" };
+        for (unsigned i = 0; i < points; ++i)
+        {
+            for (unsigned j = 0; j < 4; ++j)
+                result_key.observables.push_back(string(columns[j]) + "_" + to_string(i));
+        }
+    }
+    else
+    {
+        result_key.experiment = "stats";
+        result_key.observables.push_back("steps");
+        result_key.observables.push_back("mean_ocupancy");
+        result_key.observables.push_back("mean_flow");
+    }
+    if (result_cache != "" && (seed == -1 || resume != "" || replay_random != "" || (density_sweep < 0.0 && !online_stats)))
+    {
+        cout << "Error: --result_cache requiere --seed y --stats o --density_sweep, sin --resume ni --replay_random. No se usa la cache." << endl;
+        result_cache = "";
+    }
+    unique_ptr<ResultCache> results;
+    if (result_cache != "")
+        results.reset(new ResultCache(path + result_cache));
+    const bool only_results = (density_sweep >= 0.0) || (!plot_traffic && !plot_flow && !stream_plot && export_npy == "" &&
+                                                         checkpoint == "" && record_random == "");
+    vector<double> cached;
+    if (results && only_results && results->Load(result_key, cached))
+    {
+        cout << "Using cached results" << endl;
+        if (density_sweep >= 0.0)
+        {
+            cout << "density\tcars\tmean_ocupancy\tmean_flow" << endl;
+            for (size_t i = 0; i + 3 < cached.size(); i += 4)
+                cout << cached[i] << "\t" << (unsigned)cached[i + 1] << "\t" << cached[i + 2] << "\t" << cached[i + 3] << endl;
+        }
+        else
+        {
+            cout << "Steps: " << (CaStep)cached[0] << endl;
+            cout << "Mean ocupancy: " << cached[1] << endl;
+            cout << "Mean flow: " << cached[2] << endl;
+        }
+        cout << "Done" << endl;
+        return 0;
+    }
+
+    // Inicio de simulación
+    RandomGen::SetAlgorithm(random_algorithm);
+    RandomGen::Seed(seed);
+
     switch (ca_type)
     {
         case CIRCULAR_CA:
             cout << "Creating circular CA" << endl;
-            cellularAutomata = new CircularCA(size, density, vmax, rand_prob, init_vel);
             break;
         case OPEN_CA:
             cout << "Creating open CA" << endl;
-            cellularAutomata = new OpenCA(size, density, vmax, rand_prob, init_vel, new_car_prob, new_car_speed);
             break;
         case AUTONOMOUS_CIRCULAR_CA:
             cout << "Creating autonomous circular CA" << endl;
-            cellularAutomata = new AutonomousCircularCA(size, density, vmax, rand_prob, init_vel, aut_density);
             break;
         case AUTONOMOUS_OPEN_CA:
             cout << "Creating autonomous open CA" << endl;
-            cellularAutomata = new AutonomousOpenCA(size, density, vmax, rand_prob, init_vel, aut_density, new_car_prob, new_car_speed);
             break;
         default:
             cout << "Creating circular CA" << endl;
-            cellularAutomata = new CircularCA(size, density, vmax, rand_prob, init_vel);
             break;
     }
+    CellularAutomata *cellularAutomata = nullptr;
+    ExportedRows exported;
+    if (resume != "")
+    {
+        // El estado guardado incluye el generador, así que la evolución continúa idéntica.
+        cellularAutomata = CellularAutomata::LoadCheckpoint(path + resume, &exported).release();
+        if (!cellularAutomata)
+            return 1;
+        // Los pasos del transitorio no cuentan como medidos.
+        const CaStep step = cellularAutomata->GetStep();
+        const CaStep measured = step - min(step, cellularAutomata->GetMeasureStart());
+        cout << "Resuming from step " << step << endl;
+        iterations = (measured < iterations) ? (unsigned)(iterations - measured) : 0;
+    }
+    else
+    {
+        // Estado estacionario: de la caché o evolucionando el transitorio sin grabar.
+        if (state_cache != "" && seed == -1)
+        {
+            cout << "Error: --state_cache requiere --seed. No se usa la cache." << endl;
+            state_cache = "";
+        }
+        unique_ptr<StateCache> cache;
+        if (state_cache != "")
+        {
+            cache.reset(new StateCache(path + state_cache));
+            cellularAutomata = cache->Load(key).release();
+        }
+        if (cellularAutomata)
+            cout << "Using cached equilibrated state" << endl;
+        else
+        {
+            cellularAutomata = create_ca();
+            if (!cellularAutomata)
+                return 1;
+            if (warmup != 0)
+            {
+                cout << "Warming up " << warmup << " steps" << endl;
+                cellularAutomata->SetHistoryMode(HISTORY_NONE);
+                cellularAutomata->Evolve(warmup);
+            }
+            if (cache)
+                cache->Store(key, *cellularAutomata);
+        }
+        cellularAutomata->SetMeasureStart(cellularAutomata->GetStep());
+    }
+    // Al exportar por bloques los checkpoints los guarda el ciclo de evolución, después de cada exportación.
+    const bool chunked = (export_npy != "" && export_chunk != 0);
+    if (checkpoint != "")
+        cellularAutomata->SetCheckpointing(path + checkpoint, chunked ? 0 : checkpoint_interval, checkpoint_compress);
+    cellularAutomata->SetHistoryMode(history_mode, path + history_file);
+    cellularAutomata->SetImageFormat(bmp_format);
+    if (record_first != 0 || record_cells != 0 || record_start != 0 || record_stride != 1 || record_reservoir != 0)
+        cellularAutomata->SetHistoryRecording(record_first, record_cells, record_start, record_stride, record_reservoir, seed);
+    if (record_random != "")
+        cellularAutomata->RecordRandomness(record_random);
+    if (replay_random != "")
+        cellularAutomata->ReplayRandomness(replay_random);
+
+    if (keyframe_interval != 0)
+        cellularAutomata->SetKeyframeInterval(keyframe_interval);
+
+    // Barrido de densidad por continuación: cada punto parte del estado estacionario del anterior.
+    if (density_sweep >= 0.0)
+    {
+        vector<double> densities;
+        for (unsigned i = 0; i < sweep_points; ++i)
+            densities.push_back((sweep_points == 1) ? density_sweep : density + (density_sweep - density)*i/(sweep_points - 1));
+        if (sweep_back)
+            densities.insert(densities.end(), densities.rbegin() + 1, densities.rend());
+
+        cellularAutomata->SetHistoryMode(HISTORY_NONE);
+        cout << "density\tcars\tmean_ocupancy\tmean_flow" << endl;
+        vector<double> table;
+        for (size_t i = 0; i < densities.size(); ++i)
+        {
+            // El primer punto ya tiene el transitorio de la densidad inicial.
+            cellularAutomata->SetDensity(densities[i]);
+            if (i != 0)
+                cellularAutomata->Evolve(warmup);
+
+            // Todas las filas observadas son pasos medidos del punto.
+            CellStatistics point_stats(false);
+            StepObserverAdapter<CellStatistics> point_observer(point_stats);
+            cellularAutomata->SetObserver(&point_observer);
+            cellularAutomata->Evolve(iterations);
+            cellularAutomata->SetObserver(nullptr);
+            const double point[4] = { densities[i], (double)cellularAutomata->CountCars(), aux_mean(point_stats.Ocupancy()),
+                                      point_stats.MeanFlow() };
+            cout << point[0] << "\t" << (unsigned)point[1] << "\t" << point[2] << "\t" << point[3] << endl;
+            table.insert(table.end(), point, point + 4);
+        }
+        if (results)
+            results->Store(result_key, table);
+        delete cellularAutomata;
+        cout << "Done" << endl;
+        return 0;
+    }
+
+    // Las estadísticas y los mapas en línea se calculan en cada paso, así que no dependen del histórico.
+    StepObserverList observers;
+    CellStatistics cell_stats;
+    StepObserverAdapter<CellStatistics> stats_observer(cell_stats);
+    vector<unique_ptr<AsyncObserver>> async_observers;
+    auto add_observer = [&](StepObserver &observer)
+    {
+        // Cada salida asíncrona tiene su propio hilo consumidor.
+        if (async_output)
+        {
+            async_observers.emplace_back(new AsyncObserver(observer, async_queue, async_policy));
+            observers.Add(async_observers.back().get());
+        }
+        else
+            observers.Add(&observer);
+    };
+    if (online_stats)
+        add_observer(stats_observer);
+    unique_ptr<HistoryRenderer> renderer;
+    if (stream_plot)
+    {
+        if (!plot_traffic && !plot_flow)
+            plot_traffic = true;
+        cout << "Plotting while evolving" << endl;
+        renderer.reset(new HistoryRenderer(*cellularAutomata, plot_traffic ? path + "ca.bmp" : "",
+                                           plot_flow ? path + "ca_flow.bmp" : ""));
+        add_observer(*renderer);
+    }
+    unique_ptr<LiveSnapshot> snapshot;
+    if (snapshot_shm != "")
+    {
+        // La copia es barata y no debe atrasarse, así que se publica desde el hilo de simulación.
+        snapshot.reset(new LiveSnapshot(cellularAutomata->GetSize(), snapshot_interval, snapshot_shm));
+        if (snapshot->IsValid())
+            observers.Add(snapshot.get());
+    }
+    if (!observers.Empty())
+        cellularAutomata->SetObserver(&observers);
+
+    // Al continuar se descartan las filas exportadas después del checkpoint, que se vuelven a evolucionar.
+    if (resume != "" && export_npy != "")
+        cellularAutomata->TruncateHistoryNpy(path + export_npy, exported);
 
     // Itera
-    cellularAutomata->Evolve(iterations);
+    if (chunked)
+    {
+        CaStep last_checkpoint = cellularAutomata->GetStep();
+        for (unsigned done = 0; done < iterations; done += export_chunk)
+        {
+            if (done != 0)
+                cellularAutomata->ClearHistory();
+            cellularAutomata->Evolve(min(export_chunk, iterations - done));
+            exported = cellularAutomata->ExportHistoryNpy(path + export_npy, done != 0 || resume != "");
+
+            // El checkpoint guarda las filas ya exportadas, así que queda alineado con los npy.
+            if (checkpoint != "" && checkpoint_interval != 0 &&
+                cellularAutomata->GetStep() - last_checkpoint >= checkpoint_interval)
+            {
+                cellularAutomata->SaveCheckpoint(path + checkpoint, checkpoint_compress, exported);
+                last_checkpoint = cellularAutomata->GetStep();
+            }
+        }
+    }
+    else
+    {
+        cellularAutomata->Evolve(iterations);
+        if (export_npy != "")
+            exported = cellularAutomata->ExportHistoryNpy(path + export_npy, resume != "");
+    }
+    if (checkpoint != "")
+        cellularAutomata->SaveCheckpoint(path + checkpoint, checkpoint_compress, exported);
+
+    // Reemplaza el AC por una ventana regenerada desde los keyframes.
+    bool regenerated = false;
+    if (window_steps != 0)
+    {
+        cout << "Regenerating steps " << window_start << " to " << window_start + window_steps << endl;
+        CellularAutomata *window = cellularAutomata->Regenerate(window_start, window_steps).release();
+        if (window)
+        {
+            delete cellularAutomata;
+            cellularAutomata = window;
+            regenerated = true;
+        }
+    }
 
     // Genera resultados
-    if (!plot_traffic && !plot_flow)
+    cellularAutomata->SetObserver(nullptr);
+    if (snapshot)
+        snapshot->Finish();
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < async_observers.size(); ++i)
+    {
+        async_observers[i]->Close();
+        dropped += async_observers[i]->Dropped();
+    }
+    if (dropped != 0)
+        cout << "Dropped output steps: " << dropped << endl;
+    if (renderer)
+    {
+        renderer->Close();
+        plot_traffic = plot_flow = false;
+    }
+    if (online_stats)
+    {
+        vector<double> ocupancy = cell_stats.Ocupancy();
+        cout << "Steps: " << cell_stats.Rows() << endl;
+        cout << "Mean ocupancy: " << aux_mean(ocupancy) << endl;
+        cout << "Mean flow: " << cell_stats.MeanFlow() << endl;
+        if (results && dropped == 0)
+        {
+            const double values[3] = { (double)cell_stats.Rows(), aux_mean(ocupancy), cell_stats.MeanFlow() };
+            results->Store(result_key, vector<double>(values, values + 3));
+        }
+    }
+    if (history_mode == HISTORY_NONE && !regenerated)
+        plot_traffic = plot_flow = false;
+    else if (!plot_traffic && !plot_flow && !online_stats)
         plot_traffic = true;
 
-    if (plot_traffic)
+    if (tiles && (plot_traffic || plot_flow))
+    {
+        // Igual que los BMP: out_file_name nombra el único mapa dibujado. Con ambos, el de flujo lleva _flow.
+        string tiles_name = out_file_name;
+        if (tiles_name.size() > 4 && tiles_name.compare(tiles_name.size() - 4, 4, ".dzi") == 0)
+            tiles_name.erase(tiles_name.size() - 4);
+        const string flow_tiles_name = (tiles_name != "" && plot_traffic) ? tiles_name + "_flow" : tiles_name;
+        cout << "Plotting tiles" << endl;
+        cellularAutomata->DrawHistoryTiles(path, tiles_name, flow_tiles_name, tile_size, plot_traffic, plot_flow);
+    }
+    else if (plot_traffic && plot_flow && out_file_name == "")
     {
-        cout << "Plotting traffic" << endl;
-        cellularAutomata->DrawHistory(path, out_file_name);
+        cout << "Plotting traffic and flow" << endl;
+        cellularAutomata->DrawHistories(path);
     }
-    if (plot_flow)
+    else
     {
-        cout << "Plotting flow" << endl;
-        cellularAutomata->DrawFlowHistory(path, out_file_name);
+        if (plot_traffic)
+        {
+            cout << "Plotting traffic" << endl;
+            cellularAutomata->DrawHistory(path, out_file_name);
+        }
+        if (plot_flow)
+        {
+            cout << "Plotting flow" << endl;
+            cellularAutomata->DrawFlowHistory(path, out_file_name);
+        }
     }
 
     delete cellularAutomata;
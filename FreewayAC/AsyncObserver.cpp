@@ -0,0 +1,99 @@
+#include "AsyncObserver.h"
+
+#include <cstring>
+#include <chrono>
+using namespace std;
+
+AsyncObserver::AsyncObserver(StepObserver &target, const size_t capacity, const ASYNC_POLICY policy)
+    : m_target(target), m_queue(max<size_t>(2, capacity)), m_policy(policy), m_done(false)
+{
+    m_dropping = false;
+    m_dropped = 0;
+    m_thread = thread(&AsyncObserver::Run, this);
+}
+AsyncObserver::~AsyncObserver()
+{
+    Close();
+}
+template <class T> void AsyncObserver::Push(const bool flow, const CaStep step, const T* row, const CaSize size)
+{
+    // Después de Close las filas se procesan en el hilo que las envía.
+    if (!m_thread.joinable())
+    {
+        if (flow)
+            m_target.OnFlow(step, reinterpret_cast<const CaFlow*>(row), size);
+        else
+            m_target.OnVelocities(step, reinterpret_cast<const CaVelocity*>(row), size);
+        return;
+    }
+
+    // Con ASYNC_DROP las velocidades solo entran si también cabe el flujo del mismo paso.
+    if (m_policy == ASYNC_DROP)
+    {
+        if (flow ? m_dropping : m_queue.Free() < 2)
+        {
+            if (!flow)
+            {
+                m_dropping = true;
+                ++m_dropped;
+            }
+            else
+                m_dropping = false;
+            return;
+        }
+    }
+
+    Record* record;
+    while ((record = m_queue.Reserve()) == nullptr)
+        this_thread::yield();
+    record->flow = flow;
+    record->step = step;
+    record->size = size;
+    record->data.resize(size*sizeof(T));
+    memcpy(record->data.data(), row, size*sizeof(T));
+    m_queue.Commit();
+}
+void AsyncObserver::OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size)
+{
+    Push(false, step, row, size);
+}
+void AsyncObserver::OnFlow(const CaStep step, const CaFlow* row, const CaSize size)
+{
+    Push(true, step, row, size);
+}
+void AsyncObserver::Run()
+{
+    unsigned idle = 0;
+    while (true)
+    {
+        Record* record = m_queue.Front();
+        if (record == nullptr)
+        {
+            // La bandera se lee antes de revisar la cola otra vez, así que no quedan filas sin procesar.
+            if (m_done.load(memory_order_acquire) && m_queue.Front() == nullptr)
+                return;
+            if (++idle < 64)
+                this_thread::yield();
+            else
+                this_thread::sleep_for(chrono::microseconds(100));
+            continue;
+        }
+        idle = 0;
+        if (record->flow)
+            m_target.OnFlow(record->step, reinterpret_cast<const CaFlow*>(record->data.data()), record->size);
+        else
+            m_target.OnVelocities(record->step, reinterpret_cast<const CaVelocity*>(record->data.data()), record->size);
+        m_queue.Pop();
+    }
+}
+void AsyncObserver::Close()
+{
+    if (!m_thread.joinable())
+        return;
+    m_done.store(true, memory_order_release);
+    m_thread.join();
+}
+uint64_t AsyncObserver::Dropped() const noexcept
+{
+    return m_dropped;
+}
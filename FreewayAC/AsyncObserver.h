@@ -0,0 +1,73 @@
+/**
+* @file AsyncObserver.h
+* @brief Observadores de pasos ejecutados en un hilo consumidor.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _ASYNCOBSERVER
+#define _ASYNCOBSERVER
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "CellularAutomata.h"
+
+/**
+* @enum ASYNC_POLICY
+* @brief Qué hace el hilo de simulación cuando la cola de un AsyncObserver está llena.
+*
+* ASYNC_WAIT espera a que el consumidor libere lugar, así que no se pierden filas. ASYNC_DROP descarta el paso
+* completo (velocidades y flujo) y lo cuenta en AsyncObserver::Dropped, así que la simulación nunca espera.
+*/
+enum ASYNC_POLICY
+{
+    ASYNC_WAIT, ASYNC_DROP
+};
+
+/**
+* @class AsyncObserver
+* @brief Pasa las filas de cada paso a otro observador que se ejecuta en un hilo propio.
+*
+* El hilo de simulación solo copia la fila a un lugar libre de una cola SpscQueue acotada; la compresión,
+* el dibujo o la escritura a disco del observador destino ocurren en el hilo consumidor, en el mismo orden.
+* Los resultados del destino solo se deben leer después de Close.
+*/
+class AsyncObserver : public StepObserver
+{
+    struct Record
+    {
+        bool flow;                  ///< Fila de flujo o de velocidades.
+        CaStep step;
+        CaSize size;
+        std::vector<char> data;     ///< Copia de la fila. Se reutiliza entre pasos.
+    };
+
+    StepObserver &m_target;
+    SpscQueue<Record> m_queue;
+    ASYNC_POLICY m_policy;
+    std::atomic<bool> m_done;
+    bool m_dropping;                ///< Se descartaron las velocidades del paso actual.
+    uint64_t m_dropped;             ///< Pasos descartados.
+    std::thread m_thread;
+
+    template <class T> void Push(const bool flow, const CaStep step, const T* row, const CaSize size);
+    void Run();
+public:
+    ///@brief Constructor. Inicia el hilo consumidor.
+    ///@param target Observador que procesa las filas. No se toma posesión de él.
+    ///@param capacity Filas que caben en la cola.
+    ///@param policy Qué hacer con la cola llena.
+    AsyncObserver(StepObserver &target, const std::size_t capacity = 64, const ASYNC_POLICY policy = ASYNC_WAIT);
+    ~AsyncObserver();
+    AsyncObserver(const AsyncObserver&) = delete;
+    AsyncObserver &operator=(const AsyncObserver&) = delete;
+
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size);
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size);
+
+    void Close();                           ///< Espera a que se procesen las filas pendientes y termina el hilo.
+    uint64_t Dropped() const noexcept;      ///< Devuelve pasos descartados con ASYNC_DROP.
+};
+
+#endif
@@ -3,24 +3,593 @@
 #include <chrono>
 #include <random>
 #include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <cerrno>
+#include <cmath>
+#include <cctype>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
 using namespace std;
 
 
+/****************************
+*                           *
+*      Memoria grande       *
+*                           *
+****************************/
+
+void* aux_alloc_large(const size_t bytes, bool &huge)
+{
+    huge = false;
+    if (bytes == 0)
+        return nullptr;
+
+#if defined(__linux__)
+    const size_t huge_page = 2*1024*1024;
+    if (bytes >= huge_page)
+    {
+        void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+#if defined(MADV_HUGEPAGE)
+            madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+            huge = true;
+            return ptr;
+        }
+    }
+#endif
+    return malloc(bytes);
+}
+void aux_free_large(void* ptr, const size_t bytes, const bool huge)
+{
+    if (ptr == nullptr)
+        return;
+#if defined(__linux__)
+    if (huge)
+    {
+        munmap(ptr, bytes);
+        return;
+    }
+#endif
+    (void)bytes;
+    (void)huge;
+    free(ptr);
+}
+
+void* aux_alloc_huge(const size_t bytes, const bool explicit_pages, HUGE_PAGES &pages)
+{
+    pages = PAGES_NORMAL;
+    if (bytes == 0)
+        return nullptr;
+
+#if defined(__linux__)
+    const size_t huge_page = 2*1024*1024;
+    const size_t rounded = (bytes + huge_page - 1)/huge_page*huge_page;
+#if defined(MAP_HUGETLB)
+    if (explicit_pages)
+    {
+        void* ptr = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            pages = PAGES_EXPLICIT;
+            return ptr;
+        }
+    }
+#endif
+
+    // Se reserva una página enorme de más y se recorta para que el bloque empiece alineado.
+    char* raw = static_cast<char*>(mmap(nullptr, rounded + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (raw == MAP_FAILED)
+        return nullptr;
+    const size_t head = (huge_page - (size_t)((uintptr_t)raw % huge_page)) % huge_page;
+    if (head != 0)
+        munmap(raw, head);
+    if (huge_page - head != 0)
+        munmap(raw + head + rounded, huge_page - head);
+#if defined(MADV_HUGEPAGE)
+    madvise(raw + head, rounded, MADV_HUGEPAGE);
+#endif
+    pages = PAGES_TRANSPARENT;
+    return raw + head;
+#else
+    (void)explicit_pages;
+    bool huge = false;
+    return aux_alloc_large(bytes, huge);
+#endif
+}
+void aux_free_huge(void* ptr, const size_t bytes, const HUGE_PAGES pages)
+{
+    if (ptr == nullptr)
+        return;
+#if defined(__linux__)
+    if (pages != PAGES_NORMAL)
+    {
+        const size_t huge_page = 2*1024*1024;
+        munmap(ptr, (bytes + huge_page - 1)/huge_page*huge_page);
+        return;
+    }
+#endif
+    (void)pages;
+    aux_free_large(ptr, bytes, false);
+}
+
+uint64_t aux_hypergeometric(const uint64_t total, const uint64_t successes, const uint64_t draws, double u)
+{
+    const uint64_t failures = total - successes;
+    const uint64_t low = (draws > failures) ? draws - failures : 0;
+    const uint64_t high = min(draws, successes);
+    if (low == high)
+        return low;
+
+    // Probabilidad de la moda y recorrido alternado hacia ambos lados con las razones entre términos.
+    const uint64_t mode = min(high, max(low, (uint64_t)(((double)draws + 1.0)*((double)successes + 1.0)/((double)total + 2.0))));
+    auto log_choose = [](const double n, const double k) { return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0); };
+    const double p_mode = exp(log_choose((double)successes, (double)mode) + log_choose((double)failures, (double)(draws - mode))
+                              - log_choose((double)total, (double)draws));
+    const double K = (double)successes, n = (double)draws, F = (double)failures;
+
+    u -= p_mode;
+    if (u <= 0.0)
+        return mode;
+    uint64_t up = mode, down = mode;
+    double p_up = p_mode, p_down = p_mode;
+    while (up < high || down > low)
+    {
+        if (up < high)
+        {
+            const double k = (double)up;
+            p_up *= (K - k)*(n - k)/((k + 1.0)*(F - n + k + 1.0));
+            ++up;
+            u -= p_up;
+            if (u <= 0.0)
+                return up;
+        }
+        if (down > low)
+        {
+            const double k = (double)down;
+            p_down *= k*(F - n + k)/((K - k + 1.0)*(n - k + 1.0));
+            --down;
+            u -= p_down;
+            if (u <= 0.0)
+                return down;
+        }
+    }
+    // Solo por redondeo.
+    return mode;
+}
+
+bool aux_make_dir(const string &path)
+{
+#if defined(_WIN32)
+    return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+MappedFile::MappedFile()
+{
+    m_data = nullptr;
+    m_size = 0;
+#if defined(_WIN32)
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = nullptr;
+#else
+    m_fd = -1;
+#endif
+}
+MappedFile::~MappedFile()
+{
+    Close();
+}
+bool MappedFile::Open(const string &filepath, const size_t length)
+{
+    Close();
+#if defined(_WIN32)
+    m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(m_file, &file_size))
+    {
+        Close();
+        return false;
+    }
+    m_size = (length == 0) ? (size_t)file_size.QuadPart : length;
+    if (m_size == 0 || m_size > (size_t)file_size.QuadPart)
+    {
+        Close();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, m_size));
+#else
+    m_fd = open(filepath.c_str(), O_RDONLY);
+    if (m_fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+        Close();
+        return false;
+    }
+    m_size = (length == 0) ? (size_t)st.st_size : length;
+    if (m_size == 0 || m_size > (size_t)st.st_size)
+    {
+        Close();
+        return false;
+    }
+    void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    m_data = (ptr == MAP_FAILED) ? nullptr : static_cast<const char*>(ptr);
+#endif
+    if (m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+    if (m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+    if (m_fd != -1)
+        close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+const char* MappedFile::Data() const noexcept
+{
+    return m_data;
+}
+size_t MappedFile::Size() const noexcept
+{
+    return m_size;
+}
+bool MappedFile::IsOpen() const noexcept
+{
+    return m_data != nullptr;
+}
+
+SharedMemory::SharedMemory()
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_owner = false;
+#if defined(_WIN32)
+    m_mapping = nullptr;
+#endif
+}
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+string SharedMemory::SystemName(const string &name)
+{
+#if defined(_WIN32)
+    return "Local\\FreewayAC_" + name;
+#else
+    return "/" + name;
+#endif
+}
+bool SharedMemory::Create(const string &name, const size_t size)
+{
+    Close();
+    m_name = SystemName(name);
+#if defined(_WIN32)
+    m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                   (DWORD)(size & 0xFFFFFFFF), m_name.c_str());
+    if (m_mapping == nullptr)
+        return false;
+    m_data = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+#else
+    shm_unlink(m_name.c_str());
+    const int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1)
+        return false;
+    void* ptr = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    m_data = (ptr == MAP_FAILED) ? nullptr : static_cast<char*>(ptr);
+    if (m_data == nullptr)
+        shm_unlink(m_name.c_str());
+#endif
+    if (m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    m_size = size;
+    m_owner = true;
+    return true;
+}
+bool SharedMemory::Open(const string &name)
+{
+    Close();
+    m_name = SystemName(name);
+#if defined(_WIN32)
+    m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, m_name.c_str());
+    if (m_mapping == nullptr)
+        return false;
+    m_data = static_cast<char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info;
+    if (m_data != nullptr && VirtualQuery(m_data, &info, sizeof(info)) != 0)
+        m_size = info.RegionSize;
+#else
+    const int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void* ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        m_size = (size_t)st.st_size;
+        ptr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    m_data = (ptr == MAP_FAILED) ? nullptr : static_cast<char*>(ptr);
+#endif
+    if (m_data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+void SharedMemory::Close()
+{
+#if defined(_WIN32)
+    if (m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+    m_mapping = nullptr;
+#else
+    if (m_data != nullptr)
+        munmap(m_data, m_size);
+    if (m_owner)
+        shm_unlink(m_name.c_str());
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_owner = false;
+}
+char* SharedMemory::Data() const noexcept
+{
+    return m_data;
+}
+size_t SharedMemory::Size() const noexcept
+{
+    return m_size;
+}
+bool SharedMemory::IsOpen() const noexcept
+{
+    return m_data != nullptr;
+}
+
+unsigned long aux_process_id()
+{
+#if defined(_WIN32)
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+bool aux_process_alive(const unsigned long pid)
+{
+#if defined(_WIN32)
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (process == nullptr)
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD code = 0;
+    const bool alive = !GetExitCodeProcess(process, &code) || code == STILL_ACTIVE;
+    CloseHandle(process);
+    return alive;
+#else
+    // La señal 0 solo comprueba que el proceso existe. EPERM indica que existe pero es de otro usuario.
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+vector<unsigned> aux_allowed_cpus()
+{
+    vector<unsigned> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty())
+    {
+        for (unsigned cpu = 0; cpu < max(1u, thread::hardware_concurrency()); ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+int aux_cpu_node(const unsigned cpu)
+{
+#if defined(_WIN32)
+    UCHAR node = 0;
+    if (cpu < 64 && GetNumaProcessorNode((UCHAR)cpu, &node) && node != 0xFF)
+        return (int)node;
+#elif defined(__linux__)
+    // El directorio de cada CPU contiene un enlace nodeN a su nodo.
+    const string dir_path = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+    DIR* dir = opendir(dir_path.c_str());
+    if (dir != nullptr)
+    {
+        int node = -1;
+        for (dirent* entry = readdir(dir); entry != nullptr && node == -1; entry = readdir(dir))
+        {
+            const string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 && isdigit((unsigned char)name[4]))
+                node = atoi(name.c_str() + 4);
+        }
+        closedir(dir);
+        if (node != -1)
+            return node;
+    }
+#else
+    (void)cpu;
+#endif
+    return 0;
+}
+bool aux_pin_thread(const unsigned cpu)
+{
+#if defined(_WIN32)
+    return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+int aux_current_cpu()
+{
+#if defined(_WIN32)
+    return (int)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+int aux_memory_node(const void* ptr)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    // get_mempolicy con MPOL_F_NODE | MPOL_F_ADDR devuelve el nodo de la página, sin depender de libnuma.
+    const unsigned long MPOL_F_NODE_FLAG = 1, MPOL_F_ADDR_FLAG = 2;
+    int node = -1;
+    if (ptr != nullptr && syscall(SYS_get_mempolicy, &node, nullptr, 0UL, ptr, MPOL_F_NODE_FLAG | MPOL_F_ADDR_FLAG) == 0)
+        return node;
+    return -1;
+#else
+    (void)ptr;
+    return -1;
+#endif
+}
+
+FileLock::FileLock(const string &filepath)
+{
+    m_locked = false;
+#if defined(_WIN32)
+    m_file = CreateFileA(filepath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return;
+    OVERLAPPED overlapped = {};
+    m_locked = LockFileEx(m_file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+    m_fd = open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd == -1)
+        return;
+    int result;
+    do
+        result = flock(m_fd, LOCK_EX);
+    while (result == -1 && errno == EINTR);
+    m_locked = (result == 0);
+#endif
+}
+FileLock::~FileLock()
+{
+#if defined(_WIN32)
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        if (m_locked)
+        {
+            OVERLAPPED overlapped = {};
+            UnlockFileEx(m_file, 0, MAXDWORD, MAXDWORD, &overlapped);
+        }
+        CloseHandle(m_file);
+    }
+#else
+    if (m_fd != -1)
+    {
+        if (m_locked)
+            flock(m_fd, LOCK_UN);
+        close(m_fd);
+    }
+#endif
+}
+bool FileLock::IsLocked() const noexcept
+{
+    return m_locked;
+}
+
+
 /****************************
 *                           *
 *  Generador de aleatorios  *
 *                           *
 ****************************/
 
-RandomAlgorithm RandomGen::m_ra = MT19937;
-std::mt19937 RandomGen::mt;
-std::ranlux24 RandomGen::rl24;
-std::ranlux48 RandomGen::rl48;
+thread_local RandomAlgorithm RandomGen::m_ra = MT19937;
+thread_local std::mt19937 RandomGen::mt;
+thread_local std::ranlux24 RandomGen::rl24;
+thread_local std::ranlux48 RandomGen::rl48;
+thread_local Xoshiro256ss RandomGen::xs256;
+thread_local Pcg64 RandomGen::pcg64;
 
 void RandomGen::SetAlgorithm(RandomAlgorithm ra)
 {
     m_ra = ra;
 }
+RandomAlgorithm RandomGen::GetAlgorithm()
+{
+    return m_ra;
+}
 void RandomGen::Seed(int seed)
 {
     if (seed == -1)
@@ -40,23 +609,94 @@ void RandomGen::Seed(int seed)
     case RANLUX48:
         rl48.seed(seed);
         break;
+    case XOSHIRO256SS:
+        xs256.seed((uint64_t)seed);
+        break;
+    case PCG64:
+        pcg64.seed((uint64_t)seed);
+        break;
     };
 }
+string RandomGen::GetState()
+{
+    ostringstream os;
+    os << (int)m_ra << ' ';
+    switch (m_ra)
+    {
+    case MT19937:
+        os << mt;
+        break;
+    case RANLUX24:
+        os << rl24;
+        break;
+    case RANLUX48:
+        os << rl48;
+        break;
+    case XOSHIRO256SS:
+        os << xs256;
+        break;
+    case PCG64:
+        os << pcg64;
+        break;
+    case LCG:
+        break;
+    };
+    return os.str();
+}
+bool RandomGen::SetState(const string &state)
+{
+    istringstream is(state);
+    int ra;
+    if (!(is >> ra) || ra < LCG || ra > PCG64)
+        return false;
+
+    m_ra = (RandomAlgorithm)ra;
+    switch (m_ra)
+    {
+    case MT19937:
+        is >> mt;
+        break;
+    case RANLUX24:
+        is >> rl24;
+        break;
+    case RANLUX48:
+        is >> rl48;
+        break;
+    case XOSHIRO256SS:
+        is >> xs256;
+        break;
+    case PCG64:
+        is >> pcg64;
+        break;
+    case LCG:
+        return false;
+    };
+    return !is.fail();
+}
 int RandomGen::GetInt(int i)
 {
     switch (m_ra)
     {
     case MT19937:
-        return mt() % i;
+        return (int)aux_bounded_rand(mt, (uint32_t)i);
         break;
     case LCG:
-        return rand() % i;
+    {
+        LcgEngine lcg;
+        return uniform_int_distribution<int>(0, i - 1)(lcg);
         break;
+    }
     case RANLUX24:
-        return rl24() % i;
+        return uniform_int_distribution<int>(0, i - 1)(rl24);
         break;
     case RANLUX48:
-        return rl48() % i;
+        return uniform_int_distribution<int>(0, i - 1)(rl48);
+        break;
+    case XOSHIRO256SS:
+        return (int)aux_bounded_rand(xs256, (uint32_t)i);
+        break;
+    case PCG64:
+        return (int)aux_bounded_rand(pcg64, (uint32_t)i);
         break;
     };
     return 0;
@@ -77,6 +717,61 @@ double RandomGen::GetDouble()
     case RANLUX48:
         return (double)rl48()/(double)rl48.max();
         break;
+    case XOSHIRO256SS:
+        return (double)(xs256() >> 11)/9007199254740992.0;
+        break;
+    case PCG64:
+        return (double)(pcg64() >> 11)/9007199254740992.0;
+        break;
     };
     return 0.0;
 }
+
+void RandomGen::FillBernoulli(uint64_t* words, const size_t n, const double prob)
+{
+    switch (m_ra)
+    {
+    case MT19937:
+        aux_fill_bernoulli(mt, words, n, prob);
+        break;
+    case LCG:
+    {
+        LcgEngine lcg;
+        aux_fill_bernoulli(lcg, words, n, prob);
+        break;
+    }
+    case RANLUX24:
+        aux_fill_bernoulli(rl24, words, n, prob);
+        break;
+    case RANLUX48:
+        aux_fill_bernoulli(rl48, words, n, prob);
+        break;
+    case XOSHIRO256SS:
+        aux_fill_bernoulli(xs256, words, n, prob);
+        break;
+    case PCG64:
+        aux_fill_bernoulli(pcg64, words, n, prob);
+        break;
+    };
+}
+
+BernoulliMask::BernoulliMask()
+{
+    m_size = 0;
+    m_cursor = 0;
+    m_prob = 0.0;
+}
+void BernoulliMask::Fill(const size_t n, const double prob)
+{
+    if (m_words.size() < (n + 63)/64)
+        m_words.resize((n + 63)/64);
+
+    RandomGen::FillBernoulli(m_words.data(), n, prob);
+    m_size = n;
+    m_cursor = 0;
+    m_prob = prob;
+}
+size_t BernoulliMask::Size() const noexcept
+{
+    return m_size;
+}
@@ -11,6 +11,17 @@
 #include <vector>
 #include <numeric>
 #include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 /**
 * @brief Informa si find_val está dentro de v.
@@ -94,6 +105,322 @@ template <class N> N aux_string_to_num(const std::string &s)
     return static_cast<N>(x);
 }
 
+/**
+* @brief Cuenta los bits encendidos de x.
+*/
+inline int aux_popcount64(const uint64_t x)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+/**
+* @brief Devuelve la posición del bit encendido menos significativo de x. x no debe ser cero.
+*/
+inline int aux_ctz64(const uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+/**
+* @brief Reserva memoria para arreglos grandes. Desde 2 MiB se usan páginas anónimas alineadas
+* con páginas enormes transparentes (Linux), en otro caso malloc.
+* @param bytes Tamaño en bytes.
+* @param huge Se asigna verdadero si la memoria se reservó con páginas enormes.
+* @return Puntero a la memoria o nullptr si no hay memoria disponible.
+*/
+void* aux_alloc_large(const std::size_t bytes, bool &huge);
+
+/**
+* @brief Libera memoria reservada con aux_alloc_large.
+*/
+void aux_free_large(void* ptr, const std::size_t bytes, const bool huge);
+
+/**
+* @enum HUGE_PAGES
+* @brief Tipo de páginas con que se reservó memoria con aux_alloc_huge.
+*/
+enum HUGE_PAGES
+{
+    PAGES_NORMAL, PAGES_TRANSPARENT, PAGES_EXPLICIT
+};
+
+/**
+* @brief Reserva memoria alineada a 2 MiB para arreglos muy grandes, de modo que las páginas enormes cubren todo el
+* bloque. En Linux usa páginas enormes explícitas (MAP_HUGETLB) si se piden y hay disponibles, si no páginas
+* enormes transparentes. En otros sistemas equivale a aux_alloc_large.
+* @param bytes Tamaño en bytes. Se redondea a un múltiplo de 2 MiB.
+* @param explicit_pages Intentar primero páginas enormes explícitas.
+* @param pages Se asigna el tipo de páginas usado.
+* @return Puntero a la memoria o nullptr si no hay memoria disponible.
+*/
+void* aux_alloc_huge(const std::size_t bytes, const bool explicit_pages, HUGE_PAGES &pages);
+
+/**
+* @brief Libera memoria reservada con aux_alloc_huge.
+*/
+void aux_free_huge(void* ptr, const std::size_t bytes, const HUGE_PAGES pages);
+
+/**
+* @brief Algoritmo de Floyd: marca k de las n casillas (vacías) con value. rand(m) devuelve un entero uniforme en [0, m).
+* Antes de la iteración j solo hay casillas marcadas en [0, j), así que la casilla j siempre está libre.
+*/
+template <class Cell, class Index, class Rand>
+void aux_floyd_sample(Cell* cells, const Index n, const Index k, const Cell empty, const Cell value, Rand rand)
+{
+    for (Index j = n - k; j < n; ++j)
+    {
+        const Index t = rand(j + 1);
+        if (cells[t] == empty)
+            cells[t] = value;
+        else
+            cells[j] = value;
+    }
+}
+
+/**
+* @brief Ejecuta task(i) para i en [0, count) repartiendo los índices entre hilos.
+* @param count Cantidad de tareas.
+* @param work Trabajo total aproximado. Con menos de 2^20 unidades se usa un solo hilo.
+* @param task Tarea. Debe poder ejecutarse en paralelo con distintos índices.
+*/
+template <class Task> void aux_run_parallel(const unsigned count, const std::size_t work, Task task)
+{
+    unsigned threads = std::min(std::max(1u, std::thread::hardware_concurrency()), count);
+    if (work < ((std::size_t)1 << 20))
+        threads = 1;
+
+    std::atomic<unsigned> next(0);
+    auto worker = [&]()
+    {
+        for (unsigned i = next++; i < count; i = next++)
+            task(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        try
+        {
+            pool.push_back(std::thread(worker));
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+    worker();
+    for (std::size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+}
+
+/**
+* @brief Suma FNV-1a de 64 bits.
+*/
+inline uint64_t aux_fnv1a(const char* data, const std::size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+* @brief Crea un directorio. El directorio padre debe existir.
+* @return Verdadero si el directorio existe al terminar.
+*/
+bool aux_make_dir(const std::string &path);
+
+/**
+* @class MappedFile
+* @brief Archivo proyectado en memoria de solo lectura (mmap en POSIX, MapViewOfFile en Windows).
+*/
+class MappedFile
+{
+    const char* m_data;
+    std::size_t m_size;
+#if defined(_WIN32)
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    ///@brief Proyecta el archivo en memoria.
+    ///@param filepath Ruta del archivo.
+    ///@param length Bytes a proyectar desde el inicio. 0 proyecta el archivo completo.
+    ///@return Verdadero si se pudo proyectar.
+    bool Open(const std::string &filepath, const std::size_t length = 0);
+    void Close();                                   ///< Libera la proyección.
+    const char* Data() const noexcept;              ///< Devuelve puntero al inicio del archivo.
+    std::size_t Size() const noexcept;              ///< Devuelve bytes proyectados.
+    bool IsOpen() const noexcept;                   ///< Informa si hay un archivo proyectado.
+};
+
+/**
+* @class SharedMemory
+* @brief Memoria compartida con nombre entre procesos locales (shm_open en POSIX, CreateFileMapping en Windows).
+* Quien la crea la puede escribir y la elimina al cerrarla; quien la abre por nombre solo la puede leer.
+*/
+class SharedMemory
+{
+    char* m_data;
+    std::size_t m_size;
+    bool m_owner;
+    std::string m_name;
+#if defined(_WIN32)
+    void* m_mapping;
+#endif
+    static std::string SystemName(const std::string &name);
+public:
+    SharedMemory();
+    ~SharedMemory();
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory &operator=(const SharedMemory&) = delete;
+
+    ///@brief Crea la memoria, llena de ceros, para escribirla. Reemplaza una anterior con el mismo nombre.
+    ///@param name Nombre sin ruta.
+    ///@param size Tamaño en bytes.
+    ///@return Verdadero si se pudo crear.
+    bool Create(const std::string &name, const std::size_t size);
+
+    ///@brief Abre una memoria creada por otro proceso, de solo lectura.
+    ///@return Verdadero si existe.
+    bool Open(const std::string &name);
+
+    void Close();                                   ///< Libera la memoria. La elimina si la creó este objeto.
+    char* Data() const noexcept;                    ///< Devuelve puntero al inicio.
+    std::size_t Size() const noexcept;              ///< Devuelve tamaño en bytes.
+    bool IsOpen() const noexcept;                   ///< Informa si hay memoria abierta.
+};
+
+/**
+* @brief Devuelve el identificador del proceso actual.
+*/
+unsigned long aux_process_id();
+
+/**
+* @brief Informa si existe un proceso local con el identificador pid. Si no se puede saber devuelve verdadero.
+*/
+bool aux_process_alive(const unsigned long pid);
+
+/**
+* @brief Devuelve las CPU en que el proceso puede ejecutar hilos, en orden.
+*/
+std::vector<unsigned> aux_allowed_cpus();
+
+/**
+* @brief Devuelve el nodo NUMA de la CPU, o 0 si el sistema no informa nodos.
+*/
+int aux_cpu_node(const unsigned cpu);
+
+/**
+* @brief Fija el hilo actual a una CPU.
+* @return Verdadero si el sistema lo permitió.
+*/
+bool aux_pin_thread(const unsigned cpu);
+
+/**
+* @brief Devuelve la CPU en que se ejecuta el hilo actual, o -1 si no se sabe.
+*/
+int aux_current_cpu();
+
+/**
+* @brief Devuelve el nodo NUMA de la página que contiene ptr, o -1 si no se sabe. La página ya debe estar escrita.
+*/
+int aux_memory_node(const void* ptr);
+
+/**
+* @class FileLock
+* @brief Bloqueo exclusivo entre procesos sobre un archivo (flock en POSIX, LockFileEx en Windows).
+* El archivo se crea si no existe y el bloqueo se libera al destruir el objeto.
+*/
+class FileLock
+{
+#if defined(_WIN32)
+    void* m_file;
+#else
+    int m_fd;
+#endif
+    bool m_locked;
+public:
+    ///@brief Constructor. Espera hasta obtener el bloqueo.
+    ///@param filepath Ruta del archivo de bloqueo.
+    explicit FileLock(const std::string &filepath);
+    ~FileLock();
+    FileLock(const FileLock&) = delete;
+    FileLock &operator=(const FileLock&) = delete;
+
+    bool IsLocked() const noexcept;                 ///< Informa si se obtuvo el bloqueo.
+};
+
+/**
+* @class SpscQueue
+* @brief Cola circular acotada sin bloqueos para un productor y un consumidor.
+*
+* Los elementos se construyen una vez y se reutilizan: el productor llena en su lugar el elemento devuelto
+* por Reserve y lo publica con Commit; el consumidor lee Front y lo libera con Pop.
+*/
+template <class T> class SpscQueue
+{
+    std::vector<T> m_items;
+    std::atomic<std::size_t> m_head;               ///< Siguiente elemento a leer. Solo lo escribe el consumidor.
+    char m_padding[64];                            ///< Separa los índices en líneas de caché distintas.
+    std::atomic<std::size_t> m_tail;               ///< Siguiente elemento a escribir. Solo lo escribe el productor.
+public:
+    ///@brief Constructor.
+    ///@param capacity Elementos que caben en la cola.
+    explicit SpscQueue(const std::size_t capacity) : m_items(capacity + 1), m_head(0), m_tail(0) {}
+
+    ///@brief Devuelve el siguiente elemento libre o nullptr si la cola está llena. Solo para el productor.
+    T* Reserve() noexcept
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        const std::size_t next = (tail + 1 == m_items.size()) ? 0 : tail + 1;
+        return (next == m_head.load(std::memory_order_acquire)) ? nullptr : &m_items[tail];
+    }
+    ///@brief Publica el elemento devuelto por Reserve. Solo para el productor.
+    void Commit() noexcept
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_tail.store((tail + 1 == m_items.size()) ? 0 : tail + 1, std::memory_order_release);
+    }
+    ///@brief Devuelve el elemento más antiguo o nullptr si la cola está vacía. Solo para el consumidor.
+    T* Front() noexcept
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        return (head == m_tail.load(std::memory_order_acquire)) ? nullptr : &m_items[head];
+    }
+    ///@brief Libera el elemento devuelto por Front. Solo para el consumidor.
+    void Pop() noexcept
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        m_head.store((head + 1 == m_items.size()) ? 0 : head + 1, std::memory_order_release);
+    }
+    ///@brief Devuelve elementos libres. Exacto solo desde el productor.
+    std::size_t Free() const noexcept
+    {
+        const std::size_t head = m_head.load(std::memory_order_acquire), tail = m_tail.load(std::memory_order_relaxed);
+        return (head + m_items.size() - tail - 1) % m_items.size();
+    }
+};
+
 /****************************
 *                           *
 *  Generador de aleatorios  *
@@ -106,24 +433,304 @@ template <class N> N aux_string_to_num(const std::string &s)
 */
 enum RandomAlgorithm
 {
-    LCG, MT19937, RANLUX24, RANLUX48
+    LCG, MT19937, RANLUX24, RANLUX48, XOSHIRO256SS, PCG64
+};
+
+/**
+* @class SplitMix64
+* @brief Generador SplitMix64. Se usa para expandir semillas de los demás generadores.
+*/
+class SplitMix64
+{
+    uint64_t m_state;
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit SplitMix64(const uint64_t seed = 0) : m_state(seed) {}
+    void seed(const uint64_t seed) { m_state = seed; }
+
+    inline result_type operator()() noexcept
+    {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+/**
+* @class Xoshiro256ss
+* @brief Generador xoshiro256** de Blackman y Vigna. Periodo 2^256 - 1.
+*/
+class Xoshiro256ss
+{
+    uint64_t m_s[4];
+
+    static inline uint64_t rotl(const uint64_t x, const int k) noexcept
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit Xoshiro256ss(const uint64_t seed = 0) { this->seed(seed); }
+    void seed(const uint64_t seed)
+    {
+        SplitMix64 sm(seed);
+        for (int i = 0; i < 4; ++i)
+            m_s[i] = sm();
+    }
+
+    inline result_type operator()() noexcept
+    {
+        const uint64_t result = rotl(m_s[1]*5, 7)*9;
+        const uint64_t t = m_s[1] << 17;
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotl(m_s[3], 45);
+        return result;
+    }
+
+    ///@brief Escribe y lee el estado en texto, igual que los generadores de la biblioteca estándar.
+    friend std::ostream &operator<<(std::ostream &os, const Xoshiro256ss &e)
+    {
+        return os << e.m_s[0] << ' ' << e.m_s[1] << ' ' << e.m_s[2] << ' ' << e.m_s[3];
+    }
+    friend std::istream &operator>>(std::istream &is, Xoshiro256ss &e)
+    {
+        return is >> e.m_s[0] >> e.m_s[1] >> e.m_s[2] >> e.m_s[3];
+    }
+};
+
+/**
+* @class Pcg64
+* @brief Generador PCG64 (XSL-RR 128/64) de O'Neill. Estado de 128 bits en dos palabras de 64 bits.
+*/
+class Pcg64
+{
+    uint64_t m_hi, m_lo;            ///< Estado.
+    uint64_t m_inc_hi, m_inc_lo;    ///< Incremento (impar).
+
+    ///@brief Multiplica a*b y devuelve los 128 bits del resultado.
+    static inline void mul64(const uint64_t a, const uint64_t b, uint64_t &hi, uint64_t &lo) noexcept
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 r = (unsigned __int128)a*b;
+        hi = (uint64_t)(r >> 64);
+        lo = (uint64_t)r;
+#else
+        const uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+        const uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+        const uint64_t p0 = a_lo*b_lo, p1 = a_lo*b_hi, p2 = a_hi*b_lo, p3 = a_hi*b_hi;
+        const uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+        lo = (mid << 32) | (uint32_t)p0;
+        hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+    }
+    inline void advance() noexcept
+    {
+        const uint64_t mult_hi = 0x2360ED051FC65DA4ULL, mult_lo = 0x4385DF649FCCF645ULL;
+        uint64_t hi, lo;
+        mul64(m_lo, mult_lo, hi, lo);
+        hi += m_hi*mult_lo + m_lo*mult_hi;
+        m_lo = lo + m_inc_lo;
+        m_hi = hi + m_inc_hi + (m_lo < lo);
+    }
+public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit Pcg64(const uint64_t seed = 0) { this->seed(seed); }
+    void seed(const uint64_t seed)
+    {
+        SplitMix64 sm(seed);
+        m_inc_hi = sm();
+        m_inc_lo = sm() | 1;
+        m_hi = 0;
+        m_lo = 0;
+        advance();
+        uint64_t s_lo = sm();
+        m_lo += s_lo;
+        m_hi += sm() + (m_lo < s_lo);
+        advance();
+    }
+
+    inline result_type operator()() noexcept
+    {
+        advance();
+        const uint64_t xsl = m_hi ^ m_lo;
+        const unsigned rot = (unsigned)(m_hi >> 58);
+        return (xsl >> rot) | (xsl << ((64 - rot) & 63));
+    }
+
+    ///@brief Escribe y lee el estado en texto, igual que los generadores de la biblioteca estándar.
+    friend std::ostream &operator<<(std::ostream &os, const Pcg64 &e)
+    {
+        return os << e.m_hi << ' ' << e.m_lo << ' ' << e.m_inc_hi << ' ' << e.m_inc_lo;
+    }
+    friend std::istream &operator>>(std::istream &is, Pcg64 &e)
+    {
+        return is >> e.m_hi >> e.m_lo >> e.m_inc_hi >> e.m_inc_lo;
+    }
+};
+
+/**
+* @class LcgEngine
+* @brief Adaptador de rand() con la interfaz de los generadores de la biblioteca estándar.
+*/
+class LcgEngine
+{
+public:
+    typedef unsigned result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return RAND_MAX; }
+    inline result_type operator()() { return (result_type)rand(); }
 };
 
+/**
+* @brief Devuelve 32 bits aleatorios de un generador con salida de 32 o 64 bits completos.
+*/
+template <class Engine> inline uint32_t aux_rand32(Engine &engine)
+{
+    const uint64_t x = (uint64_t)engine();
+    return (Engine::max() > 0xFFFFFFFFULL) ? (uint32_t)(x >> 32) : (uint32_t)x;
+}
+
+/**
+* @brief Devuelve entero uniforme en [0, range) sin sesgo (método de multiplicación de Lemire).
+* Requiere un generador con salida de 32 o 64 bits completos.
+*/
+template <class Engine> uint32_t aux_bounded_rand(Engine &engine, const uint32_t range)
+{
+    uint64_t m = (uint64_t)aux_rand32(engine)*range;
+    uint32_t l = (uint32_t)m;
+    if (l < range)
+    {
+        const uint32_t t = (0u - range) % range;
+        while (l < t)
+        {
+            m = (uint64_t)aux_rand32(engine)*range;
+            l = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+/**
+* @brief Muestra de la distribución hipergeométrica: cuántos de draws elementos tomados sin reemplazo
+* de total elementos son de los successes marcados. Inversión desde la moda, con costo proporcional a
+* la desviación estándar.
+* @param u Número aleatorio uniforme en [0, 1).
+*/
+uint64_t aux_hypergeometric(const uint64_t total, const uint64_t successes, const uint64_t draws, double u);
+
+/**
+* @brief Llena words con n decisiones de Bernoulli de probabilidad prob empaquetadas en bits.
+* Se compara la salida entera del generador con un umbral (x <= prob*max), equivalente a
+* x/max <= prob sin conversiones a double. El ciclo de comparación y empaquetado no tiene
+* ramas y el compilador lo vectoriza.
+* @param engine Generador. Es un parámetro de plantilla para que la llamada se resuelva en tiempo de compilación.
+* @param words Arreglo de destino con al menos (n + 63)/64 elementos.
+*/
+template <class Engine> void aux_fill_bernoulli(Engine &engine, uint64_t* words, const std::size_t n, const double prob)
+{
+    const uint64_t max = (uint64_t)(Engine::max() - Engine::min());
+    uint64_t threshold;
+    if (prob >= 1.0)
+        threshold = max;
+    else if (prob <= 0.0)
+        threshold = 0;
+    else
+        threshold = (uint64_t)(prob*(double)max);
+
+    uint64_t raw[64];
+    for (std::size_t w = 0; w*64 < n; ++w)
+    {
+        const std::size_t count = (n - w*64 < 64) ? n - w*64 : 64;
+        for (std::size_t k = 0; k < count; ++k)
+            raw[k] = (uint64_t)(engine() - Engine::min());
+
+        uint64_t bits = 0;
+        for (std::size_t k = 0; k < count; ++k)
+            bits |= (uint64_t)(raw[k] <= threshold) << k;
+        words[w] = bits;
+    }
+}
+
 /**
 * @class RandomGen
 * @brief Generador de números aleatorios.
+* Cada hilo tiene su propio generador, de modo que varios AC pueden evolucionar en paralelo.
 */
 class RandomGen
 {
-    static RandomAlgorithm m_ra;
-    static std::mt19937 mt;
-    static std::ranlux24 rl24;
-    static std::ranlux48 rl48;
+    static thread_local RandomAlgorithm m_ra;
+    static thread_local std::mt19937 mt;
+    static thread_local std::ranlux24 rl24;
+    static thread_local std::ranlux48 rl48;
+    static thread_local Xoshiro256ss xs256;
+    static thread_local Pcg64 pcg64;
 public:
     static void SetAlgorithm(RandomAlgorithm ra);
+    static RandomAlgorithm GetAlgorithm();
     static void Seed(int seed = -1);
+
+    ///@brief Devuelve el algoritmo y el estado del generador del hilo actual en texto.
+    ///El estado de LCG (rand()) no es accesible y no se guarda.
+    static std::string GetState();
+
+    ///@brief Restaura un estado devuelto por GetState. Devuelve falso si el estado es inválido.
+    static bool SetState(const std::string &state);
+
+    ///@brief Devuelve entero uniforme en [0, i) sin sesgo.
     static int GetInt(int i);
     static double GetDouble();
+
+    ///@brief Llena words con n decisiones de Bernoulli empaquetadas en bits (bit k de words[k/64]).
+    ///@param words Arreglo de destino con al menos (n + 63)/64 elementos.
+    ///@param n Cantidad de decisiones.
+    ///@param prob Probabilidad de que cada bit sea verdadero.
+    static void FillBernoulli(uint64_t* words, const std::size_t n, const double prob);
+};
+
+/**
+* @class BernoulliMask
+* @brief Máscara de decisiones aleatorias generadas en bloque para un paso completo del AC.
+* Se genera una vez por paso con RandomGen::FillBernoulli y luego se consume bit a bit.
+*/
+class BernoulliMask
+{
+    std::vector<uint64_t> m_words;  ///< Bits empaquetados.
+    std::size_t m_size;             ///< Cantidad de decisiones válidas.
+    std::size_t m_cursor;           ///< Siguiente bit a consumir.
+    double m_prob;                  ///< Probabilidad usada en el último llenado.
+public:
+    BernoulliMask();
+
+    ///@brief Genera n decisiones nuevas con probabilidad prob y reinicia el cursor.
+    void Fill(const std::size_t n, const double prob);
+
+    ///@brief Devuelve la siguiente decisión. Si se agotan los bits se usa RandomGen::GetDouble.
+    inline bool Next() noexcept
+    {
+        if (m_cursor < m_size)
+        {
+            bool ret = ((m_words[m_cursor >> 6] >> (m_cursor & 63)) & 1) != 0;
+            ++m_cursor;
+            return ret;
+        }
+        return RandomGen::GetDouble() <= m_prob;
+    }
+
+    std::size_t Size() const noexcept;    ///< Devuelve cantidad de decisiones generadas.
 };
 
 #endif
@@ -1,9 +1,16 @@
 #include "BmpWriter.h"
 
 #include <climits>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 using namespace std;
 
+namespace
+{
+    const size_t BMP_BUFFER_BYTES = 4*1024*1024;    // Las líneas se escriben en bloques de 4 MiB.
+}
+
 // Operaciones binarias.
 char* to_byte(void* ptr)
 {
@@ -42,13 +49,36 @@ bool BMPPixel::operator==(const BMPPixel &other)
     else return false;
 }
 
-BMPWriter::BMPWriter(string filepath, unsigned int width, unsigned int height)
+BMPWriter::BMPWriter(string filepath, unsigned int width, unsigned int height, BMP_FORMAT format,
+                     const vector<BMPPixel> &palette, const bool top_down)
 {
+    // Los formatos con paleta necesitan que los colores quepan en los índices.
+    m_format = format;
+    m_palette = palette;
+    if (m_format != BMP_RGB24)
+    {
+        const size_t max_colors = (m_format == BMP_PALETTE4 || m_format == BMP_RLE4) ? 16 : 256;
+        if (m_palette.empty() || m_palette.size() > max_colors)
+        {
+            cout << "Error: Paleta BMP invalida. Se usan 24 bits." << endl;
+            m_format = BMP_RGB24;
+        }
+    }
+
+    // El formato no permite imágenes de arriba a abajo comprimidas.
+    m_top_down = top_down;
+    if (m_top_down && m_format == BMP_RLE8)
+        m_format = BMP_PALETTE8;
+    if (m_top_down && m_format == BMP_RLE4)
+        m_format = BMP_PALETTE4;
+
     // Crea encabezado.
     m_index_height = 0;
+    m_buffer_used = 0;
+    m_data_bytes = 0;
     m_width = width;
     m_height = height;
-    m_data_size = width*height;
+    m_data_size = (uint64_t)width*height;
     m_bmp_hdr = new BMPHeader;
     m_dib_hdr = new DIBHeader;
 
@@ -57,7 +87,7 @@ BMPWriter::BMPWriter(string filepath, unsigned int width, unsigned int height)
     m_bmp_hdr->app_specific2 = 0x0000;
 
     m_dib_hdr->width = width;
-    m_dib_hdr->height = height;
+    m_dib_hdr->height = m_top_down ? -(int32_t)height : (int32_t)height;
     m_dib_hdr->n_planes = swap_endian<uint16_t>(0x0100);
     m_dib_hdr->color_depth = swap_endian<uint16_t>(0x1800);
     m_dib_hdr->compression = 0x00000000;
@@ -67,40 +97,43 @@ BMPWriter::BMPWriter(string filepath, unsigned int width, unsigned int height)
     m_dib_hdr->n_colors = 0x00000000;
     m_dib_hdr->n_imp_colors = 0x00000000;
 
-    unsigned int bmp_size = 0;
+    uint64_t bmp_size = 0;
     unsigned int offset_data = 54;
     m_padding_bytes = m_width % 4;
 
     // Calcula tamaño del archivo.
     bmp_size += 14;        //BMPHeader size.
     bmp_size += 40;        //DIBHeader size.
-    bmp_size += 3*width*height;
-    bmp_size += m_height*m_padding_bytes;
-    m_bmp_hdr->size = bmp_size;
+    bmp_size += 3*m_data_size;
+    bmp_size += (uint64_t)m_height*m_padding_bytes;
+
+    if (m_format != BMP_RGB24)
+    {
+        // Paleta: 4 bytes por color después del encabezado. En RLE los tamaños se corrigen al cerrar.
+        const bool four_bits = (m_format == BMP_PALETTE4 || m_format == BMP_RLE4);
+        m_dib_hdr->color_depth = four_bits ? 4 : 8;
+        m_dib_hdr->compression = (m_format == BMP_RLE8) ? 1 : (m_format == BMP_RLE4) ? 2 : 0;
+        m_dib_hdr->n_colors = (uint32_t)m_palette.size();
+        offset_data += 4*(unsigned int)m_palette.size();
+        m_padding_bytes = 0;
+        m_dib_hdr->bmp_bytes = (uint32_t)((uint64_t)RowBytes()*m_height);
+        bmp_size = offset_data + (uint64_t)RowBytes()*m_height;
+    }
+    m_bmp_hdr->size = (uint32_t)bmp_size;
     m_bmp_hdr->bitmap_data = offset_data;
     m_dib_hdr->header_size = 40;        //DIBHeader size.
 
+    // Los tamaños del encabezado son de 32 bits.
+    if (bmp_size > UINT32_MAX || width > INT32_MAX || height > INT32_MAX)
+    {
+        cout << "Error: La imagen excede el limite de 4 GiB del formato BMP. Use teselas." << endl;
+        return;
+    }
+
     // Escribe encabezado.
     m_file.open(filepath.c_str(), ios::out | ios::binary);
     if (m_file.is_open())
-    {
-        m_file.write(to_byte(&m_bmp_hdr->identifier), 2);
-        m_file.write(to_byte(&m_bmp_hdr->size), 4);
-        m_file.write(to_byte(&m_bmp_hdr->app_specific1), 2);
-        m_file.write(to_byte(&m_bmp_hdr->app_specific2), 2);
-        m_file.write(to_byte(&m_bmp_hdr->bitmap_data), 4);
-        m_file.write(to_byte(&m_dib_hdr->header_size), 4);
-        m_file.write(to_byte(&m_dib_hdr->width), 4);
-        m_file.write(to_byte(&m_dib_hdr->height), 4);
-        m_file.write(to_byte(&m_dib_hdr->n_planes), 2);
-        m_file.write(to_byte(&m_dib_hdr->color_depth), 2);
-        m_file.write(to_byte(&m_dib_hdr->compression), 4);
-        m_file.write(to_byte(&m_dib_hdr->bmp_bytes), 4);
-        m_file.write(to_byte(&m_dib_hdr->h_res), 4);
-        m_file.write(to_byte(&m_dib_hdr->v_res), 4);
-        m_file.write(to_byte(&m_dib_hdr->n_colors), 4);
-        m_file.write(to_byte(&m_dib_hdr->n_imp_colors), 4);
-    }
+        WriteHeader();
     else
     {
         cout << "Error: No se puede crear archivo BMP." << endl;
@@ -108,35 +141,102 @@ BMPWriter::BMPWriter(string filepath, unsigned int width, unsigned int height)
 }
 BMPWriter::~BMPWriter()
 {
+    CloseBMP();
     delete m_bmp_hdr;
     delete m_dib_hdr;
 }
-void BMPWriter::WriteLine(BMPPixel* data)
+void BMPWriter::WriteHeader()
 {
-    // Escribe línea individual del BMP.
-    if(m_index_height < m_height)
+    m_file.write(to_byte(&m_bmp_hdr->identifier), 2);
+    m_file.write(to_byte(&m_bmp_hdr->size), 4);
+    m_file.write(to_byte(&m_bmp_hdr->app_specific1), 2);
+    m_file.write(to_byte(&m_bmp_hdr->app_specific2), 2);
+    m_file.write(to_byte(&m_bmp_hdr->bitmap_data), 4);
+    m_file.write(to_byte(&m_dib_hdr->header_size), 4);
+    m_file.write(to_byte(&m_dib_hdr->width), 4);
+    m_file.write(to_byte(&m_dib_hdr->height), 4);
+    m_file.write(to_byte(&m_dib_hdr->n_planes), 2);
+    m_file.write(to_byte(&m_dib_hdr->color_depth), 2);
+    m_file.write(to_byte(&m_dib_hdr->compression), 4);
+    m_file.write(to_byte(&m_dib_hdr->bmp_bytes), 4);
+    m_file.write(to_byte(&m_dib_hdr->h_res), 4);
+    m_file.write(to_byte(&m_dib_hdr->v_res), 4);
+    m_file.write(to_byte(&m_dib_hdr->n_colors), 4);
+    m_file.write(to_byte(&m_dib_hdr->n_imp_colors), 4);
+
+    if (m_format != BMP_RGB24)
     {
-        for(unsigned int i = 0; i < m_width; i++)
+        for (size_t i = 0; i < m_palette.size(); ++i)
         {
-            m_file.write(&data[i].b, 1);
-            m_file.write(&data[i].g, 1);
-            m_file.write(&data[i].r, 1);
+            const char entry[4] = { m_palette[i].b, m_palette[i].g, m_palette[i].r, 0 };
+            m_file.write(entry, 4);
         }
-        if(m_padding_bytes == 1)
-        {
-            char padding = 0x00;
-            m_file.write(to_byte(&padding), 1);
-        }
-        if(m_padding_bytes == 2)
+    }
+}
+void BMPWriter::Flush()
+{
+    if (m_buffer_used != 0 && m_file.is_open())
+        m_file.write(m_buffer.data(), m_buffer_used);
+    m_buffer_used = 0;
+}
+void BMPWriter::Append(const char* data, const size_t bytes)
+{
+    if (m_buffer.empty())
+        m_buffer.resize(BMP_BUFFER_BYTES);
+    if (m_buffer_used + bytes > m_buffer.size())
+        Flush();
+    if (bytes > m_buffer.size())
+    {
+        if (m_file.is_open())
+            m_file.write(data, bytes);
+    }
+    else
+    {
+        memcpy(m_buffer.data() + m_buffer_used, data, bytes);
+        m_buffer_used += bytes;
+    }
+    m_data_bytes += bytes;
+}
+void BMPWriter::WriteLine(BMPPixel* data)
+{
+    if (m_format != BMP_RGB24)
+    {
+        // Busca el índice de cada color en la paleta.
+        vector<uint8_t> indices(m_width, 0);
+        for (unsigned int i = 0; i < m_width; i++)
         {
-            short padding = 0x0000;
-            m_file.write(to_byte(&padding), 2);
+            for (size_t k = 0; k < m_palette.size(); ++k)
+            {
+                if (m_palette[k] == data[i])
+                {
+                    indices[i] = (uint8_t)k;
+                    break;
+                }
+            }
         }
-        if(m_padding_bytes == 3)
+        WriteIndexLine(indices.data());
+        return;
+    }
+
+    // Codifica la línea en el búfer. El relleno queda en cero.
+    if(m_top_down || m_index_height < m_height)
+    {
+        const size_t row_bytes = RowBytes();
+        if (m_buffer.empty())
+            m_buffer.resize(max(row_bytes, BMP_BUFFER_BYTES/row_bytes*row_bytes));
+        if (m_buffer_used + row_bytes > m_buffer.size())
+            Flush();
+
+        char* out = m_buffer.data() + m_buffer_used;
+        for(unsigned int i = 0; i < m_width; i++)
         {
-            unsigned int padding = 0x00000000;
-            m_file.write(to_byte(&padding), 3);
+            out[3*i] = data[i].b;
+            out[3*i + 1] = data[i].g;
+            out[3*i + 2] = data[i].r;
         }
+        memset(out + 3*m_width, 0, m_padding_bytes);
+        m_buffer_used += row_bytes;
+        m_data_bytes += row_bytes;
     }
     m_index_height++;
 }
@@ -145,11 +245,165 @@ void BMPWriter::WriteLine(std::vector<BMPPixel> data)
     if (data.size() == m_width)
         WriteLine(&data[0]);
 }
+void BMPWriter::EncodeIndexLine(const BMP_FORMAT format, const uint8_t* indices, const unsigned int width,
+                                const vector<BMPPixel> &palette, vector<char> &out)
+{
+    const size_t start = out.size();
+    switch (format)
+    {
+    case BMP_RGB24:
+        for (unsigned int i = 0; i < width; ++i)
+        {
+            const BMPPixel &color = palette[indices[i]];
+            out.push_back(color.b);
+            out.push_back(color.g);
+            out.push_back(color.r);
+        }
+        break;
+    case BMP_PALETTE8:
+        out.insert(out.end(), indices, indices + width);
+        break;
+    case BMP_PALETTE4:
+        for (unsigned int i = 0; i < width; i += 2)
+            out.push_back((char)((indices[i] << 4) | ((i + 1 < width) ? indices[i + 1] : 0)));
+        break;
+    case BMP_RLE8:
+    case BMP_RLE4:
+    {
+        // Carreras de un mismo índice en modo codificado (cantidad, índice) y tramos sin repeticiones
+        // de 3 o más pixeles en modo absoluto (0, cantidad, índices), alineados a 2 bytes.
+        const bool four_bits = (format == BMP_RLE4);
+        unsigned int i = 0;
+        while (i < width)
+        {
+            unsigned int run = 1;
+            while (i + run < width && run < 255 && indices[i + run] == indices[i])
+                ++run;
+            if (run >= 2)
+            {
+                out.push_back((char)run);
+                out.push_back((char)(four_bits ? (indices[i] << 4) | indices[i] : indices[i]));
+                i += run;
+                continue;
+            }
+
+            unsigned int literal = 1;
+            while (i + literal < width && literal < 255 &&
+                   !(i + literal + 1 < width && indices[i + literal] == indices[i + literal + 1]))
+                ++literal;
+            // En 4 bits el tramo absoluto se deja par: algunos lectores no aceptan medio byte al final.
+            if (four_bits && literal > 3)
+                literal &= ~1u;
+            if (literal < 3 || (four_bits && literal == 3))
+            {
+                for (unsigned int k = 0; k < literal; ++k)
+                {
+                    out.push_back(1);
+                    out.push_back((char)(four_bits ? indices[i + k] << 4 : indices[i + k]));
+                }
+            }
+            else
+            {
+                out.push_back(0);
+                out.push_back((char)literal);
+                const size_t data_start = out.size();
+                if (four_bits)
+                {
+                    for (unsigned int k = 0; k < literal; k += 2)
+                        out.push_back((char)((indices[i + k] << 4) | indices[i + k + 1]));
+                }
+                else
+                    out.insert(out.end(), indices + i, indices + i + literal);
+                if ((out.size() - data_start) % 2 != 0)
+                    out.push_back(0);
+            }
+            i += literal;
+        }
+        out.push_back(0);    // Fin de línea.
+        out.push_back(0);
+        return;
+    }
+    };
+
+    // Relleno a 4 bytes en los formatos sin compresión.
+    while ((out.size() - start) % 4 != 0)
+        out.push_back(0);
+}
+void BMPWriter::WriteIndexLine(const uint8_t* indices)
+{
+    if (m_top_down || m_index_height < m_height)
+    {
+        vector<char> line;
+        EncodeIndexLine(m_format, indices, m_width, m_palette, line);
+        Append(line.data(), line.size());
+    }
+    m_index_height++;
+}
+void BMPWriter::WriteEncoded(const char* data, const size_t bytes, const unsigned int count)
+{
+    Append(data, bytes);
+    m_index_height += count;
+}
+BMP_FORMAT BMPWriter::GetFormat() const
+{
+    return m_format;
+}
+void BMPWriter::WriteRows(const char* data, const unsigned int count)
+{
+    const unsigned int rows = m_top_down ? count : (m_index_height < m_height) ? min(count, m_height - m_index_height) : 0;
+    Append(data, (size_t)rows*RowBytes());
+    m_index_height += count;
+}
+unsigned int BMPWriter::RowBytes() const
+{
+    switch (m_format)
+    {
+    case BMP_PALETTE8:
+        return (m_width + 3)/4*4;
+    case BMP_PALETTE4:
+        return ((m_width + 1)/2 + 3)/4*4;
+    case BMP_RLE8:
+    case BMP_RLE4:
+        return 0;
+    default:
+        return 3*m_width + m_padding_bytes;
+    };
+}
 bool BMPWriter::IsOpen() const
 {
     return m_file.is_open();
 }
 void BMPWriter::CloseBMP()
 {
+    if (!m_file.is_open())
+        return;
+
+    if (m_format == BMP_RLE8 || m_format == BMP_RLE4)
+    {
+        // Fin del mapa de bits y tamaños reales en el encabezado.
+        const char end[2] = { 0, 1 };
+        Append(end, 2);
+        Flush();
+        if (m_bmp_hdr->bitmap_data + m_data_bytes > UINT32_MAX)
+            cout << "Error: La imagen comprimida excede el limite de 4 GiB del formato BMP." << endl;
+        m_dib_hdr->bmp_bytes = (uint32_t)m_data_bytes;
+        m_bmp_hdr->size = (uint32_t)(m_bmp_hdr->bitmap_data + m_data_bytes);
+        m_file.seekp(0);
+        WriteHeader();
+    }
+    else if (m_top_down)
+    {
+        // El alto se conoce al terminar: se corrige el encabezado con las líneas escritas.
+        Flush();
+        if (m_bmp_hdr->bitmap_data + m_data_bytes > UINT32_MAX || m_index_height > INT32_MAX)
+            cout << "Error: La imagen excede el limite de 4 GiB del formato BMP." << endl;
+        m_height = m_index_height;
+        m_dib_hdr->height = -(int32_t)m_index_height;
+        m_dib_hdr->bmp_bytes = (uint32_t)m_data_bytes;
+        m_bmp_hdr->size = (uint32_t)(m_bmp_hdr->bitmap_data + m_data_bytes);
+        m_file.seekp(0);
+        WriteHeader();
+    }
+    Flush();
     m_file.close();
 }
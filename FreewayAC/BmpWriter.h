@@ -58,6 +58,19 @@ public:
     bool operator==(const BMPPixel &other);
 };
 
+/**
+* @enum BMP_FORMAT
+* @brief Formatos de pixel del BMP.
+*/
+enum BMP_FORMAT
+{
+    BMP_RGB24,       ///< 24 bits por pixel.
+    BMP_PALETTE8,    ///< Índice de paleta de 8 bits por pixel (hasta 256 colores).
+    BMP_PALETTE4,    ///< Índice de paleta de 4 bits por pixel (hasta 16 colores).
+    BMP_RLE8,        ///< Paleta de 8 bits comprimida por carreras (BI_RLE8).
+    BMP_RLE4         ///< Paleta de 4 bits comprimida por carreras (BI_RLE4).
+};
+
 /**
 * @class BMPWriter
 * @brief Clase para escribir archivos de mapas de bits de gran tamaño.
@@ -70,17 +83,50 @@ class BMPWriter
     unsigned int m_width;
     unsigned int m_height;
     unsigned int m_padding_bytes;
-    int m_data_size;
+    uint64_t m_data_size;
     unsigned int m_index_height;
+    std::vector<char> m_buffer;    ///< Líneas codificadas pendientes de escribir.
+    std::size_t m_buffer_used;     ///< Bytes usados de m_buffer.
+    BMP_FORMAT m_format;
+    std::vector<BMPPixel> m_palette;
+    uint64_t m_data_bytes;         ///< Bytes de pixeles escritos.
+    bool m_top_down;               ///< Líneas de arriba a abajo con el alto corregido al cerrar.
+
+    void Flush();
+    void Append(const char* data, const std::size_t bytes);
+    void WriteHeader();
 
 public:
     ///@brief Constructor.
     ///@param filepath Ruta del archivo a guardar.
     ///@param width Tamaño horizontal de la imagen.
     ///@param height Tamaño vertical de la imagen.
-    BMPWriter(std::string filepath, unsigned int width, unsigned int height);
+    ///@param format Formato de pixel.
+    ///@param palette Colores de la paleta en los formatos con paleta.
+    ///@param top_down Si es verdadero las líneas se escriben de arriba a abajo (alto negativo en el encabezado),
+    ///height es solo una estimación y el alto real se escribe al cerrar. Los formatos RLE se cambian por su
+    ///equivalente sin compresión, porque BMP no admite RLE de arriba a abajo.
+    BMPWriter(std::string filepath, unsigned int width, unsigned int height, BMP_FORMAT format = BMP_RGB24,
+              const std::vector<BMPPixel> &palette = std::vector<BMPPixel>(), const bool top_down = false);
     ~BMPWriter();
 
+    ///@brief Codifica una línea de índices de paleta en el formato dado y la agrega al final de out.
+    ///En los formatos RLE incluye el fin de línea. En BMP_RGB24 usa los colores de palette.
+    static void EncodeIndexLine(const BMP_FORMAT format, const uint8_t* indices, const unsigned int width,
+                                const std::vector<BMPPixel> &palette, std::vector<char> &out);
+
+    ///@brief Escribe una línea de índices de paleta.
+    ///@param indices Arreglo con width índices. Las líneas se escriben de abajo a arriba.
+    void WriteIndexLine(const uint8_t* indices);
+
+    ///@brief Escribe líneas ya codificadas con EncodeIndexLine.
+    ///@param data Bytes de las líneas consecutivas, de abajo a arriba.
+    ///@param bytes Cantidad de bytes.
+    ///@param count Cantidad de líneas.
+    void WriteEncoded(const char* data, const std::size_t bytes, const unsigned int count);
+
+    BMP_FORMAT GetFormat() const;    ///< Devuelve el formato de pixel.
+
     ///@brief Writes BMP line.
     ///@param Array de pixeles a escribir. Las líneas se escriben de abajo a arriba.
     void WriteLine(BMPPixel* data);
@@ -89,6 +135,14 @@ public:
     ///@param Vector de pixeles a escribir. Las líneas se escriben de abajo a arriba.
     void WriteLine(std::vector<BMPPixel> data);
 
+    ///@brief Escribe líneas ya codificadas (RowBytes() bytes por línea). No sirve en los formatos RLE.
+    ///@param data Líneas consecutivas, de abajo a arriba.
+    ///@param count Cantidad de líneas.
+    void WriteRows(const char* data, const unsigned int count);
+
+    ///@brief Devuelve bytes por línea, incluyendo el relleno. En los formatos RLE el largo es variable y devuelve 0.
+    unsigned int RowBytes() const;
+
     ///@brief Return file status.
     bool IsOpen() const;
 
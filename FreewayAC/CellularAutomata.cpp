@@ -1,10 +1,79 @@
 #include "CellularAutomata.h"
 #include "BmpWriter.h"
+#include "NpyWriter.h"
+#include "TilePyramid.h"
+#include "Checkpoint.h"
+#include "NpyReader.h"
 
 #include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <climits>
+#include <random>
 using namespace std;
 
+namespace
+{
+    // Si la paleta no cabe en el formato pedido se usa el siguiente más amplio.
+    BMP_FORMAT fit_bmp_format(BMP_FORMAT format, const size_t colors)
+    {
+        if ((format == BMP_PALETTE4 || format == BMP_RLE4) && colors > 16)
+            format = (format == BMP_PALETTE4) ? BMP_PALETTE8 : BMP_RLE8;
+        if ((format == BMP_PALETTE8 || format == BMP_RLE8) && colors > 256)
+            format = BMP_RGB24;
+        return format;
+    }
+
+    // Casillas por bloque al recorrer pistas cargadas de archivos.
+    const size_t LATTICE_BLOCK = 1 << 16;
+
+    // Versión de histórico que no corresponde a ninguna estadística guardada.
+    const uint64_t HISTORY_STATS_NONE = ~(uint64_t)0;
+
+    // Filas tras las que se vuelcan los contadores de 32 bits de CellStatistics.
+    const uint64_t STATS_SPILL_ROWS = 0xFFFFFFFFu;
+
+    // Suma los contadores de 32 bits a los totales y los reinicia.
+    void spill_counters(vector<uint32_t> &block, vector<uint64_t> &total)
+    {
+        total.resize(block.size(), 0);
+        for (size_t i = 0; i < block.size(); ++i)
+            total[i] += block[i];
+        fill(block.begin(), block.end(), 0u);
+    }
+
+    // Devuelve contadores / rows con los totales volcados incluidos.
+    vector<double> counters_mean(const vector<uint32_t> &block, const vector<uint64_t> &total, const uint64_t rows)
+    {
+        vector<double> mean(block.size(), 0.0);
+        for (size_t i = 0; i < mean.size() && rows != 0; ++i)
+            mean[i] = (double)(block[i] + (total.empty() ? 0 : total[i]))/(double)rows;
+        return mean;
+    }
+
+    // Devuelve las posiciones de los autos de ca cuya clase en la última fila de classes no es 0.
+    vector<int> autonomous_positions(const vector<CaVelocity> &ca, const NpyReader &classes)
+    {
+        vector<int> positions;
+        vector<int> block(LATTICE_BLOCK);
+        for (size_t first = 0; first < ca.size(); first += LATTICE_BLOCK)
+        {
+            const size_t count = min(LATTICE_BLOCK, ca.size() - first);
+            classes.Read(classes.Rows() - 1, first, count, block.data());
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (block[i] != 0 && ca[first + i] != CA_EMPTY)
+                    positions.push_back((int)(first + i));
+            }
+        }
+        return positions;
+    }
+
+    // Casillas por bloque al colocar autos en paralelo.
+    const CaSize PLACEMENT_BLOCK = 1u << 22;
+}
+
 
 /****************************
 *                           *
@@ -12,10 +81,12 @@ using namespace std;
 *                           *
 ****************************/
 
-CellularAutomata::CellularAutomata(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel)
+CellularAutomata::CellularAutomata(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
+                                   const INITIAL_CONDITION init)
 {
     // Inicializa variables.
     m_test = false;
+    m_rand_cursor = 0;
     m_size = size;
     m_vmax = vmax;
     m_rand_prob = rand_prob;
@@ -23,35 +94,101 @@ CellularAutomata::CellularAutomata(const CaSize size, const double density, cons
     m_ca.assign(size, CA_EMPTY);
     m_ca_temp.assign(size, CA_EMPTY);
     m_ca_flow_temp.assign(size, NO_FLOW);
-    m_ca_history.clear();
-    m_ca_flow_history.clear();
+    m_step = 0;
+    m_record_first = 0;
+    m_record_cells = size;
+    m_record_start = 0;
+    m_record_stride = 1;
+    m_record_reservoir = 0;
+    m_record_seen = 0;
+    m_record_slot = -1;
+    m_record_unsorted = false;
+    m_keyframe_interval = 0;
+    m_checkpoint_interval = 0;
+    m_checkpoint_compress = false;
+    m_measure_start = 0;
+    m_observer = nullptr;
+    m_image_format = BMP_RGB24;
+    m_history_mode = HISTORY_PLAIN;
+    m_history_version = 0;
+    m_stats_version = HISTORY_STATS_NONE;
+    CreateHistory();
  
-    unsigned vehicles = (unsigned)(((double)size)*density);
-
-    // Coloca autos al azar.
-    vector<unsigned> car_positions;
-    for (unsigned i = 0; i < m_size; ++i)
-        car_positions.push_back(i);
-
-    random_shuffle(car_positions.begin(), car_positions.end(), RandomGen::GetInt);
-    for (unsigned i = 0; i < vehicles; ++i)
-        m_ca[car_positions[i]] = m_init_vel;
+    PlaceCars(min((unsigned)(((double)size)*density), (unsigned)size), init);
+    m_cars = CountCars();
 }
 CellularAutomata::CellularAutomata(const vector<int> &ca, const vector<bool> &rand_values, const CaVelocity vmax)
 {
     // Inicializa variables.
     m_test = true;
     m_ca = ca;
+    m_cars = CountCars();
     m_rand_values = rand_values;
+    m_rand_cursor = 0;
     m_size = m_ca.size();
     m_vmax = vmax;
     m_rand_prob = 0;
     m_ca_temp.assign(m_size, CA_EMPTY);
-    m_ca_history.clear();
+    m_step = 0;
+    m_record_first = 0;
+    m_record_cells = m_size;
+    m_record_start = 0;
+    m_record_stride = 1;
+    m_record_reservoir = 0;
+    m_record_seen = 0;
+    m_record_slot = -1;
+    m_record_unsorted = false;
+    m_keyframe_interval = 0;
+    m_checkpoint_interval = 0;
+    m_checkpoint_compress = false;
+    m_measure_start = 0;
+    m_observer = nullptr;
+    m_image_format = BMP_RGB24;
+    m_history_mode = HISTORY_PLAIN;
+    m_history_version = 0;
+    m_stats_version = HISTORY_STATS_NONE;
+    CreateHistory();
     m_ca_flow_temp.assign(m_size, NO_FLOW);
-    m_ca_history.push_back(m_ca);
+    m_ca_history->PushRow(m_ca);
+    ++m_history_version;
     m_init_vel = 1;
 }
+CellularAutomata::CellularAutomata(const CellularAutomata &other)
+{
+    m_test = other.m_test;
+    m_rand_prob = other.m_rand_prob;
+    m_vmax = other.m_vmax;
+    m_init_vel = other.m_init_vel;
+    m_size = other.m_size;
+    m_cars = other.m_cars;
+    m_ca = other.m_ca;
+    m_ca_temp = other.m_ca_temp;
+    m_ca_flow_temp = other.m_ca_flow_temp;
+    m_step = other.m_step;
+    m_record_first = other.m_record_first;
+    m_record_cells = other.m_record_cells;
+    m_record_start = other.m_record_start;
+    m_record_stride = other.m_record_stride;
+    m_record_reservoir = other.m_record_reservoir;
+    m_record_seen = 0;
+    m_record_slot = -1;
+    m_record_unsorted = false;
+    m_reservoir_rng = other.m_reservoir_rng;
+    m_rand_values = other.m_rand_values;
+    m_rand_cursor = other.m_rand_cursor;
+    m_keyframe_interval = 0;
+    m_checkpoint_interval = 0;
+    m_checkpoint_compress = false;
+    m_measure_start = other.m_measure_start;
+    m_observer = nullptr;
+    m_image_format = other.m_image_format;
+
+    // Las copias no comparten archivos de histórico.
+    m_history_mode = (other.m_history_mode == HISTORY_DISK) ? HISTORY_PLAIN : other.m_history_mode;
+    m_history_version = 0;
+    m_stats_version = HISTORY_STATS_NONE;
+    CreateHistory();
+}
 CellularAutomata::~CellularAutomata() {}
 void CellularAutomata::DrawHistory(string path, string out_file_name) const
 {
@@ -59,62 +196,334 @@ void CellularAutomata::DrawHistory(string path, string out_file_name) const
         out_file_name = path + "ca.bmp";
     else
         out_file_name = path + out_file_name;
+    RenderHistory(out_file_name, "");
+}
+void CellularAutomata::DrawFlowHistory(string path, string out_file_name) const
+{
+    if (out_file_name == "")
+        out_file_name = path + "ca_flow.bmp";
+    else
+        out_file_name = path + out_file_name;
+    RenderHistory("", out_file_name);
+}
+void CellularAutomata::DrawHistories(string path, string traffic_file_name, string flow_file_name) const
+{
+    RenderHistory(path + ((traffic_file_name == "") ? "ca.bmp" : traffic_file_name),
+                  path + ((flow_file_name == "") ? "ca_flow.bmp" : flow_file_name));
+}
+CaVelocity CellularAutomata::ColorTables(vector<BMPPixel> &vel_lut, vector<BMPPixel> &flow_lut) const
+{
+    // Blanco para casillas vacías y azul proporcional a la velocidad.
+    const CaVelocity max_vel = max(m_vmax, MaxVelocity());
+    vel_lut.assign(max_vel + 2, BMPPixel());
+    vel_lut[0] = BMPPixel((char)255, (char)255, (char)255);
+    for (CaVelocity v = 0; v <= max_vel; ++v)
+        vel_lut[v + 1] = BMPPixel(0, 0, (char)(255.0*(double)v/(double)m_vmax));
+    flow_lut.assign(256, BMPPixel());
+    for (int f = CHAR_MIN; f <= CHAR_MAX; ++f)
+    {
+        if (f == 0)
+            flow_lut[(unsigned char)f] = BMPPixel((char)255, (char)255, (char)255);
+        else
+            flow_lut[(unsigned char)f] = BMPPixel(0, 0, (char)(255.0*(double)f/(double)m_vmax));
+    }
+    return max_vel;
+}
+void CellularAutomata::RenderHistory(const string &traffic_file, const string &flow_file) const
+{
+    const unsigned width = m_ca_history->Width();
+    const size_t height = m_ca_history->size();
+    const size_t flow_height = m_ca_flow_history->size();
+
+    // Con paleta el índice de la velocidad v es v + 1 y el del flujo f es f.
+    vector<BMPPixel> vel_lut, flow_lut;
+    const CaVelocity max_vel = ColorTables(vel_lut, flow_lut);
+    const vector<BMPPixel> flow_palette(flow_lut.begin(), flow_lut.begin() + IS_FLOW + 1);
+
+    const BMP_FORMAT traffic_format = fit_bmp_format(m_image_format, vel_lut.size());
+    const BMP_FORMAT flow_format = fit_bmp_format(m_image_format, flow_palette.size());
+
+    unique_ptr<BMPWriter> traffic, flow;
+    if (traffic_file != "")
+    {
+        traffic.reset(new BMPWriter(traffic_file.c_str(), width, (unsigned)height, traffic_format, vel_lut));
+        if (!traffic->IsOpen())
+            traffic.reset();
+    }
+    if (flow_file != "")
+    {
+        flow.reset(new BMPWriter(flow_file.c_str(), width, (unsigned)flow_height, flow_format, flow_palette));
+        if (!flow->IsOpen())
+            flow.reset();
+    }
+    if (!traffic && !flow)
+        return;
+
+    // Se codifican lotes de líneas en paralelo y cada lote se escribe de una vez.
+    // Las líneas del BMP van de abajo a arriba: la línea l es la fila height - 1 - l. En 24 bits las
+    // líneas tienen largo fijo y van a un búfer común; con paleta cada hilo codifica sus líneas en su
+    // propio búfer, porque en RLE el largo de cada línea es variable.
+    const size_t row_bytes = 3*(size_t)width + width % 4;
+    const size_t batch = max<size_t>(1, ((size_t)4 << 20)/row_bytes);
+    const size_t lines = max(traffic ? height : 0, flow ? flow_height : 0);
+    unsigned threads = (unsigned)min<size_t>(max(1u, thread::hardware_concurrency()), batch);
+    if ((size_t)width*lines < ((size_t)1 << 20))
+        threads = 1;
 
-    unsigned height = m_ca_history.size();
-    unsigned width = m_size;
-    BMPWriter writer(out_file_name.c_str(), width, height);
-    if (writer.IsOpen())
+    const bool traffic_rgb = (traffic_format == BMP_RGB24), flow_rgb = (flow_format == BMP_RGB24);
+    vector<char> traffic_buffer((traffic && traffic_rgb) ? batch*row_bytes : 0, 0);
+    vector<char> flow_buffer((flow && flow_rgb) ? batch*row_bytes : 0, 0);
+    vector< vector<char> > traffic_out(threads), flow_out(threads);
+    vector<unsigned> traffic_lines(threads), flow_lines(threads);
+    vector< vector<uint8_t> > indices(threads, vector<uint8_t>(width));
+    vector< unique_ptr< HistoryCursor<CaVelocity> > > vel_cursors(threads);
+    vector< unique_ptr< HistoryCursor<CaFlow> > > flow_cursors(threads);
+    for (unsigned t = 0; t < threads; ++t)
     {
-        BMPPixel* bmpData = new BMPPixel[width];
-        for (int i = height-1; i >= 0; --i)     // Los archivos BMP se escriben de abajo a arriba.
+        vel_cursors[t].reset(new HistoryCursor<CaVelocity>(*m_ca_history));
+        flow_cursors[t].reset(new HistoryCursor<CaFlow>(*m_ca_flow_history));
+    }
+    m_ca_history->PrepareRead();
+    m_ca_flow_history->PrepareRead();
+
+    for (size_t first = 0; first < lines; first += batch)
+    {
+        const size_t count = min(batch, lines - first);
+        auto encode = [&](const unsigned t)
         {
-            for (unsigned j = 0; j < width; ++j)
+            uint8_t* idx = indices[t].data();
+            traffic_out[t].clear();
+            flow_out[t].clear();
+            traffic_lines[t] = flow_lines[t] = 0;
+            for (size_t l = first + count*t/threads; l < first + count*(t + 1)/threads; ++l)
             {
-                BMPPixel color;
-                if (m_ca_history[i][j] == CA_EMPTY)
-                    color = BMPPixel((char)255, (char)255, (char)255);
-                else
-                    color = BMPPixel(0, 0, (char)(255.0*(double)m_ca_history[i][j]/(double)m_vmax));
-                bmpData[j] = color;
+                if (traffic && l < height)
+                {
+                    const CaVelocity* row = vel_cursors[t]->Row(height - 1 - l);
+                    if (traffic_rgb)
+                    {
+                        char* out = traffic_buffer.data() + (l - first)*row_bytes;
+                        for (unsigned j = 0; j < width; ++j)
+                        {
+                            const CaVelocity v = row[j];
+                            const BMPPixel &color = (v >= CA_EMPTY && v <= max_vel) ? vel_lut[v + 1]
+                                                  : BMPPixel(0, 0, (char)(255.0*(double)v/(double)m_vmax));
+                            out[3*j] = color.b;
+                            out[3*j + 1] = color.g;
+                            out[3*j + 2] = color.r;
+                        }
+                    }
+                    else
+                    {
+                        for (unsigned j = 0; j < width; ++j)
+                            idx[j] = (uint8_t)(min(max(row[j], CA_EMPTY), max_vel) + 1);
+                        BMPWriter::EncodeIndexLine(traffic_format, idx, width, vel_lut, traffic_out[t]);
+                        ++traffic_lines[t];
+                    }
+                }
+                if (flow && l < flow_height)
+                {
+                    const CaFlow* row = flow_cursors[t]->Row(flow_height - 1 - l);
+                    if (flow_rgb)
+                    {
+                        char* out = flow_buffer.data() + (l - first)*row_bytes;
+                        for (unsigned j = 0; j < width; ++j)
+                        {
+                            const BMPPixel &color = flow_lut[(unsigned char)row[j]];
+                            out[3*j] = color.b;
+                            out[3*j + 1] = color.g;
+                            out[3*j + 2] = color.r;
+                        }
+                    }
+                    else
+                    {
+                        for (unsigned j = 0; j < width; ++j)
+                            idx[j] = (uint8_t)((row[j] != NO_FLOW) ? IS_FLOW : NO_FLOW);
+                        BMPWriter::EncodeIndexLine(flow_format, idx, width, flow_palette, flow_out[t]);
+                        ++flow_lines[t];
+                    }
+                }
+            }
+        };
+
+        vector<thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+        {
+            try
+            {
+                pool.push_back(thread(encode, t));
+            }
+            catch (...)
+            {
+                encode(t);
+            }
+        }
+        encode(0);
+        for (size_t t = 0; t < pool.size(); ++t)
+            pool[t].join();
+
+        if (traffic && first < height)
+        {
+            if (traffic_rgb)
+                traffic->WriteRows(traffic_buffer.data(), (unsigned)min(count, height - first));
+            else
+            {
+                for (unsigned t = 0; t < threads; ++t)
+                    traffic->WriteEncoded(traffic_out[t].data(), traffic_out[t].size(), traffic_lines[t]);
+            }
+        }
+        if (flow && first < flow_height)
+        {
+            if (flow_rgb)
+                flow->WriteRows(flow_buffer.data(), (unsigned)min(count, flow_height - first));
+            else
+            {
+                for (unsigned t = 0; t < threads; ++t)
+                    flow->WriteEncoded(flow_out[t].data(), flow_out[t].size(), flow_lines[t]);
             }
-            writer.WriteLine(bmpData);
         }
-        writer.CloseBMP();
-        delete[] bmpData;
     }
+
+    if (traffic)
+        traffic->CloseBMP();
+    if (flow)
+        flow->CloseBMP();
 }
-void CellularAutomata::DrawFlowHistory(string path, string out_file_name) const
+void CellularAutomata::DrawHistoryTiles(string path, string traffic_name, string flow_name, const unsigned tile_size,
+                                        const bool draw_traffic, const bool draw_flow) const
 {
-    if (out_file_name == "")
-        out_file_name = path + "ca_flow.bmp";
-    else
-        out_file_name = path + out_file_name;
+    const unsigned width = m_ca_history->Width();
+    const size_t height = m_ca_history->size();
+    const size_t flow_height = m_ca_flow_history->size();
+    if (width == 0 || height == 0)
+    {
+        cout << "Error: Historico vacio." << endl;
+        return;
+    }
+
+    vector<BMPPixel> vel_lut, flow_lut;
+    const CaVelocity max_vel = ColorTables(vel_lut, flow_lut);
+
+    // Una sola pasada por el histórico de arriba a abajo. Cada lote de filas se colorea en paralelo
+    // y se agrega a las pirámides, que escriben y reducen sus teselas también en paralelo.
+    unique_ptr<TilePyramid> traffic, flow;
+    if (draw_traffic)
+        traffic.reset(new TilePyramid(path + ((traffic_name == "") ? "ca" : traffic_name), width, height, tile_size));
+    if (draw_flow)
+        flow.reset(new TilePyramid(path + ((flow_name == "") ? "ca_flow" : flow_name), width, flow_height, tile_size));
+    if (!traffic && !flow)
+        return;
+    const size_t row_bytes = 3*(size_t)width;
+    const size_t batch = max<size_t>((traffic ? traffic : flow)->TileSize(), ((size_t)4 << 20)/row_bytes);
+    unsigned threads = (unsigned)min<size_t>(max(1u, thread::hardware_concurrency()), batch);
+    if ((size_t)width*height < ((size_t)1 << 20))
+        threads = 1;
+
+    vector<char> traffic_buffer(traffic ? batch*row_bytes : 0), flow_buffer(flow ? batch*row_bytes : 0);
+    vector< unique_ptr< HistoryCursor<CaVelocity> > > vel_cursors(threads);
+    vector< unique_ptr< HistoryCursor<CaFlow> > > flow_cursors(threads);
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        vel_cursors[t].reset(new HistoryCursor<CaVelocity>(*m_ca_history));
+        flow_cursors[t].reset(new HistoryCursor<CaFlow>(*m_ca_flow_history));
+    }
+    m_ca_history->PrepareRead();
+    m_ca_flow_history->PrepareRead();
 
-    unsigned height = m_ca_flow_history.size();
-    unsigned width = m_size;
-    BMPWriter writer(out_file_name.c_str(), width, height);
-    if (writer.IsOpen())
+    for (size_t first = 0; first < height; first += batch)
     {
-        BMPPixel* bmpData = new BMPPixel[width];
-        for (int i = height-1; i >= 0; --i)
+        const size_t count = min(batch, height - first);
+        auto encode = [&](const unsigned t)
         {
-            for (unsigned j=0; j<width; ++j)
+            for (size_t i = first + count*t/threads; i < first + count*(t + 1)/threads; ++i)
             {
-                BMPPixel color;
-                if (m_ca_flow_history[i][j] == 0)
-                    color = BMPPixel((char)255, (char)255, (char)255);
-                else
-                    color = BMPPixel(0, 0, (char)(255.0*(double)m_ca_flow_history[i][j]/(double)m_vmax));
-                bmpData[j] = color;
+                if (traffic)
+                {
+                    const CaVelocity* row = vel_cursors[t]->Row(i);
+                    char* out = traffic_buffer.data() + (i - first)*row_bytes;
+                    for (unsigned j = 0; j < width; ++j)
+                    {
+                        const BMPPixel &color = vel_lut[min(max(row[j], CA_EMPTY), max_vel) + 1];
+                        out[3*j] = color.b;
+                        out[3*j + 1] = color.g;
+                        out[3*j + 2] = color.r;
+                    }
+                }
+                if (flow && i < flow_height)
+                {
+                    const CaFlow* flow_row = flow_cursors[t]->Row(i);
+                    char* out = flow_buffer.data() + (i - first)*row_bytes;
+                    for (unsigned j = 0; j < width; ++j)
+                    {
+                        const BMPPixel &color = flow_lut[(unsigned char)flow_row[j]];
+                        out[3*j] = color.b;
+                        out[3*j + 1] = color.g;
+                        out[3*j + 2] = color.r;
+                    }
+                }
+            }
+        };
+
+        vector<thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+        {
+            try
+            {
+                pool.push_back(thread(encode, t));
+            }
+            catch (...)
+            {
+                encode(t);
             }
-            writer.WriteLine(bmpData);
         }
-        writer.CloseBMP();
-        delete[] bmpData;
+        encode(0);
+        for (size_t t = 0; t < pool.size(); ++t)
+            pool[t].join();
+
+        if (traffic)
+            traffic->WriteRows(traffic_buffer.data(), (unsigned)count);
+        if (flow && first < flow_height)
+            flow->WriteRows(flow_buffer.data(), (unsigned)min(count, flow_height - first));
     }
+    if (traffic)
+        traffic->Close();
+    if (flow)
+        flow->Close();
+}
+void CellularAutomata::SetImageFormat(const BMP_FORMAT format) noexcept
+{
+    m_image_format = format;
+}
+BMP_FORMAT CellularAutomata::GetImageFormat() const noexcept
+{
+    return m_image_format;
+}
+void CellularAutomata::PrepareRandomization() noexcept
+{
+    if (!m_test && !m_trace_reader)
+        m_rand_mask.Fill(m_cars, m_rand_prob);
+}
+void CellularAutomata::BeginStep() noexcept
+{
+    // Los keyframes se toman antes del paso porque algunas clases modifican el AC después de AssignChanges.
+    if (m_keyframe_interval != 0 && m_step % m_keyframe_interval == 0 && m_keyframes.back().step != m_step)
+        RecordKeyframe();
+    PrepareRandomization();
+}
+inline bool CellularAutomata::NextRandomization() noexcept
+{
+    if (m_test || m_trace_reader)
+        return Randomization();
+
+    bool ret = m_rand_mask.Next();
+    if (m_trace_writer)
+        m_trace_writer->Write(ret);
+    return ret;
 }
 inline void CellularAutomata::Step() noexcept
 {
+    BeginStep();
+
     // Iterar sobre AC hasta encotrar vehiculo.
     for (unsigned i = 0; i < m_ca.size(); ++i)
     {
@@ -135,14 +544,14 @@ inline void CellularAutomata::Step() noexcept
             }
 
             // Aleatoriedad.
-            bool rnd = Randomization();
+            bool rnd = NextRandomization();
             if ((m_ca[i] > 0) && rnd)
                 m_ca[i]--;
         }
     }
 
     // Aplicar cambios.
-    m_ca_history.push_back(m_ca);
+    RecordHistory();
     Move();
 }
 inline void CellularAutomata::Move() noexcept
@@ -164,10 +573,11 @@ inline void CellularAutomata::Move() noexcept
 }
 inline void CellularAutomata::AssignChanges() noexcept
 {
-    m_ca_flow_history.push_back(m_ca_flow_temp);
+    RecordFlowHistory();
     m_ca.assign(m_ca_temp.begin(), m_ca_temp.end());
     m_ca_flow_temp.assign(m_size, NO_FLOW);
     m_ca_temp.assign(m_size, CA_EMPTY);
+    ++m_step;
 }
 inline CaSize CellularAutomata::NextCarDist(const CaPosition pos) const noexcept
 {
@@ -182,12 +592,492 @@ std::vector<CaVelocity> CellularAutomata::GetCa()
 }
 std::vector< std::vector<CaVelocity> > CellularAutomata::GetCaHistory()
 {
-    return m_ca_history;
+    return m_ca_history->ToVector();
+}
+void CellularAutomata::ReadHistoryRows(const size_t first, const size_t count, CaVelocity* out) const
+{
+    m_ca_history->ReadRows(first, count, out);
+}
+void CellularAutomata::ClearHistory()
+{
+    m_ca_history->Clear();
+    m_ca_flow_history->Clear();
+    ++m_history_version;
+    m_record_seen = 0;
+    m_record_steps.clear();
+    m_record_unsorted = false;
+}
+ExportedRows CellularAutomata::ExportHistoryNpy(const string &filepath, const bool append) const
+{
+    const size_t width = m_ca_history->Width();
+    const size_t rows = m_ca_history->size();
+    const size_t flow_rows = m_ca_flow_history->size();
+    const size_t block = max<size_t>(1, (4u << 20)/(width*sizeof(CaVelocity)));
+    const vector<CaStep> steps = GetHistorySteps();
+
+    NpyWriter ca_file(filepath + "_ca.npy", NpyType<CaVelocity>::Descr(), sizeof(CaVelocity), width, append);
+    NpyWriter flow_file(filepath + "_flow.npy", NpyType<CaFlow>::Descr(), sizeof(CaFlow), width, append);
+    NpyWriter obs_file(filepath + "_obs.npy", NpyType<double>::Descr(), sizeof(double), 4, append);
+    if (!ca_file.IsOpen() || !flow_file.IsOpen() || !obs_file.IsOpen())
+        return ExportedRows();
+
+    // Se copia por bloques para que la memoria usada no dependa del largo del histórico.
+    vector<CaVelocity> ca_rows(block*width);
+    vector<CaFlow> flow_rows_data(block*width);
+    vector<double> obs(block*4);
+    for (size_t first = 0; first < rows; first += block)
+    {
+        const size_t count = min(block, rows - first);
+        m_ca_history->ReadRows(first, count, ca_rows.data());
+        for (size_t r = 0; r < count; ++r)
+        {
+            const CaVelocity* row = ca_rows.data() + r*width;
+            unsigned cars = 0;
+            double vel = 0.0;
+            for (size_t i = 0; i < width; ++i)
+            {
+                if (row[i] != CA_EMPTY)
+                {
+                    ++cars;
+                    vel += row[i];
+                }
+            }
+            obs[4*r] = (double)steps[first + r];
+            obs[4*r + 1] = cars;
+            obs[4*r + 2] = (cars != 0) ? vel/cars : 0.0;
+            obs[4*r + 3] = vel/width;
+        }
+        ca_file.WriteRows(ca_rows.data(), count);
+        obs_file.WriteRows(obs.data(), count);
+    }
+    for (size_t first = 0; first < flow_rows; first += block)
+    {
+        const size_t count = min(block, flow_rows - first);
+        m_ca_flow_history->ReadRows(first, count, flow_rows_data.data());
+        flow_file.WriteRows(flow_rows_data.data(), count);
+    }
+    return ExportedRows(ca_file.Rows(), flow_file.Rows());
+}
+void CellularAutomata::TruncateHistoryNpy(const string &filepath, const ExportedRows &rows) const
+{
+    if (!rows.Known())
+        return;
+
+    const size_t width = m_ca_history->Width();
+    NpyWriter ca_file(filepath + "_ca.npy", NpyType<CaVelocity>::Descr(), sizeof(CaVelocity), width, true);
+    NpyWriter flow_file(filepath + "_flow.npy", NpyType<CaFlow>::Descr(), sizeof(CaFlow), width, true);
+    NpyWriter obs_file(filepath + "_obs.npy", NpyType<double>::Descr(), sizeof(double), 4, true);
+    ca_file.Truncate(rows.velocities);
+    flow_file.Truncate(rows.flow);
+    obs_file.Truncate(rows.velocities);
+}
+void CellularAutomata::CreateHistory()
+{
+    const CaSize width = m_record_cells;
+    const bool whole = (width == m_size);
+    m_record_seen = 0;
+    m_record_steps.clear();
+    m_record_unsorted = false;
+    ++m_history_version;
+
+    if (m_record_reservoir != 0 && m_history_mode != HISTORY_PLAIN)
+    {
+        cout << "Error: El muestreo de reservorio requiere historico plain." << endl;
+        m_history_mode = HISTORY_PLAIN;
+    }
+
+    switch (m_history_mode)
+    {
+    case HISTORY_PACKED:
+        m_ca_history.reset(new PackedHistory<CaVelocity>(width, CA_EMPTY, MaxVelocity()));
+        m_ca_flow_history.reset(new PackedHistory<CaFlow>(width, NO_FLOW, IS_FLOW));
+        break;
+    case HISTORY_EVENTS:
+        // Una ventana parcial no es periódica: los autos entran y salen por sus bordes. El flujo de autos
+        // que vienen de fuera de la ventana no se puede derivar, así que se guarda empaquetado.
+        m_ca_history.reset(new EventHistory<CaVelocity>(width, CA_EMPTY, whole && IsPeriodic()));
+        if (whole)
+            m_ca_flow_history.reset(new DerivedFlowHistory<CaVelocity, CaFlow>(m_ca_history.get(), CA_EMPTY, NO_FLOW, IS_FLOW,
+                                                                                IsPeriodic()));
+        else
+            m_ca_flow_history.reset(new PackedHistory<CaFlow>(width, NO_FLOW, IS_FLOW));
+        break;
+    case HISTORY_DISK:
+    {
+        DiskHistory<CaVelocity>* ca_disk = new DiskHistory<CaVelocity>(width, m_history_path + ".ca");
+        DiskHistory<CaFlow>* flow_disk = new DiskHistory<CaFlow>(width, m_history_path + ".flow");
+        m_ca_history.reset(ca_disk);
+        m_ca_flow_history.reset(flow_disk);
+        if (ca_disk->IsOpen() && flow_disk->IsOpen())
+            break;
+
+        // Sin archivos el histórico quedaría vacío, así que se guarda en memoria.
+        cout << "Error: No se puede usar historico en disco. Se usa historico plain." << endl;
+        m_history_mode = HISTORY_PLAIN;
+        m_ca_history.reset(new HistoryArena<CaVelocity>(width));
+        m_ca_flow_history.reset(new HistoryArena<CaFlow>(width));
+        break;
+    }
+    case HISTORY_NONE:
+        m_ca_history.reset(new NullHistory<CaVelocity>(width));
+        m_ca_flow_history.reset(new NullHistory<CaFlow>(width));
+        break;
+    case HISTORY_PLAIN:
+    default:
+        m_ca_history.reset(new HistoryArena<CaVelocity>(width));
+        m_ca_flow_history.reset(new HistoryArena<CaFlow>(width));
+        break;
+    };
+}
+void CellularAutomata::RecordHistory()
+{
+    if (m_observer)
+        m_observer->OnVelocities(m_step, m_ca.data(), m_size);
+
+    m_record_slot = -1;
+    if (m_step < m_record_start || (m_step - m_record_start) % m_record_stride != 0)
+        return;
+
+    if (m_record_reservoir == 0)
+        m_record_slot = -2;
+    else
+    {
+        // Muestreo de reservorio (algoritmo R): el candidato n reemplaza una fila al azar con probabilidad k/n.
+        ++m_record_seen;
+        if (m_ca_history->size() < m_record_reservoir)
+            m_record_slot = -2;
+        else
+        {
+            const uint64_t r = uniform_int_distribution<uint64_t>(0, m_record_seen - 1)(m_reservoir_rng);
+            if (r >= m_record_reservoir)
+                return;
+            m_record_slot = (int64_t)r;
+        }
+    }
+
+    // Al reemplazar se sobrescribe la fila elegida. El orden temporal se recupera con SortReservoir().
+    if (m_record_slot >= 0)
+    {
+        static_cast<HistoryArena<CaVelocity>&>(*m_ca_history).ReplaceRow((size_t)m_record_slot, m_ca.data() + m_record_first);
+        m_record_steps[(size_t)m_record_slot] = m_step;
+        m_record_unsorted = true;
+    }
+    else
+    {
+        if (m_record_reservoir != 0)
+            m_record_steps.push_back(m_step);
+        m_ca_history->PushRow(m_ca.data() + m_record_first);
+    }
+    ++m_history_version;
+}
+void CellularAutomata::RecordFlowHistory()
+{
+    if (m_observer)
+        m_observer->OnFlow(m_step, m_ca_flow_temp.data(), m_size);
+
+    if (m_record_slot == -1)
+        return;
+    if (m_record_slot >= 0)
+        static_cast<HistoryArena<CaFlow>&>(*m_ca_flow_history).ReplaceRow((size_t)m_record_slot, m_ca_flow_temp.data() + m_record_first);
+    else
+        m_ca_flow_history->PushRow(m_ca_flow_temp.data() + m_record_first);
+    ++m_history_version;
+}
+void CellularAutomata::SortReservoir()
+{
+    if (!m_record_unsorted)
+        return;
+    m_record_unsorted = false;
+
+    vector<size_t> order(m_record_steps.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [this](const size_t a, const size_t b) { return m_record_steps[a] < m_record_steps[b]; });
+
+    vector<CaStep> steps(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        steps[i] = m_record_steps[order[i]];
+    m_record_steps.swap(steps);
+    static_cast<HistoryArena<CaVelocity>&>(*m_ca_history).PermuteRows(order);
+    if (m_ca_flow_history->size() == order.size())
+        static_cast<HistoryArena<CaFlow>&>(*m_ca_flow_history).PermuteRows(order);
+    ++m_history_version;
+}
+void CellularAutomata::SetHistoryRecording(const CaSize first_cell, const CaSize cells, const CaStep start,
+                                           const CaStep stride, const size_t reservoir, const uint64_t seed)
+{
+    m_record_first = min(first_cell, m_size - 1);
+    m_record_cells = (cells == 0) ? m_size - m_record_first : min(cells, m_size - m_record_first);
+    m_record_start = start;
+    m_record_stride = (stride == 0) ? 1 : stride;
+    m_record_reservoir = reservoir;
+    m_reservoir_rng.seed(seed);
+    CreateHistory();
+}
+vector<CaStep> CellularAutomata::GetHistorySteps() const
+{
+    if (m_record_reservoir != 0)
+        return m_record_steps;
+
+    // Las filas guardadas por Step() están al final del histórico y la última es el último paso grabado.
+    // Antes puede haber filas borradas con ClearHistory() o, en modo de prueba, el estado inicial.
+    vector<CaStep> steps(m_ca_history->size());
+    uint64_t recorded = 0;
+    if (m_step > m_record_start)
+        recorded = (m_step - 1 - m_record_start)/m_record_stride + 1;
+    const size_t rows = (size_t)min<uint64_t>(recorded, steps.size());
+    const CaStep last = m_record_start + (recorded - 1)*m_record_stride;
+    for (size_t i = 0; i < rows; ++i)
+        steps[steps.size() - 1 - i] = last - i*m_record_stride;
+    return steps;
+}
+CaSize CellularAutomata::GetHistoryFirstCell() const noexcept
+{
+    return m_record_first;
+}
+CaSize CellularAutomata::GetHistoryWidth() const noexcept
+{
+    return m_record_cells;
+}
+CaStep CellularAutomata::GetStep() const noexcept
+{
+    return m_step;
+}
+void CellularAutomata::SetMeasureStart(const CaStep step) noexcept
+{
+    m_measure_start = step;
+}
+CaStep CellularAutomata::GetMeasureStart() const noexcept
+{
+    return m_measure_start;
+}
+CaState CellularAutomata::GetState() const
+{
+    CaState state;
+    state.step = m_step;
+    state.ca = m_ca;
+    state.rand_cursor = m_rand_cursor;
+    state.rng = RandomGen::GetState();
+    return state;
+}
+void CellularAutomata::SetState(const CaState &state)
+{
+    m_step = state.step;
+    m_ca = state.ca;
+    m_size = m_ca.size();
+    m_cars = CountCars();
+    m_ca_temp.assign(m_size, CA_EMPTY);
+    m_ca_flow_temp.assign(m_size, NO_FLOW);
+    m_rand_cursor = state.rand_cursor;
+    if (!m_test && !RandomGen::SetState(state.rng))
+        cout << "Error: No se puede restaurar el estado del generador de aleatorios." << endl;
+}
+void CellularAutomata::FillCheckpoint(Checkpoint &checkpoint) const
+{
+    checkpoint.type = GetType();
+    checkpoint.vmax = m_vmax;
+    checkpoint.init_vel = m_init_vel;
+    checkpoint.rand_prob = m_rand_prob;
+    checkpoint.state = GetState();
+    checkpoint.measure_start = m_measure_start;
+}
+bool CellularAutomata::SaveCheckpoint(const string &filepath, const bool compress, const ExportedRows &exported) const
+{
+    Checkpoint checkpoint;
+    FillCheckpoint(checkpoint);
+    checkpoint.exported = exported;
+    return checkpoint.Write(filepath, compress);
+}
+unique_ptr<CellularAutomata> CellularAutomata::FromCheckpoint(const Checkpoint &checkpoint)
+{
+    // Se construye sin autos y el estado guardado reemplaza la pista y el generador.
+    const CaSize size = (CaSize)checkpoint.state.ca.size();
+    unique_ptr<CellularAutomata> ca;
+    switch (checkpoint.type)
+    {
+    case OPEN_CA:
+        ca.reset(new OpenCA(size, 0.0, checkpoint.vmax, checkpoint.rand_prob, checkpoint.init_vel,
+                            checkpoint.new_car_prob, checkpoint.new_car_speed));
+        break;
+    case AUTONOMOUS_CIRCULAR_CA:
+        ca.reset(new AutonomousCircularCA(size, 0.0, checkpoint.vmax, checkpoint.rand_prob, checkpoint.init_vel, 0.0));
+        break;
+    case AUTONOMOUS_OPEN_CA:
+        ca.reset(new AutonomousOpenCA(size, 0.0, checkpoint.vmax, checkpoint.rand_prob, checkpoint.init_vel, 0.0,
+                                      checkpoint.new_car_prob, checkpoint.new_car_speed));
+        break;
+    case CIRCULAR_CA:
+    default:
+        ca.reset(new CircularCA(size, 0.0, checkpoint.vmax, checkpoint.rand_prob, checkpoint.init_vel));
+        break;
+    }
+    ca->SetState(checkpoint.state);
+    ca->SetMeasureStart(checkpoint.measure_start);
+    return ca;
+}
+unique_ptr<CellularAutomata> CellularAutomata::LoadCheckpoint(const string &filepath, ExportedRows* exported)
+{
+    Checkpoint checkpoint;
+    if (!checkpoint.Read(filepath) || checkpoint.state.ca.empty())
+        return unique_ptr<CellularAutomata>();
+    if (exported)
+        *exported = checkpoint.exported;
+    return FromCheckpoint(checkpoint);
+}
+void CellularAutomata::SetCheckpointing(const string &filepath, const CaStep interval, const bool compress)
+{
+    m_checkpoint_file = filepath;
+    m_checkpoint_interval = interval;
+    m_checkpoint_compress = compress;
+    if (interval != 0 && RandomGen::GetAlgorithm() == LCG && !m_test)
+        cout << "Error: El estado de LCG no se puede guardar. Los checkpoints no reproduciran la evolucion." << endl;
+}
+void CellularAutomata::CheckpointIfDue() noexcept
+{
+    if (m_checkpoint_interval == 0 || m_step % m_checkpoint_interval != 0)
+        return;
+    try
+    {
+        SortReservoir();
+        SaveCheckpoint(m_checkpoint_file, m_checkpoint_compress);
+    }
+    catch (...)
+    {
+        cout << "Error: No hay memoria para el checkpoint." << endl;
+    }
+}
+void CellularAutomata::RecordKeyframe()
+{
+    m_keyframes.push_back(GetState());
+}
+void CellularAutomata::SetKeyframeInterval(const CaStep interval)
+{
+    m_keyframe_interval = interval;
+    m_keyframes.clear();
+    if (interval == 0)
+        return;
+
+    if (RandomGen::GetAlgorithm() == LCG && !m_test)
+        cout << "Error: El estado de LCG no se puede guardar. Los keyframes no reproduciran la evolucion." << endl;
+    RecordKeyframe();
+}
+CaStep CellularAutomata::GetKeyframeInterval() const noexcept
+{
+    return m_keyframe_interval;
+}
+size_t CellularAutomata::GetKeyframeCount() const noexcept
+{
+    return m_keyframes.size();
+}
+unique_ptr<CellularAutomata> CellularAutomata::RegenerateWindow(const CaStep first, const CaStep count) const
+{
+    // Keyframe más reciente con step <= first.
+    auto it = upper_bound(m_keyframes.begin(), m_keyframes.end(), first,
+                          [](const CaStep s, const CaState &k) { return s < k.step; });
+    if (it == m_keyframes.begin())
+        return unique_ptr<CellularAutomata>();
+    --it;
+
+    // La simulación usa el generador del hilo actual, así que se restaura al terminar.
+    const string saved_rng = RandomGen::GetState();
+    unique_ptr<CellularAutomata> window(Clone());
+    // Sin histórico la ventana no tendría filas, por ejemplo si solo se guardan keyframes.
+    if (window->m_history_mode == HISTORY_NONE)
+        window->SetHistoryMode(HISTORY_PLAIN);
+    window->SetState(*it);
+    window->SetHistoryRecording(m_record_first, m_record_cells, first, m_record_stride);
+    window->ReserveHistory((unsigned)count);
+    for (CaStep s = it->step; s < first + count; ++s)
+        window->Step();
+    RandomGen::SetState(saved_rng);
+    return window;
+}
+unique_ptr<CellularAutomata> CellularAutomata::Regenerate(const CaStep first, const CaStep count) const
+{
+    vector< pair<CaStep, CaStep> > windows(1, make_pair(first, count));
+    return std::move(Regenerate(windows, 1)[0]);
+}
+vector< unique_ptr<CellularAutomata> > CellularAutomata::Regenerate(const vector< pair<CaStep, CaStep> > &windows,
+                                                                    unsigned threads) const
+{
+    vector< unique_ptr<CellularAutomata> > out(windows.size());
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    threads = (unsigned)min<size_t>(threads, windows.size());
+
+    // Cada hilo toma la siguiente ventana pendiente. Los keyframes solo se leen.
+    atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        size_t i;
+        while ((i = next++) < windows.size())
+            out[i] = RegenerateWindow(windows[i].first, windows[i].second);
+    };
+
+    if (threads <= 1)
+        worker();
+    else
+    {
+        vector<thread> pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.push_back(thread(worker));
+        for (unsigned t = 0; t < threads; ++t)
+            pool[t].join();
+    }
+
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        if (!out[i])
+            cout << "Error: No hay keyframe anterior al paso " << windows[i].first << "." << endl;
+    }
+    return out;
+}
+vector< vector<CaVelocity> > CellularAutomata::GetHistoryRange(const CaStep first, const CaStep count) const
+{
+    unique_ptr<CellularAutomata> window = Regenerate(first, count);
+    if (!window)
+        return vector< vector<CaVelocity> >();
+    return window->GetCaHistory();
+}
+void CellularAutomata::SetHistoryMode(const HISTORY_MODE mode, const string &filepath)
+{
+    m_history_mode = mode;
+    m_history_path = filepath;
+    CreateHistory();
+}
+HISTORY_MODE CellularAutomata::GetHistoryMode() const noexcept
+{
+    return m_history_mode;
+}
+size_t CellularAutomata::GetHistoryMemory() const noexcept
+{
+    return m_ca_history->MemoryBytes() + m_ca_flow_history->MemoryBytes();
+}
+CaVelocity CellularAutomata::MaxVelocity() const noexcept
+{
+    return max(m_vmax, m_init_vel);
+}
+void CellularAutomata::ReserveHistory(const unsigned iter)
+{
+    size_t rows = (size_t)(iter/m_record_stride + 1);
+    if (m_record_reservoir != 0)
+        rows = m_record_reservoir;
+    m_ca_history->Reserve(m_ca_history->size() + rows);
+    m_ca_flow_history->Reserve(m_ca_flow_history->size() + rows);
+}
+void CellularAutomata::SetObserver(StepObserver* observer) noexcept
+{
+    m_observer = observer;
 }
 void CellularAutomata::Evolve(const unsigned iter) noexcept
 {
+    ReserveHistory(iter);
     for (unsigned i = 0; i < iter; ++i)
+    {
         Step();
+        CheckpointIfDue();
+    }
+    SortReservoir();
 }
 CaSize CellularAutomata::GetSize() const noexcept
 {
@@ -195,12 +1085,151 @@ CaSize CellularAutomata::GetSize() const noexcept
 }
 CaSize CellularAutomata::GetHistorySize() const noexcept
 {
-    return m_ca_history.size();
+    return m_ca_history->size();
 }
 unsigned CellularAutomata::CountCars() const noexcept
 {
     return count_if(m_ca.begin(), m_ca.end(), [](CaVelocity i) {return i != CA_EMPTY; });
 }
+void CellularAutomata::SetCarCount(const unsigned cars)
+{
+    const unsigned current = m_cars;
+    if (cars == current || cars > m_size)
+        return;
+    m_cars = cars;
+
+    // Casillas candidatas: vacías si se agregan autos, ocupadas si se quitan.
+    const bool add = (cars > current);
+    vector<CaPosition> candidates;
+    candidates.reserve(add ? m_size - current : current);
+    for (CaSize i = 0; i < m_size; ++i)
+    {
+        if ((m_ca[i] == CA_EMPTY) == add)
+            candidates.push_back((CaPosition)i);
+    }
+
+    // Fisher-Yates parcial: solo se eligen las casillas que cambian.
+    const unsigned changes = add ? cars - current : current - cars;
+    for (unsigned k = 0; k < changes; ++k)
+    {
+        swap(candidates[k], candidates[k + RandomGen::GetInt((int)(candidates.size() - k))]);
+        const CaPosition pos = candidates[k];
+        if (add)
+        {
+            m_ca[pos] = m_init_vel;
+            OnCarAdded(pos, current + k + 1);
+        }
+        else
+            m_ca[pos] = CA_EMPTY;
+    }
+    if (!add)
+    {
+        candidates.resize(changes);
+        sort(candidates.begin(), candidates.end());
+        OnCarsRemoved(candidates);
+    }
+}
+void CellularAutomata::SetDensity(const double density)
+{
+    SetCarCount((unsigned)(((double)m_size)*density));
+}
+void CellularAutomata::PlaceCars(const unsigned vehicles, const INITIAL_CONDITION init)
+{
+    if (vehicles == 0)
+        return;
+    switch (init)
+    {
+        case INIT_MEGAJAM:
+            fill(m_ca.begin(), m_ca.begin() + vehicles, m_init_vel);
+            return;
+        case INIT_UNIFORM:
+            for (unsigned i = 0; i < vehicles; ++i)
+                m_ca[(CaSize)((uint64_t)i*m_size/vehicles)] = m_init_vel;
+            return;
+        default:
+            break;
+    }
+
+    if (m_size <= PLACEMENT_BLOCK)
+    {
+        aux_floyd_sample(m_ca.data(), m_size, (CaSize)vehicles, CA_EMPTY, m_init_vel,
+                         [](const CaSize n) { return (CaSize)RandomGen::GetInt((int)n); });
+        return;
+    }
+
+    // Reparte los autos entre bloques como lo haría una selección uniforme del AC completo y da a cada bloque
+    // una semilla propia, de modo que el resultado no depende de la cantidad de hilos.
+    const unsigned blocks = (unsigned)((m_size + (uint64_t)PLACEMENT_BLOCK - 1)/PLACEMENT_BLOCK);
+    vector<unsigned> counts(blocks);
+    vector<uint64_t> seeds(blocks);
+    uint64_t cells_left = m_size, cars_left = vehicles;
+    for (unsigned b = 0; b < blocks; ++b)
+    {
+        const CaSize cells = min(PLACEMENT_BLOCK, m_size - b*PLACEMENT_BLOCK);
+        counts[b] = (unsigned)aux_hypergeometric(cells_left, cars_left, cells, RandomGen::GetDouble());
+        cells_left -= cells;
+        cars_left -= counts[b];
+        seeds[b] = ((uint64_t)RandomGen::GetInt(1 << 30) << 30) ^ (uint64_t)RandomGen::GetInt(1 << 30);
+    }
+    aux_run_parallel(blocks, vehicles, [&](const unsigned b)
+    {
+        Xoshiro256ss engine(seeds[b]);
+        const CaSize first = b*PLACEMENT_BLOCK;
+        aux_floyd_sample(m_ca.data() + first, min(PLACEMENT_BLOCK, m_size - first), (CaSize)counts[b], CA_EMPTY, m_init_vel,
+                         [&engine](const CaSize n) { return (CaSize)aux_bounded_rand(engine, n); });
+    });
+}
+bool CellularAutomata::LoadLattice(const string &filepath, const string &classes_filepath)
+{
+    NpyReader lattice, classes;
+    if (!lattice.Open(filepath))
+        return false;
+    if (lattice.Rows() == 0 || lattice.Cols() != m_size)
+    {
+        cout << "Error: La pista del archivo no tiene el tamano del AC." << endl;
+        return false;
+    }
+    if (classes_filepath != "")
+    {
+        if (!classes.Open(classes_filepath))
+            return false;
+        if (classes.Rows() == 0 || classes.Cols() != m_size)
+        {
+            cout << "Error: Las clases del archivo no tienen el tamano del AC." << endl;
+            return false;
+        }
+    }
+
+    // Se valida por bloques antes de escribir directamente en la pista.
+    const uint64_t row = lattice.Rows() - 1;
+    vector<int64_t> block(min(LATTICE_BLOCK, (size_t)m_size));
+    for (size_t first = 0; first < m_size; first += LATTICE_BLOCK)
+    {
+        const size_t count = min(LATTICE_BLOCK, m_size - first);
+        lattice.Read(row, first, count, block.data());
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (block[i] < CA_EMPTY || block[i] > m_vmax)
+            {
+                cout << "Error: Velocidad invalida en la casilla " << first + i << " de la pista." << endl;
+                return false;
+            }
+        }
+    }
+    lattice.Read(row, 0, m_size, m_ca.data());
+    fill(m_ca_temp.begin(), m_ca_temp.end(), CA_EMPTY);
+    fill(m_ca_flow_temp.begin(), m_ca_flow_temp.end(), NO_FLOW);
+    SetCarClasses(classes_filepath != "" ? &classes : nullptr);
+    m_cars = CountCars();
+    return true;
+}
+void CellularAutomata::SetCarClasses(const NpyReader* classes)
+{
+    if (classes)
+        cout << "Error: Este AC no tiene clases de autos. Se ignoran." << endl;
+}
+void CellularAutomata::OnCarAdded(const CaPosition, const unsigned) {}
+void CellularAutomata::OnCarsRemoved(const vector<CaPosition>&) {}
 bool CellularAutomata::Randomization(const double prob) noexcept
 {
     double l_prob;
@@ -209,67 +1238,408 @@ bool CellularAutomata::Randomization(const double prob) noexcept
     else
         l_prob = prob;
 
-    // Si está en modo de prueba toma los valores aleatorios de la lista.
-    if (m_test)
+    bool ret;
+    if (m_trace_reader)
+        ret = m_trace_reader->Next();
+    else if (m_test)
     {
-        if (m_rand_values.size() != 0)
+        // Si está en modo de prueba toma los valores aleatorios de la lista.
+        if (m_rand_cursor < m_rand_values.size())
+            ret = m_rand_values[m_rand_cursor++];
+        else
+            ret = false;
+    }
+    else
+        ret = RandomGen::GetDouble() <= l_prob;
+
+    if (m_trace_writer)
+        m_trace_writer->Write(ret);
+    return ret;
+}
+void CellularAutomata::RecordRandomness(const string &filepath)
+{
+    m_trace_writer.reset(new RandomTraceWriter(filepath));
+    if (!m_trace_writer->IsOpen())
+        m_trace_writer.reset();
+}
+void CellularAutomata::ReplayRandomness(const string &filepath)
+{
+    m_trace_reader.reset(new RandomTraceReader(filepath));
+    if (!m_trace_reader->IsOpen())
+        m_trace_reader.reset();
+}
+void CellularAutomata::StopTrace()
+{
+    m_trace_writer.reset();
+    m_trace_reader.reset();
+}
+void CellularAutomata::AccumulateStatistics(const size_t first, const size_t last, const size_t flow_last,
+                                            HistorySums &sums) const
+{
+    const size_t width = m_ca_history->Width();
+
+    uint64_t* ocupancy = sums.ocupancy.data();
+    uint64_t* velocity = sums.velocity.data();
+    if (m_history_mode == HISTORY_PACKED)
+    {
+        // El código de cada casilla es v + 1 y 0 si está vacía. Se pliegan los bits de cada casilla sobre su bit
+        // menos significativo, que queda encendido si hay auto, y solo se decodifican las casillas con auto.
+        const PackedHistory<CaVelocity> &packed = static_cast<const PackedHistory<CaVelocity>&>(*m_ca_history);
+        const unsigned bits = packed.Bits();
+        const unsigned per_word = 64/bits;
+        const uint64_t mask = ((uint64_t)1 << bits) - 1;
+        uint64_t lsb = 0;
+        for (unsigned k = 0; k < per_word; ++k)
+            lsb |= (uint64_t)1 << (k*bits);
+
+        for (size_t j = first; j < last; ++j)
         {
-            bool ret = m_rand_values[0];
-            m_rand_values.erase(m_rand_values.begin());
-            return ret;
+            const uint64_t* words = packed.Words(j);
+            for (size_t w = 0; w < packed.WordsPerRow(); ++w)
+            {
+                uint64_t x = words[w];
+                for (unsigned shift = 1; shift < bits; shift <<= 1)
+                    x |= x >> shift;
+                x &= lsb;
+                while (x)
+                {
+                    const unsigned bit = aux_ctz64(x);
+                    const size_t i = w*per_word + bit/bits;
+                    ocupancy[i]++;
+                    velocity[i] += ((words[w] >> bit) & mask) - 1;
+                    x &= x - 1;
+                }
+            }
         }
-        else
-            return false;
     }
     else
     {
-        if (RandomGen::GetDouble() <= l_prob)
-            return true;
-        else
-            return false;
+        // CA_EMPTY es -1, así que (v >= 0) cuenta autos y max(v, 0) suma velocidades sin ramas.
+        HistoryCursor<CaVelocity> cursor(*m_ca_history);
+        for (size_t j = first; j < last; ++j)
+        {
+            const CaVelocity* row = cursor.Row(j);
+            for (size_t i = 0; i < width; ++i)
+            {
+                const CaVelocity v = row[i];
+                ocupancy[i] += (v >= 0);
+                velocity[i] += (v > 0) ? v : 0;
+            }
+        }
     }
-}
-vector<double> CellularAutomata::CalculateOcupancy() const noexcept
-{
-    vector<double> ocupancy;
-    ocupancy.assign(this->GetSize(), 0.0);
-    unsigned height = this->GetHistorySize();
-    unsigned width = this->GetSize();
 
-    for (unsigned i = 0; i < width; ++i)
+    uint64_t* flow = sums.flow.data();
+    if (m_history_mode == HISTORY_PACKED)
     {
-        int sum = 0;
-        for (unsigned j = 1; j < height; ++j)
+        // Hay flujo en i si las casillas i e i + 1 tienen flujo: bits de w & (w >> 1).
+        const PackedHistory<CaFlow> &packed = static_cast<const PackedHistory<CaFlow>&>(*m_ca_flow_history);
+        const size_t row_words = packed.WordsPerRow();
+        for (size_t j = first; j < flow_last; ++j)
         {
-            if (m_ca_history[j][i] != CA_EMPTY)
-                sum++;
+            const uint64_t* words = packed.Words(j);
+            for (size_t w = 0; w < row_words; ++w)
+            {
+                uint64_t next = (w + 1 < row_words) ? words[w + 1] << 63 : 0;
+                uint64_t x = words[w] & ((words[w] >> 1) | next);
+                while (x)
+                {
+                    size_t i = w*64 + aux_ctz64(x);
+                    if (i < width - 1)
+                        flow[i]++;
+                    x &= x - 1;
+                }
+            }
+        }
+    }
+    else
+    {
+        HistoryCursor<CaFlow> flow_cursor(*m_ca_flow_history);
+        for (size_t j = first; j < flow_last; ++j)
+        {
+            const CaFlow* row = flow_cursor.Row(j);
+            for (size_t i = 0; i + 1 < width; ++i)
+                flow[i] += (row[i] != NO_FLOW) & (row[i + 1] != NO_FLOW);
         }
-        ocupancy[i] = (double)sum/(double)height;
     }
-    return ocupancy;
 }
-vector<double> CellularAutomata::CalculateFlow() const noexcept
+HistoryStatistics CellularAutomata::CalculateStatistics(unsigned threads) const noexcept
 {
-    vector<double> flow;
-    flow.assign(this->GetSize(), 0.0);
-    unsigned height = this->GetHistorySize();
-    unsigned width = this->GetSize();
+    if (m_stats_version == m_history_version)
+        return m_stats;
+
+    const size_t width = m_ca_history->Width();
+    const size_t height = m_ca_history->size();
+    const size_t flow_height = min(height, m_ca_flow_history->size());
+
+    // Bloques contiguos de filas por hilo, de al menos 2^20 casillas cada uno. La primera fila no se suma.
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+    const size_t rows = (height > 1) ? height - 1 : 0;
+    const size_t min_rows = max<size_t>(1, ((size_t)1 << 20)/max<size_t>(1, width));
+    threads = (unsigned)max<size_t>(1, min<size_t>(threads, rows/min_rows));
+
+    vector<HistorySums> partial(threads);
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        partial[t].ocupancy.assign(width, 0);
+        partial[t].velocity.assign(width, 0);
+        partial[t].flow.assign(width, 0);
+    }
 
-    for (unsigned i = 0; i < width - 1; ++i)
+    m_ca_history->PrepareRead();
+    m_ca_flow_history->PrepareRead();
+    auto work = [&](const unsigned t)
     {
-        int sum = 0;
-        for (unsigned j = 1; j < height; ++j)
+        const size_t first = 1 + rows*t/threads;
+        const size_t last = 1 + rows*(t + 1)/threads;
+        AccumulateStatistics(first, last, min(last, flow_height), partial[t]);
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        try
+        {
+            pool.push_back(thread(work, t));
+        }
+        catch (...)
         {
-            if ((m_ca_flow_history[j][i] != NO_FLOW) && (m_ca_flow_history[j][i + 1] != NO_FLOW))
-                sum++;
+            work(t);
         }
-        flow[i] = (double)sum/(double)height;
     }
-    return flow;
+    work(0);
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+
+    // Combina las sumas parciales.
+    HistoryStatistics stats;
+    stats.ocupancy.assign(width, 0.0);
+    stats.flow.assign(width, 0.0);
+    stats.velocity.assign(width, 0.0);
+    stats.mean_ocupancy = stats.mean_flow = stats.mean_velocity = 0.0;
+    uint64_t total_cars = 0, total_velocity = 0;
+    for (size_t i = 0; i < width; ++i)
+    {
+        uint64_t cars = 0, vel = 0, fl = 0;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            cars += partial[t].ocupancy[i];
+            vel += partial[t].velocity[i];
+            fl += partial[t].flow[i];
+        }
+        total_cars += cars;
+        total_velocity += vel;
+        if (height != 0)
+        {
+            stats.ocupancy[i] = (double)cars/(double)height;
+            if (i + 1 < width)
+                stats.flow[i] = (double)fl/(double)height;
+        }
+        if (cars != 0)
+            stats.velocity[i] = (double)vel/(double)cars;
+    }
+    if (width != 0)
+    {
+        stats.mean_ocupancy = aux_mean(stats.ocupancy);
+        stats.mean_flow = aux_mean(stats.flow);
+    }
+    if (total_cars != 0)
+        stats.mean_velocity = (double)total_velocity/(double)total_cars;
+    m_stats = stats;
+    m_stats_version = m_history_version;
+    return stats;
+}
+vector<double> CellularAutomata::CalculateOcupancy() const noexcept
+{
+    return CalculateStatistics().ocupancy;
+}
+vector<double> CellularAutomata::CalculateFlow() const noexcept
+{
+    return CalculateStatistics().flow;
 }
 double CellularAutomata::CalculateMeanFlow() const noexcept
 {
-    return aux_mean(this->CalculateFlow());
+    return CalculateStatistics().mean_flow;
+}
+
+
+/****************************
+*                           *
+*   Estadísticas en línea   *
+*                           *
+****************************/
+
+ExportedRows::ExportedRows()
+{
+    velocities = NPY_ROWS_UNKNOWN;
+    flow = NPY_ROWS_UNKNOWN;
+}
+ExportedRows::ExportedRows(const uint64_t velocities, const uint64_t flow)
+{
+    this->velocities = velocities;
+    this->flow = flow;
+}
+bool ExportedRows::Known() const noexcept
+{
+    return velocities != NPY_ROWS_UNKNOWN && flow != NPY_ROWS_UNKNOWN;
+}
+
+CellStatistics::CellStatistics(const bool skip_first)
+{
+    m_rows = 0;
+    m_flow_rows = 0;
+    m_skip_first = skip_first;
+}
+void CellStatistics::OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size)
+{
+    (void)step;
+    if (m_ocupancy.size() != size)
+    {
+        m_ocupancy.assign(size, 0);
+        m_ocupancy_total.clear();
+    }
+
+    // Igual que CalculateOcupancy: la primera fila se cuenta pero no se suma.
+    if (m_rows++ == 0 && m_skip_first)
+        return;
+    uint32_t* ocupancy = m_ocupancy.data();
+    for (CaSize i = 0; i < size; ++i)
+        ocupancy[i] += (uint32_t)(row[i] != CA_EMPTY);
+    if (m_rows % STATS_SPILL_ROWS == 0)
+        spill_counters(m_ocupancy, m_ocupancy_total);
+}
+void CellStatistics::OnFlow(const CaStep step, const CaFlow* row, const CaSize size)
+{
+    (void)step;
+    if (m_flow.size() != size)
+    {
+        m_flow.assign(size, 0);
+        m_flow_total.clear();
+    }
+
+    if (m_flow_rows++ == 0 && m_skip_first)
+        return;
+    // & en vez de && para que el ciclo no tenga ramas.
+    uint32_t* flow = m_flow.data();
+    for (CaSize i = 0; i + 1 < size; ++i)
+        flow[i] += (uint32_t)((row[i] != NO_FLOW) & (row[i + 1] != NO_FLOW));
+    if (m_flow_rows % STATS_SPILL_ROWS == 0)
+        spill_counters(m_flow, m_flow_total);
+}
+vector<double> CellStatistics::Ocupancy() const
+{
+    return counters_mean(m_ocupancy, m_ocupancy_total, m_rows);
+}
+vector<double> CellStatistics::Flow() const
+{
+    return counters_mean(m_flow, m_flow_total, m_rows);
+}
+double CellStatistics::MeanFlow() const
+{
+    return aux_mean(this->Flow());
+}
+uint64_t CellStatistics::Rows() const noexcept
+{
+    return m_rows;
+}
+void CellStatistics::Clear()
+{
+    m_ocupancy.clear();
+    m_flow.clear();
+    m_ocupancy_total.clear();
+    m_flow_total.clear();
+    m_rows = 0;
+    m_flow_rows = 0;
+}
+
+void StepObserverList::Add(StepObserver* observer)
+{
+    if (observer)
+        m_observers.push_back(observer);
+}
+bool StepObserverList::Empty() const noexcept
+{
+    return m_observers.empty();
+}
+void StepObserverList::OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size)
+{
+    for (size_t i = 0; i < m_observers.size(); ++i)
+        m_observers[i]->OnVelocities(step, row, size);
+}
+void StepObserverList::OnFlow(const CaStep step, const CaFlow* row, const CaSize size)
+{
+    for (size_t i = 0; i < m_observers.size(); ++i)
+        m_observers[i]->OnFlow(step, row, size);
+}
+
+
+/****************************
+*                           *
+*      Dibujo en línea      *
+*                           *
+****************************/
+
+HistoryRenderer::HistoryRenderer(const CellularAutomata &ca, const string &traffic_file, const string &flow_file)
+{
+    vector<BMPPixel> flow_lut;
+    m_max_vel = ca.ColorTables(m_vel_lut, flow_lut);
+    m_flow_palette.assign(flow_lut.begin(), flow_lut.begin() + IS_FLOW + 1);
+    m_first = ca.GetHistoryFirstCell();
+    m_cells = ca.GetHistoryWidth();
+    m_rows = 0;
+    m_indices.resize(m_cells);
+
+    // El alto se desconoce hasta cerrar, así que las líneas van de arriba a abajo.
+    if (traffic_file != "")
+    {
+        m_traffic.reset(new BMPWriter(traffic_file, m_cells, 0, fit_bmp_format(ca.GetImageFormat(), m_vel_lut.size()),
+                                      m_vel_lut, true));
+        if (!m_traffic->IsOpen())
+            m_traffic.reset();
+    }
+    if (flow_file != "")
+    {
+        m_flow.reset(new BMPWriter(flow_file, m_cells, 0, fit_bmp_format(ca.GetImageFormat(), m_flow_palette.size()),
+                                   m_flow_palette, true));
+        if (!m_flow->IsOpen())
+            m_flow.reset();
+    }
+}
+HistoryRenderer::~HistoryRenderer()
+{
+    Close();
+}
+void HistoryRenderer::OnVelocities(const CaStep, const CaVelocity* row, const CaSize size)
+{
+    if (!m_traffic || m_first + m_cells > size)
+        return;
+    for (CaSize j = 0; j < m_cells; ++j)
+        m_indices[j] = (uint8_t)(min(max(row[m_first + j], CA_EMPTY), m_max_vel) + 1);
+    m_line.clear();
+    BMPWriter::EncodeIndexLine(m_traffic->GetFormat(), m_indices.data(), m_cells, m_vel_lut, m_line);
+    m_traffic->WriteEncoded(m_line.data(), m_line.size(), 1);
+    ++m_rows;
+}
+void HistoryRenderer::OnFlow(const CaStep, const CaFlow* row, const CaSize size)
+{
+    if (!m_flow || m_first + m_cells > size)
+        return;
+    for (CaSize j = 0; j < m_cells; ++j)
+        m_indices[j] = (uint8_t)((row[m_first + j] != NO_FLOW) ? IS_FLOW : NO_FLOW);
+    m_line.clear();
+    BMPWriter::EncodeIndexLine(m_flow->GetFormat(), m_indices.data(), m_cells, m_flow_palette, m_line);
+    m_flow->WriteEncoded(m_line.data(), m_line.size(), 1);
+}
+uint64_t HistoryRenderer::Rows() const noexcept
+{
+    return m_rows;
+}
+void HistoryRenderer::Close()
+{
+    if (m_traffic)
+        m_traffic->CloseBMP();
+    if (m_flow)
+        m_flow->CloseBMP();
 }
 
 
@@ -279,10 +1649,19 @@ double CellularAutomata::CalculateMeanFlow() const noexcept
 *                           *
 ****************************/
 
-CircularCA::CircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel)
-    : CellularAutomata(size, density, vmax, rand_prob, init_vel) {}
+CircularCA::CircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
+                       const INITIAL_CONDITION init)
+    : CellularAutomata(size, density, vmax, rand_prob, init_vel, init) {}
 CircularCA::CircularCA(const vector<int> &ca, const vector<bool> &rand_values, const CaVelocity vmax)
     : CellularAutomata(ca, rand_values, vmax) {}
+CellularAutomata* CircularCA::Clone() const
+{
+    return new CircularCA(*this);
+}
+CA_TYPE CircularCA::GetType() const noexcept
+{
+    return CIRCULAR_CA;
+}
 inline CaVelocity &CircularCA::At(const CaPosition i) noexcept
 {
     return m_ca[i % m_ca.size()];
@@ -299,11 +1678,20 @@ inline CaVelocity CircularCA::GetAt(const CaPosition i) const noexcept
 {
     return m_ca[i % m_ca.size()];
 }
+bool CircularCA::IsPeriodic() const noexcept
+{
+    return true;
+}
 void CircularCA::Evolve(const unsigned iter) noexcept
 {
     unsigned cars = CountCars();
+    ReserveHistory(iter);
     for (unsigned i = 0; i < iter; ++i)
+    {
         Step();
+        CheckpointIfDue();
+    }
+    SortReservoir();
 
     if (cars != CountCars())
         cout << "Error: La cantidad de autos no se conserva." << endl;
@@ -317,8 +1705,8 @@ void CircularCA::Evolve(const unsigned iter) noexcept
 ****************************/
 
 OpenCA::OpenCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
-               const double new_car_prob, const CaVelocity new_car_speed)
-    : CellularAutomata(size, density, vmax, rand_prob, init_vel)
+               const double new_car_prob, const CaVelocity new_car_speed, const INITIAL_CONDITION init)
+    : CellularAutomata(size, density, vmax, rand_prob, init_vel, init)
 {
     m_new_car_prob = new_car_prob;
     m_new_car_speed = new_car_speed;
@@ -334,6 +1722,20 @@ OpenCA::OpenCA(const vector<int> &ca, const vector<bool> &rand_values, const CaV
     m_ca_empty = CA_EMPTY;
     m_ca_flow_empty = NO_FLOW;
 }
+CellularAutomata* OpenCA::Clone() const
+{
+    return new OpenCA(*this);
+}
+CA_TYPE OpenCA::GetType() const noexcept
+{
+    return OPEN_CA;
+}
+void OpenCA::FillCheckpoint(Checkpoint &checkpoint) const
+{
+    CellularAutomata::FillCheckpoint(checkpoint);
+    checkpoint.new_car_prob = m_new_car_prob;
+    checkpoint.new_car_speed = m_new_car_speed;
+}
 inline CaVelocity &OpenCA::At(const CaPosition i) noexcept
 {
     return ((unsigned)i >= m_ca.size()) ? m_ca_empty : m_ca[i];
@@ -350,8 +1752,18 @@ inline CaVelocity OpenCA::GetAt(const CaPosition i) const noexcept
 {
     return ((unsigned)i >= m_ca.size()) ? CA_EMPTY : m_ca[i];
 }
+bool OpenCA::IsPeriodic() const noexcept
+{
+    return false;
+}
+CaVelocity OpenCA::MaxVelocity() const noexcept
+{
+    return max(CellularAutomata::MaxVelocity(), m_new_car_speed);
+}
 void OpenCA::Step() noexcept
 {
+    BeginStep();
+
     // Iterar sobre AC hasta encotrar vehiculo.
     for (unsigned i = 0; i < m_ca.size(); ++i)
     {
@@ -372,20 +1784,32 @@ void OpenCA::Step() noexcept
             }
 
             // Aleatoriedad.
-            bool rnd = Randomization();
+            bool rnd = NextRandomization();
             if ((m_ca[i] > 0) && rnd)
                 m_ca[i]--;
         }
     }
 
-    m_ca_history.push_back(m_ca);
+    RecordHistory();
 
     // Aplicar cambios.
+    m_cars -= min(CarsLeaving(), m_cars);
     Move();
 
     // Añade coche con probabilidad aleatoria.
     if (m_ca[0] == CA_EMPTY && Randomization(m_new_car_prob))
+    {
         m_ca[0] = m_new_car_speed;
+        ++m_cars;
+    }
+}
+CaSize OpenCA::CarsLeaving() const noexcept
+{
+    CaSize leaving = 0;
+    const CaSize reach = (CaSize)MaxVelocity();
+    for (CaSize i = (m_size > reach) ? m_size - reach : 0; i < m_size; ++i)
+        leaving += (m_ca[i] != CA_EMPTY && i + m_ca[i] >= m_size);
+    return leaving;
 }
 
 
@@ -397,8 +1821,8 @@ void OpenCA::Step() noexcept
 
 // Frontera circular
 AutonomousCircularCA::AutonomousCircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob,
-                           const CaVelocity init_vel, const double aut_density)
-    : CircularCA(size, density, vmax, rand_prob, init_vel)
+                           const CaVelocity init_vel, const double aut_density, const INITIAL_CONDITION init)
+    : CircularCA(size, density, vmax, rand_prob, init_vel, init)
 {
     // Selecciona autos inteligentes.
     unsigned aut_car_number = (unsigned)(((double)size*density)*aut_density);
@@ -409,9 +1833,50 @@ AutonomousCircularCA::AutonomousCircularCA(const CaSize size, const double densi
             aut_car_positions.push_back(i);
     }
 
-    random_shuffle(aut_car_positions.begin(), aut_car_positions.end(), RandomGen::GetInt);
-    for (unsigned i = 0; i < aut_car_positions.size() && i < aut_car_number; ++i)
+    // Fisher-Yates parcial: solo se eligen los autos autónomos.
+    aut_car_number = min(aut_car_number, (unsigned)aut_car_positions.size());
+    for (unsigned i = 0; i < aut_car_number; ++i)
+    {
+        swap(aut_car_positions[i], aut_car_positions[i + RandomGen::GetInt((int)(aut_car_positions.size() - i))]);
         m_aut_cars.push_back(aut_car_positions[i]);
+    }
+}
+CellularAutomata* AutonomousCircularCA::Clone() const
+{
+    return new AutonomousCircularCA(*this);
+}
+CA_TYPE AutonomousCircularCA::GetType() const noexcept
+{
+    return AUTONOMOUS_CIRCULAR_CA;
+}
+CaState AutonomousCircularCA::GetState() const
+{
+    CaState state = CellularAutomata::GetState();
+    state.extra = m_aut_cars;
+    return state;
+}
+void AutonomousCircularCA::SetState(const CaState &state)
+{
+    CellularAutomata::SetState(state);
+    m_aut_cars = state.extra;
+}
+void AutonomousCircularCA::OnCarAdded(const CaPosition position, const unsigned cars)
+{
+    // El auto nuevo es autónomo con la fracción actual de autos autónomos.
+    if (cars > 1 && RandomGen::GetInt((int)(cars - 1)) < (int)m_aut_cars.size())
+        m_aut_cars.push_back(position);
+}
+void AutonomousCircularCA::SetCarClasses(const NpyReader* classes)
+{
+    m_aut_cars = classes ? autonomous_positions(m_ca, *classes) : vector<int>();
+}
+void AutonomousCircularCA::OnCarsRemoved(const vector<CaPosition> &positions)
+{
+    // Una sola pasada sobre la lista, que conserva su orden.
+    m_aut_cars.erase(remove_if(m_aut_cars.begin(), m_aut_cars.end(), [&positions](const int pos)
+    {
+        return binary_search(positions.begin(), positions.end(), (CaPosition)pos);
+    }), m_aut_cars.end());
 }
 void AutonomousCircularCA::Move() noexcept
 {
@@ -435,6 +1900,8 @@ void AutonomousCircularCA::Move() noexcept
 }
 void AutonomousCircularCA::Step() noexcept
 {
+    BeginStep();
+
     // Iterar sobre AC hasta encotrar vehiculo.
     for (unsigned i = 0; i < m_ca.size(); ++i)
     {
@@ -506,7 +1973,7 @@ void AutonomousCircularCA::Step() noexcept
             // Aleatoriedad.
             if (!smart)
             {
-                bool rnd = Randomization();
+                bool rnd = NextRandomization();
                 if ((m_ca[i] > 0) && rnd)
                     m_ca[i]--;
             }
@@ -514,14 +1981,15 @@ void AutonomousCircularCA::Step() noexcept
     }
 
     // Aplicar cambios.
-    m_ca_history.push_back(m_ca);
+    RecordHistory();
     Move();
 }
 
 // Frontera abierta
 AutonomousOpenCA::AutonomousOpenCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob,
-                           const CaVelocity init_vel, const double aut_density, const double new_car_prob, const CaVelocity new_car_speed)
-    : OpenCA(size, density, vmax, rand_prob, init_vel, new_car_prob, new_car_speed)
+                           const CaVelocity init_vel, const double aut_density, const double new_car_prob, const CaVelocity new_car_speed,
+                           const INITIAL_CONDITION init)
+    : OpenCA(size, density, vmax, rand_prob, init_vel, new_car_prob, new_car_speed, init)
 {
     // Selecciona autos inteligentes.
     unsigned aut_car_number = (unsigned)(((double)size*density)*aut_density);
@@ -532,9 +2000,50 @@ AutonomousOpenCA::AutonomousOpenCA(const CaSize size, const double density, cons
             aut_car_positions.push_back(i);
     }
 
-    random_shuffle(aut_car_positions.begin(), aut_car_positions.end(), RandomGen::GetInt);
-    for (unsigned i = 0; i < aut_car_positions.size() && i < aut_car_number; ++i)
+    // Fisher-Yates parcial: solo se eligen los autos autónomos.
+    aut_car_number = min(aut_car_number, (unsigned)aut_car_positions.size());
+    for (unsigned i = 0; i < aut_car_number; ++i)
+    {
+        swap(aut_car_positions[i], aut_car_positions[i + RandomGen::GetInt((int)(aut_car_positions.size() - i))]);
         m_aut_cars.push_back(aut_car_positions[i]);
+    }
+}
+CellularAutomata* AutonomousOpenCA::Clone() const
+{
+    return new AutonomousOpenCA(*this);
+}
+CA_TYPE AutonomousOpenCA::GetType() const noexcept
+{
+    return AUTONOMOUS_OPEN_CA;
+}
+CaState AutonomousOpenCA::GetState() const
+{
+    CaState state = CellularAutomata::GetState();
+    state.extra = m_aut_cars;
+    return state;
+}
+void AutonomousOpenCA::SetState(const CaState &state)
+{
+    CellularAutomata::SetState(state);
+    m_aut_cars = state.extra;
+}
+void AutonomousOpenCA::OnCarAdded(const CaPosition position, const unsigned cars)
+{
+    // El auto nuevo es autónomo con la fracción actual de autos autónomos.
+    if (cars > 1 && RandomGen::GetInt((int)(cars - 1)) < (int)m_aut_cars.size())
+        m_aut_cars.push_back(position);
+}
+void AutonomousOpenCA::SetCarClasses(const NpyReader* classes)
+{
+    m_aut_cars = classes ? autonomous_positions(m_ca, *classes) : vector<int>();
+}
+void AutonomousOpenCA::OnCarsRemoved(const vector<CaPosition> &positions)
+{
+    // Una sola pasada sobre la lista, que conserva su orden.
+    m_aut_cars.erase(remove_if(m_aut_cars.begin(), m_aut_cars.end(), [&positions](const int pos)
+    {
+        return binary_search(positions.begin(), positions.end(), (CaPosition)pos);
+    }), m_aut_cars.end());
 }
 void AutonomousOpenCA::Move() noexcept
 {
@@ -546,7 +2055,9 @@ void AutonomousOpenCA::Move() noexcept
             if (pos != -1)
                 m_aut_cars[pos] = (i + m_ca[i]) % m_size;
 
-            // Cambia las posiciones de los autos en AC.
+            // Cambia las posiciones de los autos en AC. El auto que entra no frena, así que puede caer sobre otro.
+            if (i + m_ca[i] < m_size && m_ca_temp[i + m_ca[i]] != CA_EMPTY && m_cars != 0)
+                --m_cars;
             AtTemp(i + m_ca[i]) = m_ca[i];
 
             // Marca las casillas donde hay flujo de autos.
@@ -558,6 +2069,8 @@ void AutonomousOpenCA::Move() noexcept
 }
 void AutonomousOpenCA::Step() noexcept
 {
+    BeginStep();
+
     // Iterar sobre AC hasta encontrar vehiculo.
     for (unsigned i = 0; i < m_ca.size(); ++i)
     {
@@ -629,7 +2142,7 @@ void AutonomousOpenCA::Step() noexcept
             // Aleatoriedad.
             if (!smart)
             {
-                bool rnd = Randomization();
+                bool rnd = NextRandomization();
                 if ((m_ca[i] > 0) && rnd)
                     m_ca[i]--;
             }
@@ -638,9 +2151,13 @@ void AutonomousOpenCA::Step() noexcept
 
     // Añade coche con probabilidad aleatoria.
     if (m_ca[0] == CA_EMPTY && Randomization(m_new_car_prob))
+    {
         m_ca[0] = m_new_car_speed;
+        ++m_cars;
+    }
 
     // Aplicar cambios.
-    m_ca_history.push_back(m_ca);
+    RecordHistory();
+    m_cars -= min(CarsLeaving(), m_cars);
     Move();
 }
\ No newline at end of file
@@ -13,14 +13,35 @@
 #include <cstdlib>
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
 
 #include "Auxiliar.h"
+#include "RandomTrace.h"
+#include "History.h"
+#include "BmpWriter.h"
 
 enum CA_TYPE
 {
     CIRCULAR_CA, OPEN_CA, AUTONOMOUS_CIRCULAR_CA, AUTONOMOUS_OPEN_CA
 };
 
+/**
+* @enum INITIAL_CONDITION
+* @brief Disposición inicial de los autos.
+*
+* INIT_RANDOM elige las casillas al azar, INIT_MEGAJAM pone todos los autos juntos desde la casilla 0 e
+* INIT_UNIFORM los reparte con espaciado uniforme. Las dos últimas no consumen números aleatorios.
+*/
+enum INITIAL_CONDITION
+{
+    INIT_RANDOM, INIT_MEGAJAM, INIT_UNIFORM
+};
+
+struct Checkpoint;
+class NpyReader;
+
 
 /****************************
 *                           *
@@ -45,12 +66,177 @@ using CaLane = unsigned;
 using CaPosition = int;
 using CaVelocity = int;
 using CaFlow = char;
+using CaStep = uint64_t;
 
 const CaVelocity CA_EMPTY = -1;
 const CaPosition CA_NULL_POS = -1;
 const CaFlow NO_FLOW = 0;
 const CaFlow IS_FLOW = 1;
 
+/// Versión del motor de simulación. Se incrementa cuando un cambio altera los resultados obtenidos con una
+/// misma semilla, lo que invalida las cachés de resultados (ver ResultCache).
+const unsigned CA_ENGINE_VERSION = 2;
+
+/**
+ * @struct CaState
+ * @brief Estado completo de un AC entre dos pasos. Basta para continuar la evolución de manera determinista.
+ */
+struct CaState
+{
+    CaStep step;                  ///< Pasos aplicados.
+    std::vector<CaVelocity> ca;   ///< Velocidades de cada casilla.
+    std::vector<int> extra;       ///< Estado propio de las clases hijas (por ejemplo, autos autónomos).
+    std::size_t rand_cursor;      ///< Siguiente valor aleatorio de prueba.
+    std::string rng;              ///< Estado de RandomGen devuelto por RandomGen::GetState.
+};
+
+/**
+ * @struct ExportedRows
+ * @brief Filas escritas en los archivos .npy de ExportHistoryNpy. El flujo puede tener una fila menos que las
+ * velocidades, así que se cuentan por separado.
+ */
+struct ExportedRows
+{
+    uint64_t velocities;    ///< Filas de filepath_ca.npy y filepath_obs.npy, o NPY_ROWS_UNKNOWN.
+    uint64_t flow;          ///< Filas de filepath_flow.npy, o NPY_ROWS_UNKNOWN.
+
+    ExportedRows();
+    ExportedRows(const uint64_t velocities, const uint64_t flow);
+    bool Known() const noexcept;    ///< Informa si se conocen las filas.
+};
+
+/// Cantidad de filas desconocida, por ejemplo en checkpoints guardados sin exportar por bloques.
+const uint64_t NPY_ROWS_UNKNOWN = ~(uint64_t)0;
+
+/**
+ * @struct HistoryStatistics
+ * @brief Estadísticas por casilla calculadas del histórico en una sola pasada.
+ */
+struct HistoryStatistics
+{
+    std::vector<double> ocupancy;   ///< Fracción de pasos con auto en cada casilla.
+    std::vector<double> flow;       ///< Fracción de pasos con flujo entre cada casilla y la siguiente.
+    std::vector<double> velocity;   ///< Velocidad media de los autos en cada casilla.
+    double mean_ocupancy;           ///< Media de ocupancy.
+    double mean_flow;               ///< Media de flow (igual a CalculateMeanFlow).
+    double mean_velocity;           ///< Velocidad media de todos los autos.
+};
+
+/**
+ * @class StepObserver
+ * @brief Recibe las filas de cada paso durante la evolución, antes de que pasen por las opciones de grabación.
+ * Se llama una vez por paso, no por casilla.
+ *
+ * Es una interfaz virtual y no un parámetro de plantilla de Step: Step es virtual en cada clase de AC, así que
+ * un observador en tiempo de compilación obligaría a instanciar todas las reglas por observador. Como la llamada
+ * es una por paso, su costo no se nota; lo que cuesta es la pasada del observador por la fila, que debe ser tan
+ * barata como la de CellStatistics.
+ */
+class StepObserver
+{
+public:
+    virtual ~StepObserver() {}
+
+    ///@brief Velocidades después de aplicar las reglas y antes de mover los autos (la fila del histórico).
+    virtual void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size) = 0;
+
+    ///@brief Casillas por las que pasaron autos al moverse (la fila del histórico de flujo).
+    virtual void OnFlow(const CaStep step, const CaFlow* row, const CaSize size) = 0;
+};
+
+/**
+ * @class StepObserverAdapter
+ * @brief Adapta cualquier clase con métodos OnVelocities y OnFlow a StepObserver sin heredar de ella.
+ */
+template <class Observer> class StepObserverAdapter : public StepObserver
+{
+    Observer &m_observer;
+public:
+    explicit StepObserverAdapter(Observer &observer) : m_observer(observer) {}
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size) { m_observer.OnVelocities(step, row, size); }
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size) { m_observer.OnFlow(step, row, size); }
+};
+
+/**
+ * @class CellStatistics
+ * @brief Acumula ocupación y flujo por casilla durante la evolución, sin guardar histórico.
+ * Los resultados coinciden con CalculateOcupancy y CalculateFlow sobre el histórico de los mismos pasos.
+ * Los contadores por casilla son de 32 bits para que la pasada por cada fila mueva poca memoria y se vectorice;
+ * se vuelcan a totales de 64 bits antes de que puedan desbordarse.
+ */
+class CellStatistics
+{
+    std::vector<uint32_t> m_ocupancy;  ///< Pasos con auto en cada casilla desde el último volcado.
+    std::vector<uint32_t> m_flow;      ///< Pasos con flujo entre cada casilla y la siguiente desde el último volcado.
+    std::vector<uint64_t> m_ocupancy_total, m_flow_total;   ///< Contadores volcados antes de que desborden.
+    uint64_t m_rows;                   ///< Filas de velocidades observadas.
+    uint64_t m_flow_rows;              ///< Filas de flujo observadas.
+    bool m_skip_first;                 ///< No sumar la primera fila.
+public:
+    ///@brief Constructor.
+    ///@param skip_first Contar la primera fila sin sumarla, como CalculateOcupancy. Con falso se suman todas, por
+    ///ejemplo cuando la primera fila observada ya es un paso medido.
+    explicit CellStatistics(const bool skip_first = true);
+
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size);
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size);
+
+    std::vector<double> Ocupancy() const;    ///< Devuelve ocupación media por casilla.
+    std::vector<double> Flow() const;        ///< Devuelve flujo medio por casilla.
+    double MeanFlow() const;                 ///< Devuelve flujo medio del AC.
+    uint64_t Rows() const noexcept;          ///< Devuelve pasos observados.
+    void Clear();                            ///< Reinicia los acumuladores.
+};
+
+/**
+ * @class StepObserverList
+ * @brief Reenvía las filas de cada paso a varios observadores, en el orden en que se agregaron.
+ */
+class StepObserverList : public StepObserver
+{
+    std::vector<StepObserver*> m_observers;
+public:
+    void Add(StepObserver* observer);       ///< Agrega un observador. No toma posesión de él.
+    bool Empty() const noexcept;             ///< Devuelve verdadero si no hay observadores.
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size);
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size);
+};
+
+class CellularAutomata;
+
+/**
+ * @class HistoryRenderer
+ * @brief Dibuja los mapas de tráfico y de flujo mientras el AC evoluciona, sin usar el histórico.
+ * Cada fila se escribe al recibirse en un BMP de arriba a abajo cuyo alto se corrige al cerrar, así que la
+ * memoria usada no depende de la cantidad de pasos y se puede evolucionar con HISTORY_NONE. Se dibujan todos
+ * los pasos con las casillas de la ventana de grabación y los colores y formato de DrawHistory.
+ */
+class HistoryRenderer : public StepObserver
+{
+    std::unique_ptr<BMPWriter> m_traffic;   ///< Mapa de tráfico. nullptr si no se dibuja.
+    std::unique_ptr<BMPWriter> m_flow;      ///< Mapa de flujo. nullptr si no se dibuja.
+    std::vector<BMPPixel> m_vel_lut;        ///< Colores de las velocidades (índice v + 1).
+    std::vector<BMPPixel> m_flow_palette;   ///< Colores del flujo.
+    std::vector<uint8_t> m_indices;         ///< Índices de la fila actual.
+    std::vector<char> m_line;               ///< Fila actual codificada.
+    CaVelocity m_max_vel;
+    CaSize m_first, m_cells;                ///< Ventana de casillas dibujada.
+    uint64_t m_rows;                        ///< Filas de tráfico dibujadas.
+public:
+    ///@brief Constructor. Abre los archivos de salida.
+    ///@param ca Autómata del que se toman colores, formato y ventana de casillas.
+    ///@param traffic_file Ruta del mapa de tráfico. Vacío para omitirlo.
+    ///@param flow_file Ruta del mapa de flujo. Vacío para omitirlo.
+    HistoryRenderer(const CellularAutomata &ca, const std::string &traffic_file, const std::string &flow_file);
+    ~HistoryRenderer();
+
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size);
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size);
+
+    uint64_t Rows() const noexcept;         ///< Devuelve filas de tráfico dibujadas.
+    void Close();                           ///< Corrige los encabezados y cierra los archivos.
+};
+
 /**
  * @class CellularAutomata
  * @brief Clase base para autómata celular.
@@ -66,12 +252,104 @@ protected:
     CaVelocity m_vmax;           ///< Valor máximo de la velocidad.
     CaVelocity m_init_vel;       ///< Velocidad inicial de los autos.
     CaSize m_size;               ///< Tamaño del autómata celular
+    CaSize m_cars;               ///< Autos en el AC. Se actualiza al agregar o quitar autos para no contarlos en cada paso.
     std::vector<CaVelocity> m_ca;       ///< Automata celular. -1 para casillas sin auto, y valores >= 0 indican velocidad del auto en esa casilla.
     std::vector<CaVelocity> m_ca_temp;
     std::vector<CaFlow> m_ca_flow_temp;                         ///< Variable temporal para operaciones con AC.
-    std::vector< std::vector<CaVelocity> > m_ca_history;
-    std::vector< std::vector<CaFlow> > m_ca_flow_history;       ///< Lista con valores históricos de AC.
+    HISTORY_MODE m_history_mode;                                ///< Forma de guardar el histórico.
+    std::string m_history_path;                                 ///< Ruta base de los archivos de histórico en HISTORY_DISK.
+    std::unique_ptr< HistoryStore<CaVelocity> > m_ca_history;   ///< Valores históricos de AC.
+    std::unique_ptr< HistoryStore<CaFlow> > m_ca_flow_history;  ///< Valores históricos de flujo.
+    CaStep m_step;                                              ///< Pasos aplicados desde la creación del AC.
+    CaSize m_record_first;                                      ///< Primera casilla guardada en el histórico.
+    CaSize m_record_cells;                                      ///< Casillas guardadas en el histórico.
+    CaStep m_record_start;                                      ///< Primer paso guardado en el histórico.
+    CaStep m_record_stride;                                     ///< Pasos entre filas guardadas.
+    std::size_t m_record_reservoir;                             ///< Filas del muestreo de reservorio. 0 lo desactiva.
+    uint64_t m_record_seen;                                     ///< Pasos candidatos vistos por el reservorio.
+    int64_t m_record_slot;                                      ///< Acción del paso actual: -1 omitir, -2 añadir, >= 0 reemplazar fila.
+    std::vector<CaStep> m_record_steps;                         ///< Paso de cada fila guardada por el reservorio.
+    bool m_record_unsorted;                                     ///< El reservorio reemplazó filas y no está en orden temporal.
+    Xoshiro256ss m_reservoir_rng;                               ///< Generador propio del reservorio.
     std::vector<bool> m_rand_values;                            ///< Lista con valores aleatorios para usar en modo de prueba.
+    std::size_t m_rand_cursor;                                  ///< Siguiente valor de m_rand_values a usar.
+    BernoulliMask m_rand_mask;                                  ///< Decisiones de descenso de velocidad del paso actual.
+    std::unique_ptr<RandomTraceWriter> m_trace_writer;          ///< Traza donde se graban las decisiones aleatorias.
+    std::unique_ptr<RandomTraceReader> m_trace_reader;          ///< Traza de donde se leen las decisiones aleatorias.
+    CaStep m_keyframe_interval;                                 ///< Pasos entre keyframes. 0 los desactiva.
+    std::vector<CaState> m_keyframes;                           ///< Estados guardados cada m_keyframe_interval pasos.
+    std::string m_checkpoint_file;                              ///< Ruta de los checkpoints periódicos.
+    CaStep m_checkpoint_interval;                               ///< Pasos entre checkpoints. 0 los desactiva.
+    bool m_checkpoint_compress;                                 ///< Comprime los checkpoints periódicos.
+    CaStep m_measure_start;                                     ///< Paso en que empezó la evolución medida. Se guarda en los checkpoints.
+    StepObserver* m_observer;                                   ///< Observador de cada paso. nullptr si no hay.
+    BMP_FORMAT m_image_format;                                  ///< Formato de pixel de los mapas BMP.
+    uint64_t m_history_version;                                 ///< Cambia con cada fila agregada o borrada del histórico.
+    mutable HistoryStatistics m_stats;                          ///< Resultado de la última pasada de CalculateStatistics.
+    mutable uint64_t m_stats_version;                           ///< m_history_version de m_stats, o HISTORY_STATS_NONE.
+
+    ///@brief Copia el estado y la configuración de otro AC con un histórico vacío, sin trazas ni keyframes.
+    CellularAutomata(const CellularAutomata &other);
+
+    ///@brief Sumas parciales por casilla de un bloque de filas del histórico.
+    struct HistorySums
+    {
+        std::vector<uint64_t> ocupancy, velocity, flow;
+    };
+
+    ///@brief Suma las filas [first, last) de velocidades y [first, flow_last) de flujo.
+    void AccumulateStatistics(const std::size_t first, const std::size_t last, const std::size_t flow_last,
+                              HistorySums &sums) const;
+
+    ///@brief Escribe los mapas BMP de tráfico y de flujo. Un nombre vacío omite ese mapa.
+    void RenderHistory(const std::string &traffic_file, const std::string &flow_file) const;
+
+    ///@brief Guarda un checkpoint si el paso actual es múltiplo del intervalo de checkpoints.
+    void CheckpointIfDue() noexcept;
+
+    ///@brief Coloca vehicles autos con velocidad inicial en el AC vacío. La selección al azar usa el algoritmo
+    ///de Floyd con el propio AC como conjunto de casillas elegidas, así que cuesta O(vehicles) sin memoria extra.
+    ///Los AC grandes se dividen en bloques con cantidades de autos hipergeométricas que se llenan en paralelo.
+    void PlaceCars(const unsigned vehicles, const INITIAL_CONDITION init);
+
+    ///@brief Asigna la clase de cada auto desde un arreglo con una clase por casilla (ver LoadLattice).
+    ///@param classes Arreglo de clases o nullptr si todos los autos son normales. Los AC sin clases de autos lo ignoran.
+    virtual void SetCarClasses(const NpyReader* classes);
+
+    ///@brief Se llama cuando SetCarCount agrega un auto.
+    ///@param position Casilla del auto nuevo.
+    ///@param cars Cantidad de autos contando el nuevo.
+    virtual void OnCarAdded(const CaPosition position, const unsigned cars);
+    ///@brief Se llama una vez cuando SetCarCount quita autos.
+    ///@param positions Casillas de los autos quitados, en orden creciente.
+    virtual void OnCarsRemoved(const std::vector<CaPosition> &positions);
+
+    ///@brief Guarda el estado actual como keyframe.
+    void RecordKeyframe();
+
+    ///@brief Regenera una ventana en el hilo actual. Devuelve nullptr si no hay keyframe anterior a first.
+    std::unique_ptr<CellularAutomata> RegenerateWindow(const CaStep first, const CaStep count) const;
+
+    ///@brief Crea los históricos vacíos según m_history_mode.
+    void CreateHistory();
+
+    ///@brief Reserva memoria del histórico para iter pasos más.
+    void ReserveHistory(const unsigned iter);
+
+    ///@brief Guarda la fila de velocidades del paso actual si corresponde según las opciones de grabación.
+    void RecordHistory();
+
+    ///@brief Guarda la fila de flujo del paso actual si se guardó su fila de velocidades.
+    void RecordFlowHistory();
+
+    ///@brief Genera en bloque las decisiones de descenso de velocidad para todos los autos del paso.
+    void PrepareRandomization() noexcept;
+
+    ///@brief Inicia un paso: guarda un keyframe si corresponde y prepara las decisiones aleatorias.
+    void BeginStep() noexcept;
+
+    ///@brief Devuelve la siguiente decisión de descenso de velocidad del paso actual.
+    bool NextRandomization() noexcept;
 
 public:
     ///@brief Constructor.
@@ -79,7 +357,9 @@ public:
     ///@param density Densidad de autos.
     ///@param vmax Velocidad máxima de los autos.
     ///@param rand_prob Probabilidad de descenso de velocidad.
-    CellularAutomata(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel);
+    ///@param init Disposición inicial de los autos.
+    CellularAutomata(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
+                     const INITIAL_CONDITION init = INIT_RANDOM);
 
     ///@brief Constructor.
     ///@param ca Lista con valores de AC.
@@ -89,6 +369,47 @@ public:
 
     virtual ~CellularAutomata();
 
+    ///@brief Devuelve una copia del AC con histórico vacío. La copia debe liberarse con delete.
+    virtual CellularAutomata* Clone() const = 0;
+
+    ///@brief Devuelve el estado actual del AC, incluyendo el del generador de aleatorios del hilo actual.
+    virtual CaState GetState() const;
+
+    ///@brief Restaura un estado devuelto por GetState. También restaura el generador del hilo actual.
+    virtual void SetState(const CaState &state);
+
+    virtual CA_TYPE GetType() const noexcept = 0;   ///< Devuelve la clase del AC.
+
+    ///@brief Llena tipo, parámetros y estado del checkpoint.
+    virtual void FillCheckpoint(Checkpoint &checkpoint) const;
+
+    ///@brief Guarda tipo, parámetros y estado en un checkpoint (ver Checkpoint).
+    ///@param filepath Ruta del archivo.
+    ///@param compress Comprime el checkpoint.
+    ///@param exported Filas ya exportadas con ExportHistoryNpy, para recortar los npy al continuar.
+    ///@return Verdadero si se escribió completo.
+    bool SaveCheckpoint(const std::string &filepath, const bool compress = false,
+                        const ExportedRows &exported = ExportedRows()) const;
+
+    ///@brief Construye un AC desde un checkpoint. Su evolución continúa idéntica a la del AC guardado.
+    ///El histórico, las opciones de grabación y los observadores no se guardan y deben configurarse de nuevo.
+    static std::unique_ptr<CellularAutomata> FromCheckpoint(const Checkpoint &checkpoint);
+
+    ///@brief Lee un checkpoint y construye el AC. Devuelve nullptr si el archivo no es válido.
+    ///@param filepath Ruta del archivo.
+    ///@param exported Si no es nullptr recibe las filas exportadas guardadas en el checkpoint.
+    static std::unique_ptr<CellularAutomata> LoadCheckpoint(const std::string &filepath, ExportedRows* exported = nullptr);
+
+    ///@brief Guarda un checkpoint cada interval pasos durante Evolve. El archivo se reemplaza cada vez.
+    ///@param filepath Ruta del archivo.
+    ///@param interval Pasos entre checkpoints. 0 los desactiva.
+    ///@param compress Comprime los checkpoints.
+    void SetCheckpointing(const std::string &filepath, const CaStep interval, const bool compress = false);
+    ///@brief Marca el paso en que empieza la evolución medida, por ejemplo al terminar el transitorio. Se guarda
+    ///en los checkpoints para saber cuántos pasos medidos faltan al continuar.
+    void SetMeasureStart(const CaStep step) noexcept;
+    CaStep GetMeasureStart() const noexcept;          ///< Devuelve el paso en que empezó la evolución medida.
+
     ///@brief Dibuja mapa histórico del AC en formato BMP.
 	///@param path Ruta del archivo.
 	///@param out_file_name Nombre del archivo de salida.
@@ -99,10 +420,52 @@ public:
 	///@param out_file_name Nombre del archivo de salida.
 	virtual void DrawFlowHistory(std::string path = "", std::string out_file_name = "") const;
 
+	///@brief Dibuja los mapas de tráfico y de flujo en una sola pasada por el histórico.
+	///@param path Ruta de los archivos.
+	///@param traffic_file_name Nombre del mapa de tráfico. Por defecto ca.bmp.
+	///@param flow_file_name Nombre del mapa de flujo. Por defecto ca_flow.bmp.
+	void DrawHistories(std::string path = "", std::string traffic_file_name = "", std::string flow_file_name = "") const;
+
+	///@brief Llena las tablas de colores de velocidades (índice v + 1) y de flujo (índice f como unsigned char).
+	///@return Velocidad máxima con color propio.
+	CaVelocity ColorTables(std::vector<BMPPixel> &vel_lut, std::vector<BMPPixel> &flow_lut) const;
+
+	///@brief Dibuja los mapas de tráfico y de flujo como pirámides Deep Zoom de teselas (ver TilePyramid).
+	///Sirve para historias que exceden el límite de 4 GiB de un BMP. Los niveles reducidos muestran la media de
+	///cada bloque de celdas.
+	///@param path Ruta de los archivos.
+	///@param traffic_name Nombre base del mapa de tráfico. Por defecto ca (ca.dzi y ca_files).
+	///@param flow_name Nombre base del mapa de flujo. Por defecto ca_flow.
+	///@param tile_size Lado de las teselas en pixeles.
+	///@param draw_traffic Dibujar el mapa de tráfico.
+	///@param draw_flow Dibujar el mapa de flujo.
+	void DrawHistoryTiles(std::string path = "", std::string traffic_name = "", std::string flow_name = "",
+	                      const unsigned tile_size = 256, const bool draw_traffic = true, const bool draw_flow = true) const;
+
+	///@brief Cambia el formato de pixel de los mapas BMP. Con paleta cada velocidad es un índice; si los
+	///colores no caben en 4 bits se usan 8. Los formatos RLE reducen mucho los mapas con tráfico disperso.
+	void SetImageFormat(const BMP_FORMAT format) noexcept;
+	BMP_FORMAT GetImageFormat() const noexcept;       ///< Devuelve el formato de pixel de los mapas BMP.
+
     ///@brief Evoluciona (itera) el AC.
     ///@param iter Número de iteraciones.
     virtual void Evolve(const unsigned iter) noexcept;
 
+    ///@brief Evoluciona el AC llamando a observer.OnVelocities y observer.OnFlow en cada paso.
+    ///@param iter Número de iteraciones.
+    ///@param observer Objeto de cualquier clase con los métodos de StepObserver.
+    template <class Observer> void Evolve(const unsigned iter, Observer &observer)
+    {
+        StepObserverAdapter<Observer> adapter(observer);
+        StepObserver* previous = m_observer;
+        m_observer = &adapter;
+        Evolve(iter);
+        m_observer = previous;
+    }
+
+    ///@brief Cambia el observador de cada paso. nullptr lo desactiva. El AC no toma posesión del observador.
+    void SetObserver(StepObserver* observer) noexcept;
+
     ///@brief Devuelve la distancia al auto más próximo desde la posición pos.
     ///@param pos Posición desde dónde iniciar la búsqueda.
     CaSize NextCarDist(const CaPosition pos) const noexcept;
@@ -111,6 +474,18 @@ public:
     ///@param prob Probabilidad de obtener valor verdadero. Por defecto se utiliza m_rand_prob.
     bool Randomization(const double prob = -1.0) noexcept;
 
+    ///@brief Graba en un archivo todas las decisiones aleatorias de la evolución a partir de ahora.
+    ///@param filepath Ruta del archivo de traza.
+    void RecordRandomness(const std::string &filepath);
+
+    ///@brief Toma las decisiones aleatorias de una traza grabada con RecordRandomness.
+    ///El estado inicial debe coincidir con el de la ejecución grabada (por ejemplo, misma semilla).
+    ///@param filepath Ruta del archivo de traza.
+    void ReplayRandomness(const std::string &filepath);
+
+    ///@brief Cierra las trazas de grabación y reproducción abiertas.
+    void StopTrace();
+
     ///@brief Devuelve referencia a elemento del AC considerando las condiciones de frontera.
     ///@param i Posición dentro del AC.
     virtual CaVelocity &At(const CaPosition i) noexcept = 0;
@@ -118,9 +493,89 @@ public:
     virtual CaFlow &AtFlowTemp(const CaPosition i) noexcept = 0;
     virtual CaVelocity GetAt(const CaPosition i) const noexcept = 0;
 
+    ///@brief Devuelve verdadero si las condiciones de frontera son periódicas.
+    virtual bool IsPeriodic() const noexcept = 0;
+
     std::vector<CaVelocity> GetCa();
     std::vector< std::vector<CaVelocity> > GetCaHistory();
+
+    ///@brief Copia count filas del histórico de velocidades a partir de first en out (count*GetHistoryWidth() elementos).
+    void ReadHistoryRows(const std::size_t first, const std::size_t count, CaVelocity* out) const;
+
+    ///@brief Borra las filas del histórico sin cambiar su configuración.
+    void ClearHistory();
+
+    ///@brief Escribe el histórico en archivos .npy: filepath_ca.npy (int32, pasos x casillas),
+    ///filepath_flow.npy (int8, pasos x casillas) y filepath_obs.npy (float64, pasos x 4) con el paso,
+    ///la cantidad de autos, la velocidad media y el flujo (suma de velocidades por casilla) de cada fila.
+    ///@param filepath Ruta base de los archivos.
+    ///@param append Agrega las filas al final de archivos existentes. Permite exportar por bloques
+    ///              llamando a ClearHistory() después de cada exportación.
+    ///@return Filas en los archivos después de exportar.
+    ExportedRows ExportHistoryNpy(const std::string &filepath, const bool append = false) const;
+
+    ///@brief Recorta los archivos de ExportHistoryNpy a las filas indicadas, por ejemplo las que había al guardar
+    ///el checkpoint desde el que se continúa. Las filas sobrantes se sobrescriben al volver a agregar.
+    ///@param filepath Ruta base de los archivos.
+    ///@param rows Filas a conservar. No hace nada si no se conocen.
+    void TruncateHistoryNpy(const std::string &filepath, const ExportedRows &rows) const;
+
+    ///@brief Cambia la forma de guardar el histórico. Borra el histórico existente.
+    ///@param mode HISTORY_PLAIN, HISTORY_PACKED, HISTORY_EVENTS, HISTORY_DISK o HISTORY_NONE.
+    ///@param filepath Ruta base de los archivos en HISTORY_DISK. Se crean filepath.ca y filepath.flow.
+    void SetHistoryMode(const HISTORY_MODE mode, const std::string &filepath = "ca_history");
+    HISTORY_MODE GetHistoryMode() const noexcept;     ///< Devuelve la forma de guardar el histórico.
+
+    ///@brief Cambia qué partes de la evolución se guardan en el histórico. Borra el histórico existente.
+    ///@param first_cell Primera casilla guardada.
+    ///@param cells Casillas guardadas a partir de first_cell. 0 guarda hasta el final del AC.
+    ///@param start Primer paso guardado.
+    ///@param stride Se guarda un paso de cada stride.
+    ///@param reservoir Si es mayor que 0 se guardan solo reservoir pasos elegidos al azar de manera uniforme
+    ///                 entre los candidatos (requiere HISTORY_PLAIN).
+    ///@param seed Semilla del generador del reservorio, independiente de RandomGen.
+    void SetHistoryRecording(const CaSize first_cell = 0, const CaSize cells = 0, const CaStep start = 0,
+                             const CaStep stride = 1, const std::size_t reservoir = 0, const uint64_t seed = 0);
+
+    ///@brief Pone en orden temporal las filas que el reservorio reemplazó en su lugar. Evolve lo llama al terminar;
+    ///quien llame Step() directamente debe llamarlo antes de leer el histórico.
+    void SortReservoir();
+    ///@brief Devuelve el paso de cada fila del histórico de velocidades.
+    std::vector<CaStep> GetHistorySteps() const;
+    CaSize GetHistoryFirstCell() const noexcept;      ///< Devuelve la primera casilla guardada en el histórico.
+    CaSize GetHistoryWidth() const noexcept;          ///< Devuelve casillas por fila del histórico.
+    CaStep GetStep() const noexcept;                  ///< Devuelve pasos aplicados desde la creación del AC.
+
+    ///@brief Guarda el estado completo cada interval pasos, empezando por el actual. 0 desactiva y borra los keyframes.
+    ///Con keyframes se puede regenerar cualquier ventana de tiempo sin guardar el histórico completo.
+    ///No sirven con RandomAlgorithm LCG, cuyo estado no es accesible, ni con trazas de aleatorios.
+    void SetKeyframeInterval(const CaStep interval);
+    CaStep GetKeyframeInterval() const noexcept;      ///< Devuelve pasos entre keyframes.
+    std::size_t GetKeyframeCount() const noexcept;    ///< Devuelve cantidad de keyframes guardados.
+
+    ///@brief Vuelve a simular desde el keyframe más cercano y devuelve una copia del AC cuyo histórico contiene
+    ///los pasos [first, first + count), con la ventana de casillas y el salto entre pasos de este AC.
+    ///@return Copia del AC o nullptr si no hay keyframe anterior a first.
+    std::unique_ptr<CellularAutomata> Regenerate(const CaStep first, const CaStep count) const;
+
+    ///@brief Regenera varias ventanas (primer paso, cantidad de pasos) en paralelo.
+    ///@param threads Hilos a usar. 0 usa todos los disponibles.
+    std::vector< std::unique_ptr<CellularAutomata> > Regenerate(const std::vector< std::pair<CaStep, CaStep> > &windows,
+                                                                 unsigned threads = 0) const;
+
+    ///@brief Devuelve las filas del histórico de velocidades de los pasos [first, first + count) regeneradas.
+    std::vector< std::vector<CaVelocity> > GetHistoryRange(const CaStep first, const CaStep count) const;
+    std::size_t GetHistoryMemory() const noexcept;    ///< Devuelve memoria reservada por el histórico en bytes.
+
+    ///@brief Devuelve la velocidad máxima que puede aparecer en el AC. Se usa para codificar el histórico.
+    virtual CaVelocity MaxVelocity() const noexcept;
     
+    ///@brief Calcula ocupación, flujo y velocidad media por casilla en una pasada por filas.
+    ///Las filas se reparten en bloques contiguos entre hilos que suman por separado. El resultado se guarda hasta
+    ///que cambie el histórico, así que CalculateOcupancy, CalculateFlow y CalculateMeanFlow seguidos hacen una pasada.
+    ///@param threads Hilos a usar. 0 usa todos los disponibles.
+    HistoryStatistics CalculateStatistics(unsigned threads = 0) const noexcept;
+
     virtual std::vector<double> CalculateOcupancy() const noexcept;
     virtual std::vector<double> CalculateFlow() const noexcept;
     virtual double CalculateMeanFlow() const noexcept;
@@ -128,6 +583,23 @@ public:
     CaSize GetSize() const noexcept;             ///< Devuelve tamaño del AC.
     CaSize GetHistorySize() const noexcept;      ///< Devuelve tamaño de la lista histórica de evolución del AC.
     unsigned CountCars() const noexcept;           ///< Cuenta la cantidad de autos en AC.
+
+    ///@brief Cambia la cantidad de autos partiendo del estado actual, para continuar un barrido de densidad
+    ///sin empezar de un estado aleatorio. Agrega autos con la velocidad inicial en casillas vacías elegidas
+    ///al azar o quita autos elegidos al azar; el resto de la pista no cambia.
+    void SetCarCount(const unsigned cars);
+
+    ///@brief Cambia la cantidad de autos a size*density, como en el constructor (ver SetCarCount).
+    void SetDensity(const double density);
+
+    ///@brief Reemplaza la pista por un arreglo .npy de velocidades, con -1 en las casillas vacías, leído de un
+    ///archivo proyectado en memoria (ver NpyReader). De un arreglo de dos dimensiones, como el histórico
+    ///exportado con ExportHistoryNpy, se usa la última fila. La pista no cambia si el archivo es inválido.
+    ///@param filepath Ruta del arreglo de velocidades. Debe tener tantas casillas como el AC.
+    ///@param classes_filepath Ruta opcional de un arreglo con la clase de cada casilla: 0 para autos normales
+    ///y otro valor para autónomos. Sin él todos los autos son normales.
+    ///@return Verdadero si se cargó.
+    bool LoadLattice(const std::string &filepath, const std::string &classes_filepath = "");
     virtual void Step() noexcept;            ///< Aplica reglas de evolución temporal del AC.
     virtual void Move() noexcept;            ///< Mueve los autos según las condiciones de frontera especificadas en clase hija.
     void AssignChanges() noexcept;           ///< Asigna cambios de los arrays teporales al array m_ca e historico.
@@ -152,7 +624,9 @@ public:
     ///@param density Densidad de autos.
     ///@param vmax Velocidad máxima de los autos.
     ///@param rand_prob Probabilidad de descenso de velocidad.
-    CircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel);
+    ///@param init Disposición inicial de los autos.
+    CircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
+               const INITIAL_CONDITION init = INIT_RANDOM);
 
     ///@brief Constructor.
     ///@param ca Lista con valores de AC.
@@ -161,16 +635,21 @@ public:
     ///@param vmax Velocidad máxima de los autos.
     CircularCA(const std::vector<int> &ca, const std::vector<bool> &rand_values, const CaVelocity vmax);
 
+    CellularAutomata* Clone() const;
+    CA_TYPE GetType() const noexcept;
+
     ///@brief Devuelve elemento de valores del autómata celular considerando las condiciones de frontera.
     ///@param i Posición dentro del AC.
     CaVelocity &At(const CaPosition i) noexcept;
     CaVelocity &AtTemp(const CaPosition i) noexcept;
     CaFlow &AtFlowTemp(const CaPosition i) noexcept;
     CaVelocity GetAt(const CaPosition i) const noexcept;
+    bool IsPeriodic() const noexcept;
 
     ///@brief Evoluciona (itera) el AC. Verifica si se conserva la cantidad de autos.
     ///@param iter Número de iteraciones.
     void Evolve(const unsigned iter) noexcept;
+    using CellularAutomata::Evolve;
 };
 
 
@@ -199,8 +678,9 @@ public:
     ///@param rand_prob Probabilidad de descenso de velocidad.
     ///@param new_car_prob Probabilidad de que aparezca un nuevo auto en la posición 0 del AC en la siguiente iteración.
     ///@param new_car_speed Velocidad de nuevo auto cuando ingresa a la pista.
+    ///@param init Disposición inicial de los autos.
     OpenCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob, const CaVelocity init_vel,
-           const double new_car_prob, const CaVelocity new_car_speed);
+           const double new_car_prob, const CaVelocity new_car_speed, const INITIAL_CONDITION init = INIT_RANDOM);
 
     ///@brief Constructor.
     ///@param ca Lista con valores de AC.
@@ -210,14 +690,23 @@ public:
     ///@param new_car_speed Velocidad de nuevo auto cuando ingresa a la pista.
     OpenCA(const std::vector<int> &ca, const std::vector<bool> &rand_values, const CaVelocity vmax, const CaVelocity new_car_speed);
 
+    CellularAutomata* Clone() const;
+    CA_TYPE GetType() const noexcept;
+    void FillCheckpoint(Checkpoint &checkpoint) const;   ///< Incluye los parámetros de entrada de autos.
+
     ///@brief Devuelve elemento de valores del autómata celular considerando las condiciones de frontera.
     ///@param i Posición dentro del AC.
     CaVelocity &At(const CaPosition i) noexcept;
     CaVelocity &AtTemp(const CaPosition i) noexcept;
     CaFlow &AtFlowTemp(const CaPosition i) noexcept;
     CaVelocity GetAt(const CaPosition i) const noexcept;
+    bool IsPeriodic() const noexcept;
 
     void Step() noexcept;    ///< Aplica reglas de evolución temporal del AC.
+    CaVelocity MaxVelocity() const noexcept;
+protected:
+    ///@brief Cuenta los autos que salen de la pista al moverse. Solo revisa las últimas MaxVelocity() casillas.
+    CaSize CarsLeaving() const noexcept;
 };
 
 
@@ -242,8 +731,17 @@ public:
     ///@param vmax Velocidad máxima de los autos.
     ///@param rand_prob Probabilidad de descenso de velocidad.
     ///@param aut_density Densidad de autos autónomos respecto a número total de autos.
+    ///@param init Disposición inicial de los autos.
     AutonomousCircularCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob,
-                 const CaVelocity init_vel, const double aut_density);
+                 const CaVelocity init_vel, const double aut_density, const INITIAL_CONDITION init = INIT_RANDOM);
+
+    CellularAutomata* Clone() const;
+    CA_TYPE GetType() const noexcept;
+    CaState GetState() const;                       ///< Incluye las posiciones de los autos autónomos.
+    void SetState(const CaState &state);
+    void OnCarAdded(const CaPosition position, const unsigned cars);    ///< Conserva la fracción de autos autónomos.
+    void OnCarsRemoved(const std::vector<CaPosition> &positions);        ///< Quita los autos de la lista de autónomos.
+    void SetCarClasses(const NpyReader* classes);   ///< Los autos con clase distinta de 0 son autónomos.
 
     void Move() noexcept;    ///< Mueve los autos con condiciones de frontera periódicas.
     virtual void Step() noexcept;    ///< Aplica reglas de evolución temporal del AC para autos normales e inteligentes.
@@ -267,8 +765,18 @@ public:
     ///@param aut_density Densidad de autos autónomos respecto a número total de autos.
     ///@param new_car_prob Probabilidad de que aparezca un nuevo auto en la posición 0 del AC en la siguiente iteración.
     ///@param new_car_speed Velocidad de nuevo auto cuando ingresa a la pista.
+    ///@param init Disposición inicial de los autos.
     AutonomousOpenCA(const CaSize size, const double density, const CaVelocity vmax, const double rand_prob,
-                 const CaVelocity init_vel, const double aut_density, const double new_car_prob, const CaVelocity new_car_speed);
+                 const CaVelocity init_vel, const double aut_density, const double new_car_prob, const CaVelocity new_car_speed,
+                 const INITIAL_CONDITION init = INIT_RANDOM);
+
+    CellularAutomata* Clone() const;
+    CA_TYPE GetType() const noexcept;
+    CaState GetState() const;                       ///< Incluye las posiciones de los autos autónomos.
+    void SetState(const CaState &state);
+    void OnCarAdded(const CaPosition position, const unsigned cars);    ///< Conserva la fracción de autos autónomos.
+    void OnCarsRemoved(const std::vector<CaPosition> &positions);        ///< Quita los autos de la lista de autónomos.
+    void SetCarClasses(const NpyReader* classes);   ///< Los autos con clase distinta de 0 son autónomos.
 
 
     void Move() noexcept;    ///< Mueve los autos con condiciones de frontera periódicas.
@@ -0,0 +1,272 @@
+#include "Checkpoint.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+using namespace std;
+
+namespace
+{
+    const char CHECKPOINT_ID[4] = { 'F', 'W', 'C', 'K' };
+    const uint32_t CHECKPOINT_VERSION = 3;
+    const uint32_t CHECKPOINT_COMPRESSED = 1;
+
+    // Escritura y lectura de valores en un búfer de bytes.
+    template <class T> void put(vector<char> &out, const T value)
+    {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+    template <class T> bool get(const vector<char> &in, size_t &pos, T &value)
+    {
+        if (pos + sizeof(T) > in.size())
+            return false;
+        memcpy(&value, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    uint64_t fnv1a(const vector<char> &data)
+    {
+        return aux_fnv1a(data.data(), data.size());
+    }
+
+    // Compresión por carreras (PackBits): un byte de control n < 128 precede n + 1 bytes literales y
+    // n > 128 repite el byte siguiente 257 - n veces.
+    vector<char> pack(const vector<char> &in)
+    {
+        vector<char> out;
+        size_t i = 0;
+        while (i < in.size())
+        {
+            size_t run = 1;
+            while (i + run < in.size() && run < 128 && in[i + run] == in[i])
+                ++run;
+            if (run >= 2)
+            {
+                out.push_back((char)(257 - run));
+                out.push_back(in[i]);
+                i += run;
+                continue;
+            }
+
+            size_t literal = 1;
+            while (i + literal < in.size() && literal < 128 &&
+                   !(i + literal + 1 < in.size() && in[i + literal] == in[i + literal + 1]))
+                ++literal;
+            out.push_back((char)(literal - 1));
+            out.insert(out.end(), in.begin() + i, in.begin() + i + literal);
+            i += literal;
+        }
+        return out;
+    }
+    bool unpack(const vector<char> &in, const size_t size, vector<char> &out)
+    {
+        out.clear();
+        out.reserve(size);
+        size_t i = 0;
+        while (i < in.size() && out.size() < size)
+        {
+            const unsigned n = (unsigned char)in[i++];
+            if (n < 128)
+            {
+                if (i + n + 1 > in.size())
+                    return false;
+                out.insert(out.end(), in.begin() + i, in.begin() + i + n + 1);
+                i += n + 1;
+            }
+            else if (n > 128)
+            {
+                if (i >= in.size())
+                    return false;
+                out.insert(out.end(), 257 - n, in[i++]);
+            }
+        }
+        return out.size() == size;
+    }
+}
+
+Checkpoint::Checkpoint()
+{
+    type = CIRCULAR_CA;
+    vmax = 0;
+    init_vel = 0;
+    rand_prob = 0;
+    new_car_prob = 0;
+    new_car_speed = 0;
+    state.step = 0;
+    state.rand_cursor = 0;
+    measure_start = 0;
+}
+bool Checkpoint::Write(const string &filepath, const bool compress) const
+{
+    // Contenido.
+    vector<char> data;
+    put<int32_t>(data, type);
+    put<int32_t>(data, vmax);
+    put<int32_t>(data, init_vel);
+    put<double>(data, rand_prob);
+    put<double>(data, new_car_prob);
+    put<int32_t>(data, new_car_speed);
+    put<uint64_t>(data, state.step);
+    put<uint64_t>(data, state.rand_cursor);
+
+    const bool narrow = all_of(state.ca.begin(), state.ca.end(), [](CaVelocity v) { return v >= -128 && v <= 127; });
+    put<uint64_t>(data, state.ca.size());
+    put<uint8_t>(data, narrow ? 1 : 4);
+    for (size_t i = 0; i < state.ca.size(); ++i)
+    {
+        if (narrow)
+            put<int8_t>(data, (int8_t)state.ca[i]);
+        else
+            put<int32_t>(data, state.ca[i]);
+    }
+    put<uint64_t>(data, state.extra.size());
+    for (size_t i = 0; i < state.extra.size(); ++i)
+        put<int32_t>(data, state.extra[i]);
+    put<uint64_t>(data, state.rng.size());
+    data.insert(data.end(), state.rng.begin(), state.rng.end());
+    put<uint64_t>(data, exported.velocities);
+    put<uint64_t>(data, exported.flow);
+    put<uint64_t>(data, measure_start);
+
+    const vector<char> stored = compress ? pack(data) : data;
+    const string tmp_path = filepath + ".tmp";
+    {
+        ofstream file(tmp_path.c_str(), ios::out | ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            cout << "Error: No se puede crear archivo de checkpoint." << endl;
+            return false;
+        }
+        file.write(CHECKPOINT_ID, 4);
+        const uint32_t version = CHECKPOINT_VERSION, flags = compress ? CHECKPOINT_COMPRESSED : 0;
+        const uint64_t size = data.size(), stored_size = stored.size(), hash = fnv1a(data);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(&stored_size), sizeof(stored_size));
+        file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        file.write(stored.data(), stored.size());
+        file.flush();
+        if (!file)
+        {
+            cout << "Error: No se pudo escribir el checkpoint." << endl;
+            return false;
+        }
+    }
+
+    // El checkpoint anterior solo se reemplaza cuando el nuevo está completo.
+#if defined(_WIN32)
+    remove(filepath.c_str());
+#endif
+    if (rename(tmp_path.c_str(), filepath.c_str()) != 0)
+    {
+        cout << "Error: No se puede reemplazar el checkpoint." << endl;
+        return false;
+    }
+    return true;
+}
+bool Checkpoint::Read(const string &filepath)
+{
+    ifstream file(filepath.c_str(), ios::in | ios::binary);
+    if (!file.is_open())
+    {
+        cout << "Error: No se puede abrir archivo de checkpoint." << endl;
+        return false;
+    }
+
+    char id[4];
+    uint32_t version = 0, flags = 0;
+    uint64_t size = 0, stored_size = 0, hash = 0;
+    file.read(id, 4);
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&flags), sizeof(flags));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    file.read(reinterpret_cast<char*>(&stored_size), sizeof(stored_size));
+    file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    if (!file || !equal(id, id + 4, CHECKPOINT_ID) || version < 1 || version > CHECKPOINT_VERSION)
+    {
+        cout << "Error: Archivo de checkpoint invalido." << endl;
+        return false;
+    }
+
+    vector<char> stored((size_t)stored_size), data;
+    file.read(stored.data(), stored.size());
+    bool ok = !!file;
+    if (ok && (flags & CHECKPOINT_COMPRESSED))
+        ok = unpack(stored, (size_t)size, data);
+    else
+        data.swap(stored);
+    if (!ok || data.size() != size || fnv1a(data) != hash)
+    {
+        cout << "Error: Checkpoint incompleto o dañado." << endl;
+        return false;
+    }
+
+    size_t pos = 0;
+    int32_t ca_type = 0, vmax32 = 0, init_vel32 = 0, speed32 = 0;
+    uint64_t step = 0, cursor = 0, cells = 0, extra_size = 0, rng_size = 0;
+    uint8_t width = 0;
+    ok = get(data, pos, ca_type) && get(data, pos, vmax32) && get(data, pos, init_vel32) && get(data, pos, rand_prob) &&
+         get(data, pos, new_car_prob) && get(data, pos, speed32) && get(data, pos, step) && get(data, pos, cursor) &&
+         get(data, pos, cells) && get(data, pos, width) && (width == 1 || width == 4) &&
+         ca_type >= CIRCULAR_CA && ca_type <= AUTONOMOUS_OPEN_CA;
+    if (ok)
+    {
+        state.ca.resize((size_t)cells);
+        for (size_t i = 0; i < state.ca.size() && ok; ++i)
+        {
+            if (width == 1)
+            {
+                int8_t v = 0;
+                ok = get(data, pos, v);
+                state.ca[i] = v;
+            }
+            else
+            {
+                int32_t v = 0;
+                ok = get(data, pos, v);
+                state.ca[i] = v;
+            }
+        }
+    }
+    ok = ok && get(data, pos, extra_size);
+    if (ok)
+    {
+        state.extra.resize((size_t)extra_size);
+        for (size_t i = 0; i < state.extra.size() && ok; ++i)
+        {
+            int32_t v = 0;
+            ok = get(data, pos, v);
+            state.extra[i] = v;
+        }
+    }
+    ok = ok && get(data, pos, rng_size) && pos + rng_size <= data.size();
+    if (ok)
+    {
+        state.rng.assign(data.begin() + pos, data.begin() + pos + (size_t)rng_size);
+        pos += (size_t)rng_size;
+    }
+    exported = ExportedRows();
+    if (ok && version >= 2)
+        ok = get(data, pos, exported.velocities) && get(data, pos, exported.flow);
+    measure_start = 0;
+    if (ok && version >= 3)
+        ok = get(data, pos, measure_start);
+    if (!ok)
+    {
+        cout << "Error: Checkpoint incompleto o dañado." << endl;
+        return false;
+    }
+
+    type = (CA_TYPE)ca_type;
+    vmax = vmax32;
+    init_vel = init_vel32;
+    new_car_speed = speed32;
+    state.step = step;
+    state.rand_cursor = (size_t)cursor;
+    return true;
+}
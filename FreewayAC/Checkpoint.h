@@ -0,0 +1,50 @@
+/**
+* @file Checkpoint.h
+* @brief Checkpoints binarios para continuar simulaciones interrumpidas.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _CHECKPOINT
+#define _CHECKPOINT
+
+#include <string>
+#include "CellularAutomata.h"
+
+/**
+* @struct Checkpoint
+* @brief Tipo, parámetros y estado de un AC. Basta para construirlo de nuevo y continuar su evolución
+* de manera idéntica (ver CellularAutomata::FromCheckpoint).
+*
+* Formato: identificador "FWCK", versión, opciones, largo del contenido, largo guardado, suma FNV-1a de 64 bits
+* del contenido y el contenido, opcionalmente comprimido por carreras. Desde la versión 2 el contenido termina con
+* las filas exportadas y desde la versión 3 con el paso en que empezó la evolución medida; se siguen leyendo
+* checkpoints de versiones anteriores. Las velocidades se guardan en un byte si caben. El archivo se escribe en
+* path.tmp y se renombra al terminar, de modo que una interrupción durante la escritura no daña el checkpoint anterior.
+*/
+struct Checkpoint
+{
+    CA_TYPE type;                 ///< Clase del AC.
+    CaVelocity vmax;              ///< Velocidad máxima.
+    CaVelocity init_vel;          ///< Velocidad inicial de los autos.
+    double rand_prob;             ///< Probabilidad de descenso de velocidad.
+    double new_car_prob;          ///< Probabilidad de entrada de autos (AC abiertos).
+    CaVelocity new_car_speed;     ///< Velocidad de entrada de autos (AC abiertos).
+    CaState state;                ///< Estado entre dos pasos, incluyendo el generador de aleatorios.
+    ExportedRows exported;        ///< Filas ya exportadas a npy al guardar. Desconocidas en la versión 1.
+    CaStep measure_start;         ///< Paso en que empezó la evolución medida, tras el transitorio. 0 antes de la versión 3.
+
+    Checkpoint();
+
+    ///@brief Escribe el checkpoint.
+    ///@param filepath Ruta del archivo.
+    ///@param compress Comprime el contenido por carreras.
+    ///@return Verdadero si se escribió completo.
+    bool Write(const std::string &filepath, const bool compress = false) const;
+
+    ///@brief Lee un checkpoint. Rechaza archivos truncados o con suma incorrecta.
+    ///@return Verdadero si se leyó completo.
+    bool Read(const std::string &filepath);
+};
+
+#endif
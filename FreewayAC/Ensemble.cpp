@@ -0,0 +1,146 @@
+#include "Ensemble.h"
+
+#include <iostream>
+#include <memory>
+#include <map>
+#include <set>
+#include <chrono>
+#include <thread>
+#include <atomic>
+using namespace std;
+
+namespace
+{
+    // Guarda el nodo de la memoria de la pista la primera vez que el AC envía una fila.
+    class PlacementProbe : public StepObserver
+    {
+    public:
+        int node;
+
+        PlacementProbe() : node(-1) {}
+        void OnVelocities(const CaStep, const CaVelocity* row, const CaSize size)
+        {
+            if (node == -1 && size != 0)
+                node = aux_memory_node(row);
+        }
+        void OnFlow(const CaStep, const CaFlow*, const CaSize) {}
+    };
+}
+
+ReplicaResult::ReplicaResult()
+{
+    replica = 0;
+    cpu = -1;
+    node = 0;
+    memory_node = -1;
+    cells = 0;
+    rows = 0;
+    mean_ocupancy = 0.0;
+    mean_flow = 0.0;
+    seconds = 0.0;
+}
+
+Ensemble::Ensemble(const unsigned workers, const bool pin)
+{
+    m_pin = pin;
+
+    // Reparte las CPU alternando nodos: primera CPU de cada nodo, luego la segunda, etc.
+    map<int, vector<unsigned>> by_node;
+    const vector<unsigned> cpus = aux_allowed_cpus();
+    for (size_t i = 0; i < cpus.size(); ++i)
+        by_node[aux_cpu_node(cpus[i])].push_back(cpus[i]);
+    vector<unsigned> order;
+    for (size_t k = 0; order.size() < cpus.size(); ++k)
+    {
+        for (map<int, vector<unsigned>>::const_iterator it = by_node.begin(); it != by_node.end(); ++it)
+        {
+            if (k < it->second.size())
+                order.push_back(it->second[k]);
+        }
+    }
+
+    // Dos trabajadores fijos a la misma CPU se turnarían en ella, así que no se crean más que CPU.
+    unsigned count = (workers == 0) ? (unsigned)order.size() : workers;
+    if (m_pin && count > order.size())
+    {
+        cout << "Error: Solo hay " << order.size() << " CPU disponibles. Se usan " << order.size() << " trabajadores." << endl;
+        count = (unsigned)order.size();
+    }
+    for (unsigned w = 0; w < count; ++w)
+        m_cpus.push_back(order[w % order.size()]);
+}
+unsigned Ensemble::Workers() const noexcept
+{
+    return (unsigned)m_cpus.size();
+}
+unsigned Ensemble::Nodes() const
+{
+    set<int> nodes;
+    for (size_t w = 0; w < m_cpus.size(); ++w)
+        nodes.insert(aux_cpu_node(m_cpus[w]));
+    return (unsigned)nodes.size();
+}
+vector<ReplicaResult> Ensemble::Run(const unsigned replicas, const Factory &factory, const unsigned warmup,
+                                    const unsigned iterations) const
+{
+    vector<ReplicaResult> results(replicas);
+    atomic<unsigned> next(0);
+    auto worker = [&](const unsigned w)
+    {
+        if (m_pin && !aux_pin_thread(m_cpus[w]) && w == 0)
+            cout << "Error: No se pudo fijar el hilo a la CPU " << m_cpus[w] << "." << endl;
+
+        for (unsigned r = next++; r < replicas; r = next++)
+        {
+            ReplicaResult &result = results[r];
+            result.replica = r;
+            const auto start = chrono::steady_clock::now();
+
+            // Se crea en este hilo para que sus arreglos queden en el nodo de esta CPU.
+            unique_ptr<CellularAutomata> ca(factory(r));
+            if (!ca)
+                continue;
+            ca->SetHistoryMode(HISTORY_NONE);
+            ca->Evolve(warmup);
+
+            CellStatistics stats;
+            StepObserverAdapter<CellStatistics> stats_observer(stats);
+            PlacementProbe probe;
+            StepObserverList observers;
+            observers.Add(&stats_observer);
+            observers.Add(&probe);
+            ca->SetObserver(&observers);
+            ca->Evolve(iterations);
+            ca->SetObserver(nullptr);
+
+            result.cpu = aux_current_cpu();
+            result.node = (result.cpu >= 0) ? aux_cpu_node((unsigned)result.cpu) : 0;
+            result.memory_node = probe.node;
+            result.cells = ca->GetSize();
+            result.rows = stats.Rows();
+            result.mean_ocupancy = aux_mean(stats.Ocupancy());
+            result.mean_flow = stats.MeanFlow();
+            ca.reset();
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    // Todos los trabajadores son hilos nuevos, así que el hilo que llama no queda fijo a una CPU.
+    vector<thread> pool;
+    for (unsigned w = 0; w < m_cpus.size(); ++w)
+    {
+        try
+        {
+            pool.push_back(thread(worker, w));
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    if (pool.empty())
+        cout << "Error: No se pudieron crear hilos para las replicas." << endl;
+    return results;
+}
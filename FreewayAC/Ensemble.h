@@ -0,0 +1,69 @@
+/**
+* @file Ensemble.h
+* @brief Evolución de muchas réplicas de un AC en hilos fijos a CPU, con la memoria de cada réplica en su nodo NUMA.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _ENSEMBLE
+#define _ENSEMBLE
+
+#include <vector>
+#include <functional>
+#include "CellularAutomata.h"
+
+/**
+* @struct ReplicaResult
+* @brief Estadísticas de una réplica y dónde se ejecutó.
+*/
+struct ReplicaResult
+{
+    unsigned replica;
+    int cpu;                ///< CPU del hilo al terminar, o -1 si no se sabe.
+    int node;               ///< Nodo NUMA de esa CPU.
+    int memory_node;        ///< Nodo NUMA de la pista, o -1 si no se sabe.
+    CaSize cells;           ///< Tamaño del AC, o 0 si no se pudo crear.
+    uint64_t rows;          ///< Pasos medidos.
+    double mean_ocupancy;
+    double mean_flow;
+    double seconds;         ///< Tiempo de creación y evolución.
+
+    ReplicaResult();
+};
+
+/**
+* @class Ensemble
+* @brief Ejecuta réplicas independientes de un AC repartidas entre hilos trabajadores.
+*
+* Cada trabajador se fija a una CPU; las CPU se eligen alternando nodos NUMA, así que con menos trabajadores que
+* CPU se usan todos los nodos. Cada réplica se crea en el hilo que la evoluciona: sus arreglos se escriben por
+* primera vez ahí, de modo que el sistema los ubica en el nodo de esa CPU (política first-touch) y la evolución
+* no cruza la interconexión entre nodos. La réplica se destruye antes de tomar la siguiente.
+*/
+class Ensemble
+{
+    std::vector<unsigned> m_cpus;   ///< CPU de cada trabajador.
+    bool m_pin;
+public:
+    ///@brief Crea una réplica. Se llama en el hilo trabajador, que debe sembrar RandomGen.
+    using Factory = std::function<CellularAutomata*(const unsigned replica)>;
+
+    ///@brief Constructor.
+    ///@param workers Hilos trabajadores. Con 0 se usa uno por CPU disponible. Con pin no se usan más que CPU.
+    ///@param pin Fijar cada trabajador a su CPU.
+    explicit Ensemble(const unsigned workers = 0, const bool pin = true);
+
+    unsigned Workers() const noexcept;          ///< Devuelve cantidad de trabajadores.
+    unsigned Nodes() const;                     ///< Devuelve cantidad de nodos NUMA entre las CPU de los trabajadores.
+
+    ///@brief Evoluciona las réplicas sin histórico.
+    ///@param replicas Cantidad de réplicas.
+    ///@param factory Crea la réplica i.
+    ///@param warmup Pasos de transitorio, sin medir.
+    ///@param iterations Pasos medidos con CellStatistics.
+    ///@return Resultados en orden de réplica.
+    std::vector<ReplicaResult> Run(const unsigned replicas, const Factory &factory, const unsigned warmup,
+                                   const unsigned iterations) const;
+};
+
+#endif
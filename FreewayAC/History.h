@@ -0,0 +1,770 @@
+/**
+* @file History.h
+* @brief Almacenamiento de la evolución histórica del AC.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _HISTORY
+#define _HISTORY
+
+#include <vector>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <mutex>
+#include <iostream>
+
+#include "Auxiliar.h"
+
+/**
+* @enum HISTORY_MODE
+* @brief Formas de guardar el histórico del AC.
+*/
+enum HISTORY_MODE
+{
+    HISTORY_PLAIN,     ///< Matriz contigua con un elemento por casilla.
+    HISTORY_PACKED,    ///< Bits empaquetados: flujo en 1 bit y velocidades en 4 bits o menos si vmax lo permite.
+    HISTORY_EVENTS,    ///< Movimientos de autos por paso con estados completos periódicos. El flujo se deriva.
+    HISTORY_DISK,      ///< Filas escritas a archivo por bloques. La memoria usada no depende de las iteraciones.
+    HISTORY_NONE       ///< No se guarda histórico. Las estadísticas se calculan con observadores durante la evolución.
+};
+
+/**
+* @class HistoryStore
+* @brief Interfaz común de los históricos. Cada fila es un paso de tiempo de Width() casillas.
+*/
+template <class T> class HistoryStore
+{
+public:
+    virtual ~HistoryStore() {}
+
+    ///@brief Reserva memoria para al menos rows filas en total.
+    virtual void Reserve(const std::size_t rows) = 0;
+
+    ///@brief Añade una fila al final del histórico.
+    ///@param row Arreglo con Width() elementos.
+    virtual void PushRow(const T* row) = 0;
+    void PushRow(const std::vector<T> &row)
+    {
+        PushRow(row.data());
+    }
+
+    ///@brief Copia count filas a partir de first en out (count*Width() elementos, por filas).
+    virtual void ReadRows(const std::size_t first, const std::size_t count, T* out) const = 0;
+
+    virtual std::size_t size() const noexcept = 0;           ///< Devuelve cantidad de filas.
+    virtual std::size_t Width() const noexcept = 0;          ///< Devuelve elementos por fila.
+    virtual std::size_t MemoryBytes() const noexcept = 0;    ///< Devuelve memoria reservada en bytes.
+    virtual void Clear() noexcept = 0;                       ///< Borra las filas.
+
+    ///@brief Devuelve puntero a la fila t si el histórico la guarda sin codificar, o nullptr.
+    virtual const T* RowData(const std::size_t t) const noexcept { (void)t; return nullptr; }
+
+    ///@brief Prepara el histórico para que varios hilos lean a la vez mientras no se añadan filas.
+    virtual void PrepareRead() const {}
+
+    ///@brief Copia el histórico a una lista de listas.
+    std::vector< std::vector<T> > ToVector() const
+    {
+        std::vector< std::vector<T> > out(this->size(), std::vector<T>(this->Width()));
+        for (std::size_t t = 0; t < out.size(); ++t)
+            ReadRows(t, 1, out[t].data());
+        return out;
+    }
+};
+
+/**
+* @class HistoryRow
+* @brief Vista de solo lectura de una fila (un paso de tiempo) del histórico.
+*/
+template <class T> class HistoryRow
+{
+    const T* m_data;
+    std::size_t m_size;
+public:
+    HistoryRow(const T* data, const std::size_t size) : m_data(data), m_size(size) {}
+
+    const T &operator[](const std::size_t i) const noexcept { return m_data[i]; }
+    std::size_t size() const noexcept { return m_size; }
+    const T* data() const noexcept { return m_data; }
+    const T* begin() const noexcept { return m_data; }
+    const T* end() const noexcept { return m_data + m_size; }
+};
+
+/**
+* @class NullHistory
+* @brief Histórico que descarta las filas. Se usa en HISTORY_NONE.
+*/
+template <class T> class NullHistory : public HistoryStore<T>
+{
+    std::size_t m_width;
+public:
+    explicit NullHistory(const std::size_t width) : m_width(width) {}
+
+    void Reserve(const std::size_t rows) { (void)rows; }
+    using HistoryStore<T>::PushRow;
+    void PushRow(const T* row) { (void)row; }
+    void ReadRows(const std::size_t first, const std::size_t count, T* out) const { (void)first; (void)count; (void)out; }
+    std::size_t size() const noexcept { return 0; }
+    std::size_t Width() const noexcept { return m_width; }
+    std::size_t MemoryBytes() const noexcept { return 0; }
+    void Clear() noexcept {}
+};
+
+/**
+* @class HistoryArena
+* @brief Histórico guardado como una sola matriz contigua de filas x ancho.
+* La memoria se reserva por adelantado con Reserve (Evolve la llama con el número de iteraciones)
+* y crece geométricamente si se excede. Los bloques grandes usan páginas enormes.
+*/
+template <class T> class HistoryArena : public HistoryStore<T>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "HistoryArena requiere tipos trivialmente copiables.");
+
+    T* m_data;
+    std::size_t m_width;       ///< Elementos por fila.
+    std::size_t m_rows;        ///< Filas guardadas.
+    std::size_t m_capacity;    ///< Filas reservadas.
+    bool m_huge;               ///< La memoria usa páginas enormes.
+
+    void Reallocate(const std::size_t capacity)
+    {
+        bool huge;
+        T* data = static_cast<T*>(aux_alloc_large(capacity*m_width*sizeof(T), huge));
+        if (data == nullptr && capacity*m_width != 0)
+            throw std::bad_alloc();
+        if (m_rows != 0)
+            std::memcpy(data, m_data, m_rows*m_width*sizeof(T));
+        aux_free_large(m_data, m_capacity*m_width*sizeof(T), m_huge);
+        m_data = data;
+        m_capacity = capacity;
+        m_huge = huge;
+    }
+public:
+    HistoryArena(const std::size_t width = 0) : m_data(nullptr), m_width(width), m_rows(0), m_capacity(0), m_huge(false) {}
+    ~HistoryArena()
+    {
+        aux_free_large(m_data, m_capacity*m_width*sizeof(T), m_huge);
+    }
+    HistoryArena(const HistoryArena&) = delete;
+    HistoryArena &operator=(const HistoryArena&) = delete;
+
+    ///@brief Cambia el ancho de las filas. Borra el histórico.
+    void SetWidth(const std::size_t width)
+    {
+        Clear();
+        aux_free_large(m_data, m_capacity*m_width*sizeof(T), m_huge);
+        m_data = nullptr;
+        m_capacity = 0;
+        m_huge = false;
+        m_width = width;
+    }
+
+    using HistoryStore<T>::PushRow;
+
+    void Reserve(const std::size_t rows)
+    {
+        if (rows > m_capacity)
+            Reallocate(rows);
+    }
+    void PushRow(const T* row)
+    {
+        if (m_rows == m_capacity)
+            Reallocate(m_capacity < 16 ? 16 : m_capacity*2);
+        std::memcpy(m_data + m_rows*m_width, row, m_width*sizeof(T));
+        ++m_rows;
+    }
+    void ReadRows(const std::size_t first, const std::size_t count, T* out) const
+    {
+        std::memcpy(out, m_data + first*m_width, count*m_width*sizeof(T));
+    }
+
+    HistoryRow<T> operator[](const std::size_t t) const noexcept
+    {
+        return HistoryRow<T>(m_data + t*m_width, m_width);
+    }
+    const T* RowData(const std::size_t t) const noexcept
+    {
+        return m_data + t*m_width;
+    }
+
+    ///@brief Sobrescribe la fila t.
+    void ReplaceRow(const std::size_t t, const T* row)
+    {
+        std::memcpy(m_data + t*m_width, row, m_width*sizeof(T));
+    }
+    ///@brief Reordena las filas: la fila i pasa a ser la que estaba en order[i]. Sigue los ciclos de la
+    ///permutación, así que cada fila se copia una vez y solo hace falta una fila temporal.
+    void PermuteRows(const std::vector<std::size_t> &order)
+    {
+        std::vector<bool> done(m_rows, false);
+        std::vector<T> temp(m_width);
+        for (std::size_t i = 0; i < m_rows; ++i)
+        {
+            if (done[i] || order[i] == i)
+                continue;
+            std::memcpy(temp.data(), m_data + i*m_width, m_width*sizeof(T));
+            std::size_t j = i;
+            while (order[j] != i)
+            {
+                std::memcpy(m_data + j*m_width, m_data + order[j]*m_width, m_width*sizeof(T));
+                done[j] = true;
+                j = order[j];
+            }
+            std::memcpy(m_data + j*m_width, temp.data(), m_width*sizeof(T));
+            done[j] = true;
+        }
+    }
+
+    std::size_t size() const noexcept { return m_rows; }
+    std::size_t Width() const noexcept { return m_width; }
+    std::size_t MemoryBytes() const noexcept { return m_capacity*m_width*sizeof(T); }
+    void Clear() noexcept { m_rows = 0; }                           ///< Borra las filas sin liberar memoria.
+    const T* Data() const noexcept { return m_data; }               ///< Devuelve la matriz completa.
+};
+
+/**
+* @class PackedHistory
+* @brief Histórico con cada casilla codificada en Bits() bits (potencia de 2 hasta 32), código = valor - mínimo.
+* Cada fila ocupa WordsPerRow() palabras de 64 bits y ninguna casilla cruza de una palabra a otra,
+* de modo que las reducciones pueden operar directamente sobre las palabras.
+*/
+template <class T> class PackedHistory : public HistoryStore<T>
+{
+    HistoryArena<uint64_t> m_words;
+    std::size_t m_width;
+    unsigned m_bits;            ///< Bits por casilla.
+    std::size_t m_row_words;    ///< Palabras por fila.
+    T m_min;                    ///< Valor con código 0.
+    std::vector<uint64_t> m_row;
+
+public:
+    using HistoryStore<T>::PushRow;
+
+    ///@brief Constructor.
+    ///@param width Casillas por fila.
+    ///@param min_value Valor mínimo que se guardará.
+    ///@param max_value Valor máximo que se guardará.
+    PackedHistory(const std::size_t width, const T min_value, const T max_value)
+    {
+        const uint64_t codes = (uint64_t)((int64_t)max_value - (int64_t)min_value) + 1;
+        m_bits = 1;
+        while (m_bits < 32 && ((uint64_t)1 << m_bits) < codes)
+            m_bits *= 2;
+
+        m_width = width;
+        m_min = min_value;
+        m_row_words = (width*m_bits + 63)/64;
+        m_words.SetWidth(m_row_words);
+        m_row.assign(m_row_words, 0);
+    }
+
+    void Reserve(const std::size_t rows)
+    {
+        m_words.Reserve(rows);
+    }
+    void PushRow(const T* row)
+    {
+        const unsigned per_word = 64/m_bits;
+        const uint64_t mask = (((uint64_t)1 << m_bits) - 1);
+        for (std::size_t w = 0; w < m_row_words; ++w)
+        {
+            const std::size_t first = w*per_word;
+            const std::size_t last = (first + per_word < m_width) ? first + per_word : m_width;
+            uint64_t word = 0;
+            for (std::size_t i = first; i < last; ++i)
+                word |= ((uint64_t)((int64_t)row[i] - (int64_t)m_min) & mask) << ((i - first)*m_bits);
+            m_row[w] = word;
+        }
+        m_words.PushRow(m_row.data());
+    }
+    void ReadRows(const std::size_t first, const std::size_t count, T* out) const
+    {
+        const unsigned per_word = 64/m_bits;
+        const uint64_t mask = (((uint64_t)1 << m_bits) - 1);
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            const uint64_t* words = Words(first + t);
+            T* out_row = out + t*m_width;
+            for (std::size_t i = 0; i < m_width; ++i)
+                out_row[i] = (T)((int64_t)((words[i/per_word] >> ((i % per_word)*m_bits)) & mask) + (int64_t)m_min);
+        }
+    }
+
+    std::size_t size() const noexcept { return m_words.size(); }
+    std::size_t Width() const noexcept { return m_width; }
+    std::size_t MemoryBytes() const noexcept { return m_words.MemoryBytes(); }
+    void Clear() noexcept { m_words.Clear(); }
+
+    unsigned Bits() const noexcept { return m_bits; }                   ///< Devuelve bits por casilla.
+    std::size_t WordsPerRow() const noexcept { return m_row_words; }    ///< Devuelve palabras por fila.
+    T MinValue() const noexcept { return m_min; }                       ///< Devuelve el valor con código 0.
+
+    ///@brief Devuelve las palabras de la fila t.
+    const uint64_t* Words(const std::size_t t) const noexcept
+    {
+        return m_words.Data() + t*m_row_words;
+    }
+};
+
+/**
+* @struct HistoryEvent
+* @brief Cambio de un auto entre dos filas consecutivas del histórico de eventos.
+*/
+struct HistoryEvent
+{
+    int32_t pos;      ///< Origen (movimiento o salida) o llegada (entrada).
+    int16_t vel;      ///< Nueva velocidad del auto.
+    uint8_t type;     ///< EVENT_MOVE, EVENT_ENTRY o EVENT_EXIT.
+};
+
+enum HISTORY_EVENT_TYPE
+{
+    EVENT_MOVE, EVENT_ENTRY, EVENT_EXIT
+};
+
+/**
+* @class EventHistory
+* @brief Histórico que guarda solo los cambios de cada paso y un estado completo cada
+* KeyframeInterval() filas.
+*
+* Un auto en x con velocidad v en la fila t-1 se encuentra en x + v en la fila t. Por cada auto se
+* guarda un evento con su nueva velocidad; las salidas por la frontera abierta y las entradas se
+* guardan como eventos propios. Si una fila no se puede explicar con movimientos (por ejemplo, la
+* fila inicial del modo de prueba) se guarda completa. La memoria crece con autos x pasos en lugar
+* de casillas x pasos, y reconstruir una fila cuesta a lo sumo KeyframeInterval() pasos de eventos.
+*/
+template <class T> class EventHistory : public HistoryStore<T>
+{
+    std::size_t m_width;
+    std::size_t m_rows;
+    std::size_t m_interval;                     ///< Filas entre estados completos.
+    bool m_periodic;                            ///< Frontera periódica.
+    T m_empty;                                  ///< Valor de casilla vacía.
+    HistoryArena<T> m_keyframes;                ///< Estados completos.
+    std::vector<std::size_t> m_keyframe_rows;   ///< Fila de cada estado completo.
+    std::vector<HistoryEvent> m_events;         ///< Eventos de todas las filas.
+    std::vector<std::size_t> m_event_end;       ///< Fin de los eventos de cada fila en m_events.
+    std::vector<T> m_last;                      ///< Última fila añadida.
+    std::vector<char> m_claimed;                ///< Casillas alcanzadas por un movimiento.
+
+    ///@brief Calcula la fila r a partir de la fila anterior prev usando sus eventos.
+    void Apply(const std::size_t r, const T* prev, T* dst) const
+    {
+        std::fill(dst, dst + m_width, m_empty);
+        for (std::size_t e = m_event_end[r - 1]; e < m_event_end[r]; ++e)
+        {
+            const HistoryEvent &ev = m_events[e];
+            if (ev.type == EVENT_MOVE)
+            {
+                std::size_t to = (std::size_t)ev.pos + (std::size_t)prev[ev.pos];
+                if (to >= m_width)
+                    to %= m_width;
+                dst[to] = (T)ev.vel;
+            }
+            else if (ev.type == EVENT_ENTRY)
+                dst[ev.pos] = (T)ev.vel;
+        }
+    }
+    void PushEvent(const std::size_t pos, const T vel, const HISTORY_EVENT_TYPE type)
+    {
+        HistoryEvent ev;
+        ev.pos = (int32_t)pos;
+        ev.vel = (int16_t)vel;
+        ev.type = (uint8_t)type;
+        m_events.push_back(ev);
+    }
+public:
+    using HistoryStore<T>::PushRow;
+
+    ///@brief Constructor.
+    ///@param width Casillas por fila.
+    ///@param empty Valor de casilla vacía.
+    ///@param periodic Verdadero si los autos que salen por el final entran por el principio.
+    ///@param keyframe_interval Filas entre estados completos.
+    EventHistory(const std::size_t width, const T empty, const bool periodic, const std::size_t keyframe_interval = 1024)
+        : m_keyframes(width)
+    {
+        m_width = width;
+        m_rows = 0;
+        m_interval = (keyframe_interval == 0) ? 1 : keyframe_interval;
+        m_periodic = periodic;
+        m_empty = empty;
+        m_last.assign(width, empty);
+        m_claimed.assign(width, 0);
+    }
+
+    void Reserve(const std::size_t rows)
+    {
+        m_event_end.reserve(rows);
+        m_keyframes.Reserve(rows/m_interval + 1);
+    }
+    void PushRow(const T* row)
+    {
+        bool keyframe = (m_rows % m_interval == 0);
+        if (!keyframe)
+        {
+            const std::size_t start = m_events.size();
+            std::fill(m_claimed.begin(), m_claimed.end(), 0);
+            for (std::size_t x = 0; x < m_width && !keyframe; ++x)
+            {
+                if (m_last[x] == m_empty)
+                    continue;
+
+                std::size_t to = x + (std::size_t)m_last[x];
+                if (to >= m_width)
+                {
+                    if (!m_periodic)
+                    {
+                        PushEvent(x, m_empty, EVENT_EXIT);
+                        continue;
+                    }
+                    to %= m_width;
+                }
+                if (row[to] == m_empty || m_claimed[to])
+                    keyframe = true;
+                else
+                {
+                    m_claimed[to] = 1;
+                    PushEvent(x, row[to], EVENT_MOVE);
+                }
+            }
+            for (std::size_t x = 0; x < m_width && !keyframe; ++x)
+            {
+                if (row[x] != m_empty && !m_claimed[x])
+                    PushEvent(x, row[x], EVENT_ENTRY);
+            }
+            if (keyframe)
+                m_events.resize(start);
+        }
+        if (keyframe)
+        {
+            m_keyframes.PushRow(row);
+            m_keyframe_rows.push_back(m_rows);
+        }
+        m_event_end.push_back(m_events.size());
+        std::copy(row, row + m_width, m_last.begin());
+        ++m_rows;
+    }
+    void ReadRows(const std::size_t first, const std::size_t count, T* out) const
+    {
+        if (count == 0)
+            return;
+
+        // Estado completo más cercano anterior a first.
+        std::size_t k = (std::size_t)(std::upper_bound(m_keyframe_rows.begin(), m_keyframe_rows.end(), first)
+                                      - m_keyframe_rows.begin()) - 1;
+        std::vector<T> prev(m_keyframes.RowData(k), m_keyframes.RowData(k) + m_width);
+        std::vector<T> cur(m_width);
+        for (std::size_t r = m_keyframe_rows[k] + 1; r <= first; ++r)
+        {
+            if (k + 1 < m_keyframe_rows.size() && m_keyframe_rows[k + 1] == r)
+            {
+                ++k;
+                std::copy(m_keyframes.RowData(k), m_keyframes.RowData(k) + m_width, cur.begin());
+            }
+            else
+                Apply(r, prev.data(), cur.data());
+            prev.swap(cur);
+        }
+
+        std::copy(prev.begin(), prev.end(), out);
+        for (std::size_t t = 1; t < count; ++t)
+        {
+            const std::size_t r = first + t;
+            T* dst = out + t*m_width;
+            if (k + 1 < m_keyframe_rows.size() && m_keyframe_rows[k + 1] == r)
+            {
+                ++k;
+                std::copy(m_keyframes.RowData(k), m_keyframes.RowData(k) + m_width, dst);
+            }
+            else
+                Apply(r, dst - m_width, dst);
+        }
+    }
+
+    std::size_t size() const noexcept { return m_rows; }
+    std::size_t Width() const noexcept { return m_width; }
+    std::size_t MemoryBytes() const noexcept
+    {
+        return m_keyframes.MemoryBytes() + m_events.capacity()*sizeof(HistoryEvent)
+               + (m_event_end.capacity() + m_keyframe_rows.capacity())*sizeof(std::size_t);
+    }
+    void Clear() noexcept
+    {
+        m_rows = 0;
+        m_keyframes.Clear();
+        m_keyframe_rows.clear();
+        m_events.clear();
+        m_event_end.clear();
+        std::fill(m_last.begin(), m_last.end(), m_empty);
+    }
+
+    std::size_t KeyframeInterval() const noexcept { return m_interval; }    ///< Devuelve filas entre estados completos.
+    std::size_t EventCount() const noexcept { return m_events.size(); }     ///< Devuelve cantidad de eventos guardados.
+};
+
+/**
+* @class DerivedFlowHistory
+* @brief Histórico de flujo que no guarda datos: cada fila se calcula desde la fila de velocidades
+* correspondiente, marcando las casillas x, ..., x + v - 1 de cada auto como lo hace Move().
+*/
+template <class T, class F> class DerivedFlowHistory : public HistoryStore<F>
+{
+    const HistoryStore<T>* m_source;    ///< Histórico de velocidades.
+    std::size_t m_rows;
+    std::size_t m_offset;               ///< Fila de velocidades correspondiente a la fila de flujo 0.
+    T m_empty;
+    F m_no_flow, m_is_flow;
+    bool m_periodic;
+public:
+    using HistoryStore<F>::PushRow;
+
+    ///@brief Constructor.
+    ///@param source Histórico de velocidades del que se deriva el flujo.
+    ///@param empty Valor de casilla vacía.
+    ///@param no_flow Valor sin flujo.
+    ///@param is_flow Valor con flujo.
+    ///@param periodic Verdadero si la frontera es periódica.
+    DerivedFlowHistory(const HistoryStore<T>* source, const T empty, const F no_flow, const F is_flow, const bool periodic)
+        : m_source(source), m_rows(0), m_offset(0), m_empty(empty), m_no_flow(no_flow), m_is_flow(is_flow), m_periodic(periodic) {}
+
+    void Reserve(const std::size_t rows) { (void)rows; }
+
+    ///@brief Registra una fila nueva. Se asume que corresponde a la última fila de velocidades.
+    void PushRow(const F* row)
+    {
+        (void)row;
+        if (m_rows == 0)
+            m_offset = m_source->size() - 1;
+        ++m_rows;
+    }
+    void ReadRows(const std::size_t first, const std::size_t count, F* out) const
+    {
+        const std::size_t width = m_source->Width();
+        std::vector<T> vel(count*width);
+        m_source->ReadRows(first + m_offset, count, vel.data());
+        std::fill(out, out + count*width, m_no_flow);
+        for (std::size_t t = 0; t < count; ++t)
+        {
+            const T* v = vel.data() + t*width;
+            F* f = out + t*width;
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                if (v[x] == m_empty)
+                    continue;
+                for (std::size_t j = x; j < x + (std::size_t)v[x]; ++j)
+                {
+                    if (j < width)
+                        f[j] = m_is_flow;
+                    else if (m_periodic)
+                        f[j % width] = m_is_flow;
+                }
+            }
+        }
+    }
+
+    std::size_t size() const noexcept { return m_rows; }
+    std::size_t Width() const noexcept { return m_source->Width(); }
+    std::size_t MemoryBytes() const noexcept { return 0; }
+    void Clear() noexcept { m_rows = 0; }
+};
+
+/**
+* @class DiskHistory
+* @brief Histórico escrito a un archivo a medida que se genera.
+* Las filas se acumulan en un bloque de tamaño fijo que se escribe al llenarse, por lo que la
+* memoria usada es constante. El archivo contiene solo la matriz de filas x ancho sin encabezado
+* y se lee proyectándolo en memoria.
+*/
+template <class T> class DiskHistory : public HistoryStore<T>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "DiskHistory requiere tipos trivialmente copiables.");
+
+    std::string m_path;
+    std::ofstream m_file;
+    std::size_t m_width;
+    std::size_t m_rows;             ///< Filas totales.
+    std::size_t m_flushed;          ///< Filas escritas al archivo.
+    std::size_t m_chunk_rows;       ///< Filas por bloque.
+    std::vector<T> m_chunk;         ///< Filas pendientes de escribir.
+
+    mutable std::mutex m_map_mutex;
+    mutable MappedFile m_map;       ///< Proyección de las filas escritas.
+    mutable std::size_t m_mapped;   ///< Filas cubiertas por la proyección.
+    mutable bool m_map_error;       ///< Ya se informó que no se pudo proyectar el archivo.
+
+    void Flush()
+    {
+        const std::size_t pending = m_rows - m_flushed;
+        if (pending == 0)
+            return;
+        m_file.write(reinterpret_cast<const char*>(m_chunk.data()), pending*m_width*sizeof(T));
+        m_file.flush();
+        if (!m_file && m_file.is_open())
+        {
+            std::cout << "Error: No se pudo escribir el archivo de historico." << std::endl;
+            m_file.close();
+        }
+        m_flushed = m_rows;
+    }
+
+    ///@brief Devuelve las filas escritas en el archivo, proyectándolas de nuevo si el archivo creció.
+    ///Devuelve nullptr si no se pudieron proyectar.
+    const T* Mapped(const std::size_t rows) const
+    {
+        std::lock_guard<std::mutex> lock(m_map_mutex);
+        if (m_mapped < rows)
+        {
+            m_map.Open(m_path, m_flushed*m_width*sizeof(T));
+            m_mapped = m_map.IsOpen() ? m_flushed : 0;
+            if (m_mapped < rows && !m_map_error)
+            {
+                std::cout << "Error: No se puede proyectar el archivo de historico. Se lee sin proyectar." << std::endl;
+                m_map_error = true;
+            }
+        }
+        return (m_mapped < rows) ? nullptr : reinterpret_cast<const T*>(m_map.Data());
+    }
+
+    ///@brief Lee count filas desde first directamente del archivo, cuando no se puede proyectar.
+    void ReadFile(const std::size_t first, const std::size_t count, T* out) const
+    {
+        std::ifstream file(m_path.c_str(), std::ios::in | std::ios::binary);
+        file.seekg((std::streamoff)(first*m_width*sizeof(T)));
+        file.read(reinterpret_cast<char*>(out), (std::streamsize)(count*m_width*sizeof(T)));
+        if (!file)
+        {
+            std::cout << "Error: No se pudo leer el archivo de historico." << std::endl;
+            std::fill(out, out + count*m_width, T());
+        }
+    }
+public:
+    using HistoryStore<T>::PushRow;
+
+    ///@brief Constructor.
+    ///@param width Casillas por fila.
+    ///@param filepath Archivo donde se escriben las filas. Se sobrescribe si existe.
+    ///@param chunk_bytes Memoria del bloque de escritura.
+    DiskHistory(const std::size_t width, const std::string &filepath, const std::size_t chunk_bytes = 4*1024*1024)
+    {
+        m_path = filepath;
+        m_width = width;
+        m_rows = 0;
+        m_flushed = 0;
+        m_mapped = 0;
+        m_map_error = false;
+        m_chunk_rows = std::max<std::size_t>(1, chunk_bytes/std::max<std::size_t>(1, width*sizeof(T)));
+        m_chunk.resize(m_chunk_rows*width);
+        m_file.open(filepath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_file.is_open())
+            std::cout << "Error: No se puede crear archivo de historico." << std::endl;
+    }
+    ~DiskHistory()
+    {
+        Flush();
+    }
+
+    void Reserve(const std::size_t rows) { (void)rows; }
+    void PushRow(const T* row)
+    {
+        std::copy(row, row + m_width, m_chunk.begin() + (m_rows - m_flushed)*m_width);
+        ++m_rows;
+        if (m_rows - m_flushed == m_chunk_rows)
+            Flush();
+    }
+    void ReadRows(const std::size_t first, const std::size_t count, T* out) const
+    {
+        // Filas del archivo, proyectadas o leídas, y luego las del bloque pendiente.
+        const std::size_t in_file = (first < m_flushed) ? std::min(count, m_flushed - first) : 0;
+        if (in_file != 0)
+        {
+            const T* data = Mapped(first + in_file);
+            if (data)
+                std::copy(data + first*m_width, data + (first + in_file)*m_width, out);
+            else
+                ReadFile(first, in_file, out);
+        }
+        for (std::size_t t = in_file; t < count; ++t)
+        {
+            const T* row = m_chunk.data() + (first + t - m_flushed)*m_width;
+            std::copy(row, row + m_width, out + t*m_width);
+        }
+    }
+    ///@brief Devuelve la fila t, o nullptr si el archivo no se pudo proyectar (entonces se usa ReadRows).
+    const T* RowData(const std::size_t t) const noexcept
+    {
+        if (t >= m_flushed)
+            return m_chunk.data() + (t - m_flushed)*m_width;
+        const T* data = Mapped(t + 1);
+        return data ? data + t*m_width : nullptr;
+    }
+
+    std::size_t size() const noexcept { return m_rows; }
+    std::size_t Width() const noexcept { return m_width; }
+    std::size_t MemoryBytes() const noexcept { return m_chunk.size()*sizeof(T); }
+    void Clear() noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_map_mutex);
+        m_map.Close();
+        m_mapped = 0;
+        m_rows = 0;
+        m_flushed = 0;
+        m_file.close();
+        m_file.open(m_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    }
+
+    ///@brief Proyecta todas las filas escritas para que las lecturas concurrentes no vuelvan a proyectar.
+    void PrepareRead() const { Mapped(m_flushed); }
+
+    bool IsOpen() const noexcept { return m_file.is_open(); }      ///< Informa si se puede escribir el archivo.
+    const std::string &Path() const noexcept { return m_path; }    ///< Devuelve ruta del archivo.
+    void Sync() { Flush(); }                                        ///< Escribe las filas pendientes.
+};
+
+/**
+* @class HistoryCursor
+* @brief Acceso secuencial (en cualquier dirección) a las filas de un histórico.
+* Las filas se leen por bloques para que los históricos codificados decodifiquen una sola vez
+* cada bloque. Si el histórico guarda las filas sin codificar se accede directamente.
+*/
+template <class T> class HistoryCursor
+{
+    const HistoryStore<T> &m_store;
+    std::vector<T> m_block;
+    std::size_t m_block_rows;
+    std::size_t m_first, m_count;
+public:
+    ///@brief Constructor.
+    ///@param store Histórico a leer.
+    ///@param block_bytes Memoria máxima del bloque de lectura.
+    HistoryCursor(const HistoryStore<T> &store, const std::size_t block_bytes = 4*1024*1024)
+        : m_store(store), m_first(0), m_count(0)
+    {
+        const std::size_t row_bytes = store.Width()*sizeof(T);
+        m_block_rows = (row_bytes == 0) ? 1 : std::max<std::size_t>(1, std::min<std::size_t>(256, block_bytes/row_bytes));
+    }
+
+    ///@brief Devuelve la fila t.
+    const T* Row(const std::size_t t)
+    {
+        const T* direct = m_store.RowData(t);
+        if (direct != nullptr)
+            return direct;
+
+        if (t < m_first || t >= m_first + m_count)
+        {
+            m_first = t - t % m_block_rows;
+            m_count = std::min(m_block_rows, m_store.size() - m_first);
+            m_block.resize(m_count*m_store.Width());
+            m_store.ReadRows(m_first, m_count, m_block.data());
+        }
+        return m_block.data() + (t - m_first)*m_store.Width();
+    }
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include "LargeCA.h"
+
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+namespace
+{
+    // Casillas por bloque de la pista (128 MiB, múltiplo de las páginas enormes de 2 MiB y 1 GiB).
+    const unsigned LARGE_CHUNK_BITS = 27;
+    const CaLargeSize LARGE_CHUNK = (CaLargeSize)1 << LARGE_CHUNK_BITS;
+
+    // Casillas por bloque al colocar autos, igual que en CellularAutomata para obtener la misma pista.
+    const CaLargeSize PLACEMENT_BLOCK = (CaLargeSize)1 << 22;
+    static_assert(LARGE_CHUNK % PLACEMENT_BLOCK == 0, "Los bloques de colocacion deben caber en los de la pista.");
+}
+
+LargeCircularCA::LargeCircularCA(const CaLargeSize size, const double density, const CaVelocity vmax, const double rand_prob,
+                                 const CaVelocity init_vel, const INITIAL_CONDITION init, const bool explicit_pages)
+{
+    m_size = size;
+    m_vmax = vmax;
+    m_rand_prob = rand_prob;
+    m_init_vel = init_vel;
+    m_cars = 0;
+    m_first = size;
+    m_step = 0;
+    m_rows = m_occupied = m_flowed = 0;
+    if (m_vmax > 127 || m_init_vel > 127)
+    {
+        cout << "Error: La velocidad maxima de un AC grande es 127." << endl;
+        m_vmax = min(m_vmax, 127);
+        m_init_vel = min(m_init_vel, 127);
+    }
+
+    // Cada hilo reserva y toca sus propios bloques, así que las páginas quedan cerca del hilo que las llenó.
+    const size_t chunks = (size_t)((size + LARGE_CHUNK - 1)/LARGE_CHUNK);
+    m_chunks.assign(chunks, nullptr);
+    m_pages.assign(chunks, PAGES_NORMAL);
+    aux_run_parallel((unsigned)chunks, (size_t)size, [&](const unsigned c)
+    {
+        m_chunks[c] = static_cast<CaLargeCell*>(aux_alloc_huge((size_t)ChunkCells(c), explicit_pages, m_pages[c]));
+        if (m_chunks[c])
+            memset(m_chunks[c], (unsigned char)CA_EMPTY, (size_t)ChunkCells(c));
+    });
+    if (!IsValid())
+    {
+        cout << "Error: No hay memoria para un AC de " << size << " casillas." << endl;
+        return;
+    }
+
+    PlaceCars(min((CaLargeSize)(((double)size)*density), size), init);
+}
+LargeCircularCA::~LargeCircularCA()
+{
+    for (size_t c = 0; c < m_chunks.size(); ++c)
+        aux_free_huge(m_chunks[c], (size_t)ChunkCells(c), m_pages[c]);
+}
+CaLargeSize LargeCircularCA::ChunkCells(const size_t chunk) const noexcept
+{
+    return min(LARGE_CHUNK, m_size - ((CaLargeSize)chunk << LARGE_CHUNK_BITS));
+}
+inline CaLargeCell &LargeCircularCA::Cell(const CaLargePosition i) noexcept
+{
+    return m_chunks[(size_t)(i >> LARGE_CHUNK_BITS)][i & (LARGE_CHUNK - 1)];
+}
+void LargeCircularCA::PlaceCars(const CaLargeSize vehicles, const INITIAL_CONDITION init)
+{
+    m_cars = vehicles;
+    m_rand_words.assign((size_t)((vehicles + 63)/64) + 1, 0);
+    if (vehicles == 0)
+        return;
+
+    // Misma disposición y mismos números aleatorios que CellularAutomata::PlaceCars.
+    const CaLargeCell value = (CaLargeCell)m_init_vel;
+    switch (init)
+    {
+        case INIT_MEGAJAM:
+            for (CaLargePosition i = 0; i < vehicles; ++i)
+                Cell(i) = value;
+            m_first = 0;
+            return;
+        case INIT_UNIFORM:
+        {
+            // i*size/vehicles sin desbordar: parte entera y resto por separado.
+            const CaLargeSize quotient = m_size/vehicles, remainder = m_size % vehicles;
+            CaLargePosition pos = 0;
+            CaLargeSize carry = 0;
+            for (CaLargeSize i = 0; i < vehicles; ++i)
+            {
+                Cell(pos) = value;
+                pos += quotient;
+                carry += remainder;
+                if (carry >= vehicles)
+                {
+                    carry -= vehicles;
+                    ++pos;
+                }
+            }
+            m_first = 0;
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (m_size <= PLACEMENT_BLOCK)
+    {
+        aux_floyd_sample(m_chunks[0], (uint32_t)m_size, (uint32_t)vehicles, (CaLargeCell)CA_EMPTY, value,
+                         [](const uint32_t n) { return (uint32_t)RandomGen::GetInt((int)n); });
+        FindFirst();
+        return;
+    }
+
+    const size_t blocks = (size_t)((m_size + PLACEMENT_BLOCK - 1)/PLACEMENT_BLOCK);
+    vector<uint32_t> counts(blocks);
+    vector<uint64_t> seeds(blocks);
+    uint64_t cells_left = m_size, cars_left = vehicles;
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        const CaLargeSize cells = min(PLACEMENT_BLOCK, m_size - b*PLACEMENT_BLOCK);
+        counts[b] = (uint32_t)aux_hypergeometric(cells_left, cars_left, cells, RandomGen::GetDouble());
+        cells_left -= cells;
+        cars_left -= counts[b];
+        seeds[b] = ((uint64_t)RandomGen::GetInt(1 << 30) << 30) ^ (uint64_t)RandomGen::GetInt(1 << 30);
+    }
+    aux_run_parallel((unsigned)blocks, (size_t)vehicles, [&](const unsigned b)
+    {
+        // Los bloques de colocación no cruzan bloques de la pista.
+        Xoshiro256ss engine(seeds[b]);
+        const CaLargePosition first = b*PLACEMENT_BLOCK;
+        aux_floyd_sample(&Cell(first), (uint32_t)min(PLACEMENT_BLOCK, m_size - first), counts[b], (CaLargeCell)CA_EMPTY, value,
+                         [&engine](const uint32_t n) { return aux_bounded_rand(engine, n); });
+    });
+    FindFirst();
+}
+void LargeCircularCA::FindFirst() noexcept
+{
+    m_first = m_size;
+    for (size_t c = 0; c < m_chunks.size() && m_first == m_size; ++c)
+    {
+        const CaLargeCell* cells = m_chunks[c];
+        const CaLargeSize count = ChunkCells(c);
+        for (CaLargePosition k = 0; k < count; ++k)
+        {
+            if (cells[k] != CA_EMPTY)
+            {
+                m_first = ((CaLargePosition)c << LARGE_CHUNK_BITS) + k;
+                break;
+            }
+        }
+    }
+}
+bool LargeCircularCA::IsValid() const noexcept
+{
+    for (size_t c = 0; c < m_chunks.size(); ++c)
+    {
+        if (m_chunks[c] == nullptr)
+            return false;
+    }
+    return true;
+}
+HUGE_PAGES LargeCircularCA::Pages() const noexcept
+{
+    HUGE_PAGES pages = PAGES_EXPLICIT;
+    for (size_t c = 0; c < m_pages.size(); ++c)
+        pages = min(pages, m_pages[c]);
+    return pages;
+}
+void LargeCircularCA::Step() noexcept
+{
+    // Mismas decisiones aleatorias que CellularAutomata::PrepareRandomization: una por auto, en orden de casilla.
+    RandomGen::FillBernoulli(m_rand_words.data(), (size_t)m_cars, m_rand_prob);
+
+    // Se recorre la pista hacia atrás desde la última casilla hasta el primer auto. Cada auto avanza menos que la
+    // distancia al de adelante, que ya se movió, así que su destino está libre. Los autos que dan la vuelta caen
+    // antes del primer auto, en casillas que ya no se recorren.
+    uint64_t flowed = 0;
+    CaLargePosition next = m_first + m_size;    // Posición anterior del auto de adelante.
+    CaLargePosition new_first = m_size;
+    uint64_t car = m_cars;
+    const size_t first_chunk = (size_t)(m_first >> LARGE_CHUNK_BITS);
+    for (size_t c = m_chunks.size(); m_cars != 0 && c-- > first_chunk;)
+    {
+        CaLargeCell* cells = m_chunks[c];
+        const CaLargePosition base = (CaLargePosition)c << LARGE_CHUNK_BITS;
+        const CaLargePosition low = (m_first > base) ? m_first - base : 0;
+        for (CaLargePosition k = ChunkCells(c); k-- > low;)
+        {
+            // Salta de ocho en ocho las casillas vacías.
+            if ((k & 7) == 7 && k >= low + 7)
+            {
+                uint64_t word;
+                memcpy(&word, cells + k - 7, sizeof(word));
+                if (word == ~(uint64_t)0)
+                {
+                    k -= 7;
+                    continue;
+                }
+            }
+            CaVelocity v = cells[k];
+            if (v == CA_EMPTY)
+                continue;
+
+            // Aceleración y frenado.
+            const CaLargePosition i = base + k;
+            const CaLargeSize dist = next - i;
+            if ((v < m_vmax) && (dist > (CaLargeSize)(v + 1)))
+                v++;
+            else if ((v > 0) && (dist <= (CaLargeSize)v))
+                v = (CaVelocity)(dist - 1);
+
+            // Aleatoriedad.
+            --car;
+            if ((v > 0) && ((m_rand_words[car >> 6] >> (car & 63)) & 1))
+                v--;
+
+            // Pares de casillas vecinas con flujo, sin contar el par entre la última y la primera casilla.
+            if (v > 0)
+                flowed += (uint64_t)(v - 1) - ((i + v > m_size) ? 1 : 0);
+
+            cells[k] = (CaLargeCell)CA_EMPTY;
+            CaLargePosition j = i + v;
+            if (j >= m_size)
+                j -= m_size;
+            Cell(j) = (CaLargeCell)v;
+            new_first = min(new_first, j);
+            next = i;
+        }
+    }
+    if (m_cars != 0)
+        m_first = new_first;
+
+    // Igual que CellStatistics: el primer paso se cuenta pero no se suma.
+    if (m_rows++ != 0)
+    {
+        m_occupied += m_cars;
+        m_flowed += flowed;
+    }
+    ++m_step;
+}
+void LargeCircularCA::Evolve(const CaStep iter) noexcept
+{
+    for (CaStep i = 0; i < iter; ++i)
+        Step();
+}
+CaLargeSize LargeCircularCA::GetSize() const noexcept
+{
+    return m_size;
+}
+CaLargeSize LargeCircularCA::CountCars() const noexcept
+{
+    return m_cars;
+}
+CaStep LargeCircularCA::GetStep() const noexcept
+{
+    return m_step;
+}
+CaVelocity LargeCircularCA::GetAt(const CaLargePosition i) const noexcept
+{
+    return m_chunks[(size_t)((i % m_size) >> LARGE_CHUNK_BITS)][(i % m_size) & (LARGE_CHUNK - 1)];
+}
+void LargeCircularCA::ClearStatistics() noexcept
+{
+    m_rows = m_occupied = m_flowed = 0;
+}
+uint64_t LargeCircularCA::Rows() const noexcept
+{
+    return m_rows;
+}
+double LargeCircularCA::MeanOcupancy() const noexcept
+{
+    return (m_rows != 0 && m_size != 0) ? (double)m_occupied/((double)m_rows*(double)m_size) : 0.0;
+}
+double LargeCircularCA::MeanFlow() const noexcept
+{
+    return (m_rows != 0 && m_size != 0) ? (double)m_flowed/((double)m_rows*(double)m_size) : 0.0;
+}
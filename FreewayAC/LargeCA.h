@@ -0,0 +1,78 @@
+/**
+* @file LargeCA.h
+* @brief AC circular de escala muy grande (más de 2^32 casillas) con índices de 64 bits.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _LARGECA
+#define _LARGECA
+
+#include <vector>
+#include "CellularAutomata.h"
+
+using CaLargeSize = uint64_t;
+using CaLargePosition = uint64_t;
+using CaLargeCell = int8_t;
+
+/**
+* @class LargeCircularCA
+* @brief AC circular con las mismas reglas que CircularCA pensado para pistas de miles de millones de casillas.
+*
+* Cada casilla ocupa un byte y la pista se reparte en bloques de 2^27 casillas alineados a páginas enormes
+* (ver aux_alloc_huge), que se llenan en paralelo. No guarda histórico: ocupación y flujo se acumulan en cada paso
+* igual que CellStatistics. Cada paso es una sola pasada hacia atrás que aplica las reglas y mueve los autos en la
+* misma pista, así que no hace falta una copia temporal. Con la misma semilla, tamaño y parámetros, la evolución
+* coincide con la de CircularCA.
+*/
+class LargeCircularCA
+{
+    std::vector<CaLargeCell*> m_chunks;     ///< Bloques de la pista.
+    std::vector<HUGE_PAGES> m_pages;        ///< Tipo de páginas de cada bloque.
+    CaLargeSize m_size;
+    CaVelocity m_vmax;
+    double m_rand_prob;
+    CaVelocity m_init_vel;
+    CaLargeSize m_cars;
+    CaLargePosition m_first;                ///< Casilla del primer auto.
+    CaStep m_step;
+    std::vector<uint64_t> m_rand_words;     ///< Decisiones de descenso de velocidad del paso, una por auto.
+    uint64_t m_rows, m_occupied, m_flowed;  ///< Contadores de ocupación y flujo, como en CellStatistics.
+
+    CaLargeSize ChunkCells(const std::size_t chunk) const noexcept;
+    inline CaLargeCell &Cell(const CaLargePosition i) noexcept;
+    void PlaceCars(const CaLargeSize vehicles, const INITIAL_CONDITION init);
+    void FindFirst() noexcept;
+public:
+    ///@brief Constructor.
+    ///@param size Tamaño del AC.
+    ///@param density Densidad de autos.
+    ///@param vmax Velocidad máxima de los autos. A lo más 127.
+    ///@param rand_prob Probabilidad de descenso de velocidad.
+    ///@param init_vel Velocidad inicial de los autos.
+    ///@param init Disposición inicial de los autos.
+    ///@param explicit_pages Usar páginas enormes explícitas si hay disponibles.
+    LargeCircularCA(const CaLargeSize size, const double density, const CaVelocity vmax, const double rand_prob,
+                    const CaVelocity init_vel, const INITIAL_CONDITION init = INIT_RANDOM, const bool explicit_pages = false);
+    ~LargeCircularCA();
+    LargeCircularCA(const LargeCircularCA&) = delete;
+    LargeCircularCA &operator=(const LargeCircularCA&) = delete;
+
+    bool IsValid() const noexcept;                          ///< Informa si se pudo reservar la pista.
+    HUGE_PAGES Pages() const noexcept;                      ///< Devuelve el tipo de páginas de la pista.
+
+    void Step() noexcept;                                   ///< Aplica las reglas y mueve los autos.
+    void Evolve(const CaStep iter) noexcept;                ///< Evoluciona iter pasos.
+
+    CaLargeSize GetSize() const noexcept;                   ///< Devuelve tamaño del AC.
+    CaLargeSize CountCars() const noexcept;                 ///< Devuelve cantidad de autos.
+    CaStep GetStep() const noexcept;                        ///< Devuelve pasos aplicados.
+    CaVelocity GetAt(const CaLargePosition i) const noexcept; ///< Devuelve la velocidad en la casilla i o CA_EMPTY.
+
+    void ClearStatistics() noexcept;                        ///< Olvida los pasos acumulados, por ejemplo tras el transitorio.
+    uint64_t Rows() const noexcept;                         ///< Devuelve pasos acumulados.
+    double MeanOcupancy() const noexcept;                   ///< Igual que la media de CellStatistics::Ocupancy.
+    double MeanFlow() const noexcept;                       ///< Igual que CellStatistics::MeanFlow.
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "LiveSnapshot.h"
+
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <new>
+using namespace std;
+
+namespace
+{
+    const char SNAPSHOT_ID[8] = { 'F', 'W', 'S', 'N', 'A', 'P', '2', '\0' };
+
+    // Las velocidades empiezan en una línea de caché propia.
+    const size_t SNAPSHOT_HEADER_SIZE = (sizeof(SnapshotHeader) + 63) / 64 * 64;
+
+    // Bytes de las velocidades, completando la última palabra de 64 bits.
+    size_t cell_bytes(const uint64_t cells)
+    {
+        return (size_t)((cells*sizeof(CaVelocity) + 7)/8*8);
+    }
+
+    // Copias por palabras atómicas relajadas. La última palabra puede estar incompleta en la fila del AC.
+    void store_words(atomic<uint64_t>* words, const char* data, const size_t bytes)
+    {
+        const size_t full = bytes/8;
+        for (size_t w = 0; w < full; ++w)
+        {
+            uint64_t word;
+            memcpy(&word, data + w*8, 8);
+            words[w].store(word, memory_order_relaxed);
+        }
+        if (bytes % 8 != 0)
+        {
+            uint64_t word = 0;
+            memcpy(&word, data + full*8, bytes % 8);
+            words[full].store(word, memory_order_relaxed);
+        }
+    }
+    void load_words(const atomic<uint64_t>* words, char* data, const size_t bytes)
+    {
+        const size_t full = bytes/8;
+        for (size_t w = 0; w < full; ++w)
+        {
+            const uint64_t word = words[w].load(memory_order_relaxed);
+            memcpy(data + w*8, &word, 8);
+        }
+        if (bytes % 8 != 0)
+        {
+            const uint64_t word = words[full].load(memory_order_relaxed);
+            memcpy(data + full*8, &word, bytes % 8);
+        }
+    }
+}
+
+LiveState::LiveState()
+{
+    step = 0;
+    cars = 0;
+    rows = 0;
+    ocupancy = 0.0;
+    mean_flow = 0.0;
+    finished = false;
+}
+
+LiveSnapshot::LiveSnapshot(const CaSize size, const CaStep interval, const string &shm_name)
+{
+    m_header = nullptr;
+    m_words = nullptr;
+    m_size = size;
+    m_interval = (interval == 0) ? 1 : interval;
+    m_last = 0;
+    m_rows = m_flow_rows = m_occupied = m_flowed = 0;
+
+    const size_t bytes = SNAPSHOT_HEADER_SIZE + cell_bytes(size);
+    char* data = nullptr;
+    if (shm_name != "")
+    {
+        if (!m_shm.Create(shm_name, bytes))
+        {
+            cout << "Error: No se puede crear memoria compartida " << shm_name << "." << endl;
+            return;
+        }
+        data = m_shm.Data();
+    }
+    else
+    {
+        m_local.assign((bytes + sizeof(uint64_t) - 1)/sizeof(uint64_t), 0);
+        data = reinterpret_cast<char*>(m_local.data());
+    }
+
+    m_header = new (data) SnapshotHeader();
+    memcpy(m_header->magic, SNAPSHOT_ID, sizeof(SNAPSHOT_ID));
+    m_header->header_size = (uint32_t)SNAPSHOT_HEADER_SIZE;
+    m_header->cell_size = (uint32_t)sizeof(CaVelocity);
+    m_header->cells = size;
+    m_header->writer_pid = (uint32_t)aux_process_id();
+    m_header->sequence.store(0, memory_order_relaxed);
+    m_header->finished.store(0, memory_order_relaxed);
+    m_words = reinterpret_cast<atomic<uint64_t>*>(data + SNAPSHOT_HEADER_SIZE);
+    for (size_t w = 0; w < cell_bytes(size)/8; ++w)
+        new (m_words + w) atomic<uint64_t>(0);
+    const vector<CaVelocity> empty(size, CA_EMPTY);
+    store_words(m_words, reinterpret_cast<const char*>(empty.data()), (size_t)size*sizeof(CaVelocity));
+    atomic_thread_fence(memory_order_release);
+}
+LiveSnapshot::~LiveSnapshot()
+{
+    Finish();
+}
+void LiveSnapshot::Publish(const CaStep step, const CaVelocity* row, const uint64_t cars)
+{
+    // Seqlock: sequence es impar mientras se escribe. Solo el hilo de simulación escribe, así que no hay bloqueo.
+    const uint64_t sequence = m_header->sequence.load(memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    m_header->step.store(step, memory_order_relaxed);
+    m_header->cars.store(cars, memory_order_relaxed);
+    m_header->rows.store(m_rows, memory_order_relaxed);
+    m_header->flow_rows.store(m_flow_rows, memory_order_relaxed);
+    m_header->occupied.store(m_occupied, memory_order_relaxed);
+    m_header->flowed.store(m_flowed, memory_order_relaxed);
+    if (row)
+        store_words(m_words, reinterpret_cast<const char*>(row), (size_t)m_size*sizeof(CaVelocity));
+
+    m_header->sequence.store(sequence + 2, memory_order_release);
+}
+void LiveSnapshot::OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size)
+{
+    if (!m_header || size != m_size)
+        return;
+
+    uint64_t cars = 0;
+    for (CaSize i = 0; i < size; ++i)
+        cars += (row[i] != CA_EMPTY);
+
+    // Igual que CellStatistics: la primera fila se cuenta pero no se suma.
+    if (m_rows++ != 0)
+        m_occupied += cars;
+    if (m_rows == 1 || step - m_last >= m_interval)
+    {
+        m_last = step;
+        Publish(step, row, cars);
+    }
+}
+void LiveSnapshot::OnFlow(const CaStep step, const CaFlow* row, const CaSize size)
+{
+    (void)step;
+    if (!m_header || size != m_size)
+        return;
+
+    if (m_flow_rows++ == 0)
+        return;
+    for (CaSize i = 0; i + 1 < size; ++i)
+        m_flowed += ((row[i] != NO_FLOW) && (row[i + 1] != NO_FLOW));
+}
+bool LiveSnapshot::IsValid() const noexcept
+{
+    return m_header != nullptr;
+}
+const SnapshotHeader* LiveSnapshot::Header() const noexcept
+{
+    return m_header;
+}
+void LiveSnapshot::Finish()
+{
+    if (!m_header || m_header->finished.load(memory_order_relaxed))
+        return;
+
+    // Publica los contadores de los pasos posteriores a la última fila copiada.
+    Publish(m_header->step.load(memory_order_relaxed), nullptr, m_header->cars.load(memory_order_relaxed));
+    m_header->finished.store(1, memory_order_release);
+}
+
+SnapshotReader::SnapshotReader()
+{
+    m_header = nullptr;
+}
+SnapshotReader::SnapshotReader(const LiveSnapshot &snapshot)
+{
+    m_header = snapshot.Header();
+}
+bool SnapshotReader::Open(const string &shm_name)
+{
+    m_header = nullptr;
+    if (!m_shm.Open(shm_name))
+    {
+        cout << "Error: No existe memoria compartida " << shm_name << "." << endl;
+        return false;
+    }
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(m_shm.Data());
+    if (m_shm.Size() < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_ID, sizeof(SNAPSHOT_ID)) != 0 ||
+        header->cell_size != sizeof(CaVelocity) || header->header_size < sizeof(SnapshotHeader) ||
+        header->header_size % 8 != 0 || m_shm.Size() < header->header_size + cell_bytes(header->cells))
+    {
+        cout << "Error: La memoria compartida " << shm_name << " no es de FreewayAC." << endl;
+        m_shm.Close();
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+bool SnapshotReader::Read(LiveState &state, const unsigned retries) const
+{
+    if (!m_header)
+        return false;
+
+    const atomic<uint64_t>* words = reinterpret_cast<const atomic<uint64_t>*>(reinterpret_cast<const char*>(m_header) +
+                                                                              m_header->header_size);
+    state.ca.resize((size_t)m_header->cells);
+    for (unsigned attempt = 0; attempt <= retries; ++attempt)
+    {
+        // finished se lee antes, así que si está marcado la copia ya tiene los contadores finales.
+        const bool finished = m_header->finished.load(memory_order_acquire) != 0;
+        const uint64_t before = m_header->sequence.load(memory_order_acquire);
+        if (before & 1)
+        {
+            this_thread::yield();
+            continue;
+        }
+
+        const uint64_t step = m_header->step.load(memory_order_relaxed), cars = m_header->cars.load(memory_order_relaxed);
+        const uint64_t rows = m_header->rows.load(memory_order_relaxed);
+        const uint64_t occupied = m_header->occupied.load(memory_order_relaxed), flowed = m_header->flowed.load(memory_order_relaxed);
+        load_words(words, reinterpret_cast<char*>(state.ca.data()), state.ca.size()*sizeof(CaVelocity));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (m_header->sequence.load(memory_order_relaxed) != before)
+            continue;
+
+        const double cells_count = (double)state.ca.size();
+        state.step = step;
+        state.cars = cars;
+        state.rows = rows;
+        state.ocupancy = (rows != 0 && cells_count != 0) ? (double)occupied/((double)rows*cells_count) : 0.0;
+        state.mean_flow = (rows != 0 && cells_count != 0) ? (double)flowed/((double)rows*cells_count) : 0.0;
+        state.finished = finished;
+        return true;
+    }
+    return false;
+}
+bool SnapshotReader::WriterAlive() const
+{
+    return m_header != nullptr && aux_process_alive(m_header->writer_pid);
+}
@@ -0,0 +1,127 @@
+/**
+* @file LiveSnapshot.h
+* @brief Copia del estado actual del AC que otros hilos o procesos pueden leer durante la evolución.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _LIVESNAPSHOT
+#define _LIVESNAPSHOT
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include "CellularAutomata.h"
+
+/**
+* @struct SnapshotHeader
+* @brief Encabezado de la copia, seguido de las velocidades de cada casilla. Es el formato de la memoria compartida.
+*
+* sequence es el contador del seqlock: es impar mientras el escritor cambia la copia. Los contadores solo se
+* deben leer con SnapshotReader, que repite la lectura si sequence cambió en medio. Los contadores y las
+* velocidades se escriben y leen con operaciones atómicas relajadas por palabras de 64 bits, así que leer mientras
+* se escribe no es una carrera de datos; el seqlock solo descarta las copias mezcladas.
+*/
+struct SnapshotHeader
+{
+    char magic[8];                          ///< "FWSNAP2".
+    uint32_t header_size;                   ///< Bytes del encabezado. Las velocidades empiezan aquí.
+    uint32_t cell_size;                     ///< Bytes de cada velocidad.
+    uint64_t cells;                         ///< Casillas de la copia. Ocupan palabras de 64 bits completas.
+    std::atomic<uint64_t> sequence;         ///< Contador del seqlock.
+    std::atomic<uint32_t> finished;         ///< Distinto de cero cuando la simulación terminó.
+    uint32_t writer_pid;                    ///< Proceso que publica, para saber si terminó sin marcar finished.
+    std::atomic<uint64_t> step;             ///< Paso de la fila copiada.
+    std::atomic<uint64_t> cars;             ///< Autos en la fila copiada.
+    std::atomic<uint64_t> rows;             ///< Filas de velocidades observadas.
+    std::atomic<uint64_t> flow_rows;        ///< Filas de flujo observadas.
+    std::atomic<uint64_t> occupied;         ///< Suma de autos de las filas observadas, sin la primera.
+    std::atomic<uint64_t> flowed;           ///< Suma de pares de casillas con flujo, sin la primera fila.
+};
+
+/**
+* @struct LiveState
+* @brief Estado leído de una copia: la última fila publicada y las estadísticas acumuladas hasta ella (al terminar,
+* hasta la última fila observada). ocupancy y mean_flow coinciden con los de CellStatistics sobre las mismas filas.
+*/
+struct LiveState
+{
+    CaStep step;
+    uint64_t cars;
+    uint64_t rows;
+    double ocupancy;
+    double mean_flow;
+    bool finished;
+    std::vector<CaVelocity> ca;
+
+    LiveState();
+};
+
+/**
+* @class LiveSnapshot
+* @brief Observador que publica la fila actual y los contadores de las estadísticas con un seqlock.
+*
+* El hilo de simulación nunca espera: incrementa sequence, copia y vuelve a incrementar. Los lectores
+* (SnapshotReader) repiten la lectura si la copia cambió mientras leían. La copia vive en memoria del proceso o,
+* si se da un nombre, en memoria compartida que otros procesos locales pueden abrir de solo lectura.
+*/
+class LiveSnapshot : public StepObserver
+{
+    SharedMemory m_shm;
+    std::vector<uint64_t> m_local;          ///< Copia cuando no se usa memoria compartida.
+    SnapshotHeader* m_header;
+    std::atomic<uint64_t>* m_words;         ///< Velocidades de la copia.
+    CaSize m_size;
+    CaStep m_interval;
+    CaStep m_last;                          ///< Paso de la última publicación.
+    uint64_t m_rows, m_flow_rows, m_occupied, m_flowed;
+
+    void Publish(const CaStep step, const CaVelocity* row, const uint64_t cars);
+public:
+    ///@brief Constructor.
+    ///@param size Tamaño del AC.
+    ///@param interval Pasos entre publicaciones de la fila. Los contadores se acumulan en todos los pasos.
+    ///@param shm_name Nombre de la memoria compartida. Si es vacío la copia solo se lee dentro del proceso.
+    explicit LiveSnapshot(const CaSize size, const CaStep interval = 1, const std::string &shm_name = "");
+    ~LiveSnapshot();
+    LiveSnapshot(const LiveSnapshot&) = delete;
+    LiveSnapshot &operator=(const LiveSnapshot&) = delete;
+
+    void OnVelocities(const CaStep step, const CaVelocity* row, const CaSize size);
+    void OnFlow(const CaStep step, const CaFlow* row, const CaSize size);
+
+    bool IsValid() const noexcept;                  ///< Informa si se pudo crear la copia.
+    const SnapshotHeader* Header() const noexcept;  ///< Devuelve la copia para SnapshotReader.
+    void Finish();                                  ///< Marca la simulación como terminada.
+};
+
+/**
+* @class SnapshotReader
+* @brief Lee una copia de LiveSnapshot desde otro hilo o, por nombre, desde otro proceso.
+*/
+class SnapshotReader
+{
+    SharedMemory m_shm;
+    const SnapshotHeader* m_header;
+public:
+    SnapshotReader();
+
+    ///@brief Lee una copia del mismo proceso.
+    explicit SnapshotReader(const LiveSnapshot &snapshot);
+
+    ///@brief Abre de solo lectura la memoria compartida creada por otro proceso.
+    ///@return Verdadero si existe y tiene el formato de LiveSnapshot.
+    bool Open(const std::string &shm_name);
+
+    ///@brief Copia el estado publicado más reciente.
+    ///@param state Se asigna el estado leído.
+    ///@param retries Intentos antes de rendirse si el escritor publica mientras se lee.
+    ///@return Verdadero si se leyó un estado consistente.
+    bool Read(LiveState &state, const unsigned retries = 1000) const;
+
+    ///@brief Informa si el proceso que publica sigue en ejecución. Si terminó sin marcar finished, la copia
+    ///ya no va a cambiar. Se debe llamar antes de Read para que esa lectura vea todo lo que publicó.
+    bool WriterAlive() const;
+};
+
+#endif
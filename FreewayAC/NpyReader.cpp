@@ -0,0 +1,106 @@
+#include "NpyReader.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+    const char NPY_MAGIC[6] = { '\x93', 'N', 'U', 'M', 'P', 'Y' };
+
+    // Devuelve el valor de key en el diccionario del encabezado o una cadena vacía.
+    string header_value(const string &text, const string &key)
+    {
+        const size_t pos = text.find("'" + key + "':");
+        if (pos == string::npos)
+            return string();
+        size_t begin = pos + key.size() + 3;
+        while (begin < text.size() && text[begin] == ' ')
+            ++begin;
+        const size_t end = (text[begin] == '(') ? text.find(')', begin) + 1 : text.find_first_of(",}", begin);
+        return (end == string::npos || end == 0) ? string() : text.substr(begin, end - begin);
+    }
+}
+
+NpyReader::NpyReader()
+{
+    m_data = nullptr;
+    m_kind = 0;
+    m_item_size = 0;
+    m_rows = 0;
+    m_cols = 0;
+}
+bool NpyReader::Open(const string &filepath)
+{
+    m_data = nullptr;
+    if (!m_map.Open(filepath))
+    {
+        cout << "Error: No se puede abrir archivo npy." << endl;
+        return false;
+    }
+
+    // Identificador, versión y largo del encabezado (2 bytes en la versión 1, 4 en las demás).
+    const char* file = m_map.Data();
+    const size_t file_size = m_map.Size();
+    if (file_size < 10 || !equal(NPY_MAGIC, NPY_MAGIC + 6, file) || file[6] < 1 || file[6] > 3)
+    {
+        cout << "Error: Archivo npy invalido." << endl;
+        return false;
+    }
+    const size_t prefix = (file[6] == 1) ? 10 : 12;
+    size_t text_len = 0;
+    for (size_t i = prefix - 1; i >= 8 && file_size >= prefix; --i)
+        text_len = (text_len << 8) | (unsigned char)file[i];
+    if (file_size < prefix || prefix + text_len > file_size)
+    {
+        cout << "Error: Archivo npy invalido." << endl;
+        return false;
+    }
+    const string text(file + prefix, text_len);
+
+    const string descr = header_value(text, "descr");
+    const string order = header_value(text, "fortran_order");
+    const string shape = header_value(text, "shape");
+    const bool type_ok = descr.size() == 5 && (descr[1] == '<' || descr[1] == '|') &&
+                         (descr[2] == 'i' || descr[2] == 'u' || descr[2] == 'b') &&
+                         (descr[3] == '1' || descr[3] == '2' || descr[3] == '4' || descr[3] == '8');
+    uint64_t dims[2] = { 0, 0 };
+    unsigned ndims = 0;
+    if (shape.size() >= 2)
+    {
+        istringstream is(shape.substr(1, shape.size() - 2));
+        char comma;
+        while (ndims < 2 && is >> dims[ndims])
+        {
+            ++ndims;
+            if (!(is >> comma))
+                break;
+        }
+    }
+    if (!type_ok || ndims == 0 || (order != "False" && ndims == 2 && dims[0] > 1))
+    {
+        cout << "Error: Arreglo npy no soportado. Se requiere un arreglo entero de una o dos dimensiones en orden C." << endl;
+        return false;
+    }
+
+    m_kind = (descr[2] == 'b') ? 'u' : descr[2];
+    m_item_size = descr[3] - '0';
+    m_rows = (ndims == 2) ? dims[0] : 1;
+    m_cols = (size_t)((ndims == 2) ? dims[1] : dims[0]);
+    if (prefix + text_len + m_rows*m_cols*m_item_size > file_size)
+    {
+        cout << "Error: Archivo npy incompleto." << endl;
+        return false;
+    }
+    m_data = file + prefix + text_len;
+    return true;
+}
+uint64_t NpyReader::Rows() const noexcept
+{
+    return m_rows;
+}
+size_t NpyReader::Cols() const noexcept
+{
+    return m_cols;
+}
@@ -0,0 +1,82 @@
+/**
+* @file NpyReader.h
+* @brief Lector de arreglos .npy de NumPy proyectados en memoria.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _NPYREADER
+#define _NPYREADER
+
+#include <string>
+#include <cstdint>
+#include "Auxiliar.h"
+
+/**
+* @class NpyReader
+* @brief Abre un arreglo .npy de una o dos dimensiones (versiones 1.0 a 3.0) proyectándolo en memoria, de
+* modo que los datos se leen directamente del archivo sin copiarlos ni interpretar texto.
+*
+* Un arreglo de una dimensión se trata como una sola fila. Solo se aceptan arreglos en orden de C y
+* tipos enteros o booleanos de 1, 2, 4 u 8 bytes en little endian.
+*/
+class NpyReader
+{
+    MappedFile m_map;
+    const char* m_data;        ///< Inicio de los datos.
+    char m_kind;               ///< Tipo de NumPy: 'i' con signo, 'u' sin signo o 'b' booleano.
+    std::size_t m_item_size;   ///< Bytes por elemento.
+    uint64_t m_rows;           ///< Filas.
+    std::size_t m_cols;        ///< Elementos por fila.
+public:
+    NpyReader();
+
+    ///@brief Abre y valida el archivo.
+    ///@return Verdadero si es un arreglo soportado.
+    bool Open(const std::string &filepath);
+
+    uint64_t Rows() const noexcept;           ///< Devuelve filas.
+    std::size_t Cols() const noexcept;        ///< Devuelve elementos por fila.
+
+    ///@brief Convierte count elementos de la fila row desde la columna first a T y los escribe en out.
+    template <class T> void Read(const uint64_t row, const std::size_t first, const std::size_t count, T* out) const
+    {
+        const char* src = m_data + (row*m_cols + first)*m_item_size;
+        switch (m_item_size)
+        {
+            case 1:
+                if (m_kind == 'i')
+                    Convert(reinterpret_cast<const int8_t*>(src), count, out);
+                else
+                    Convert(reinterpret_cast<const uint8_t*>(src), count, out);
+                break;
+            case 2:
+                if (m_kind == 'i')
+                    Convert(reinterpret_cast<const int16_t*>(src), count, out);
+                else
+                    Convert(reinterpret_cast<const uint16_t*>(src), count, out);
+                break;
+            case 4:
+                if (m_kind == 'i')
+                    Convert(reinterpret_cast<const int32_t*>(src), count, out);
+                else
+                    Convert(reinterpret_cast<const uint32_t*>(src), count, out);
+                break;
+            default:
+                if (m_kind == 'i')
+                    Convert(reinterpret_cast<const int64_t*>(src), count, out);
+                else
+                    Convert(reinterpret_cast<const uint64_t*>(src), count, out);
+                break;
+        }
+    }
+private:
+    // Los datos empiezan alineados a 16 bytes o más, así que se leen en su tipo directamente de la proyección.
+    template <class S, class T> static void Convert(const S* src, const std::size_t count, T* out)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            out[i] = (T)src[i];
+    }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "NpyWriter.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+    const char NPY_MAGIC[8] = { '\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+    const size_t NPY_PREFIX = 10;    // Identificador, versión y largo del encabezado.
+    const int NPY_ROWS_WIDTH = 20;   // Dígitos reservados para la cantidad de filas.
+}
+
+NpyWriter::NpyWriter(const string &filepath, const string &descr, const size_t item_size, const size_t cols, const bool append)
+{
+    m_descr = descr;
+    m_cols = cols;
+    m_item_size = item_size;
+    m_rows = 0;
+    m_header_len = 0;
+
+    if (append && OpenAppend(filepath))
+        return;
+
+    m_file.open(filepath.c_str(), ios::in | ios::out | ios::binary | ios::trunc);
+    if (m_file.is_open())
+    {
+        string header = Header(0, 0);
+        m_header_len = header.size();
+        m_file.write(header.data(), header.size());
+    }
+    else
+        cout << "Error: No se puede crear archivo npy." << endl;
+}
+NpyWriter::~NpyWriter()
+{
+    Close();
+}
+string NpyWriter::Header(const uint64_t rows, const size_t length) const
+{
+    ostringstream dict;
+    dict << "{'descr': '" << m_descr << "', 'fortran_order': False, 'shape': ("
+         << setw(NPY_ROWS_WIDTH) << rows << ", " << m_cols << "), }";
+    string text = dict.str();
+
+    // El encabezado termina en salto de línea y los datos empiezan en múltiplo de 64 bytes.
+    size_t total = (length != 0) ? length : (NPY_PREFIX + text.size() + 1 + 63)/64*64;
+    if (total < NPY_PREFIX + text.size() + 1)
+        return string();
+    text.append(total - NPY_PREFIX - text.size() - 1, ' ');
+    text.push_back('\n');
+
+    string header(NPY_MAGIC, 8);
+    header.push_back((char)(text.size() & 0xFF));
+    header.push_back((char)((text.size() >> 8) & 0xFF));
+    return header + text;
+}
+bool NpyWriter::OpenAppend(const string &filepath)
+{
+    m_file.open(filepath.c_str(), ios::in | ios::out | ios::binary);
+    if (!m_file.is_open())
+        return false;
+
+    char prefix[NPY_PREFIX];
+    m_file.read(prefix, NPY_PREFIX);
+    if (!m_file || !equal(prefix, prefix + 6, NPY_MAGIC) || prefix[6] != 1)
+    {
+        cout << "Error: Archivo npy invalido. Se reemplaza." << endl;
+        m_file.close();
+        return false;
+    }
+    size_t text_len = (unsigned char)prefix[8] | ((size_t)(unsigned char)prefix[9] << 8);
+    string text(text_len, ' ');
+    m_file.read(&text[0], text_len);
+
+    // Solo se aceptan archivos con el mismo tipo y columnas.
+    ostringstream expected;
+    expected << "'descr': '" << m_descr << "'";
+    size_t shape = text.find("'shape': (");
+    uint64_t rows = 0;
+    size_t cols = 0;
+    char comma = 0;
+    if (shape != string::npos)
+    {
+        istringstream is(text.substr(shape + 10));
+        is >> rows >> comma >> cols;
+    }
+    if (text.find(expected.str()) == string::npos || text.find("'fortran_order': False") == string::npos ||
+        comma != ',' || cols != m_cols || Header(rows, NPY_PREFIX + text_len).empty())
+    {
+        cout << "Error: Archivo npy incompatible. Se reemplaza." << endl;
+        m_file.close();
+        return false;
+    }
+
+    m_rows = rows;
+    m_header_len = NPY_PREFIX + text_len;
+    m_file.seekp(m_header_len + rows*m_cols*m_item_size);
+    return true;
+}
+void NpyWriter::Truncate(const uint64_t rows)
+{
+    if (!m_file.is_open() || rows >= m_rows)
+        return;
+    m_rows = rows;
+    m_file.seekp(m_header_len + rows*m_cols*m_item_size);
+}
+bool NpyWriter::IsOpen() const
+{
+    return m_file.is_open();
+}
+uint64_t NpyWriter::Rows() const
+{
+    return m_rows;
+}
+size_t NpyWriter::Cols() const
+{
+    return m_cols;
+}
+void NpyWriter::Close()
+{
+    if (!m_file.is_open())
+        return;
+
+    string header = Header(m_rows, m_header_len);
+    m_file.seekp(0);
+    m_file.write(header.data(), header.size());
+    m_file.close();
+}
@@ -0,0 +1,75 @@
+/**
+* @file NpyWriter.h
+* @brief Escritor de arreglos en formato .npy de NumPy.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _NPYWRITER
+#define _NPYWRITER
+
+#include <fstream>
+#include <string>
+#include <cstdint>
+
+/**
+* @brief Devuelve el descriptor de tipo de NumPy de T (little endian).
+*/
+template <class T> struct NpyType;
+template <> struct NpyType<int8_t>   { static const char* Descr() { return "|i1"; } };
+template <> struct NpyType<char>     { static const char* Descr() { return "|i1"; } };
+template <> struct NpyType<int32_t>  { static const char* Descr() { return "<i4"; } };
+template <> struct NpyType<uint32_t> { static const char* Descr() { return "<u4"; } };
+template <> struct NpyType<int64_t>  { static const char* Descr() { return "<i8"; } };
+template <> struct NpyType<uint64_t> { static const char* Descr() { return "<u8"; } };
+template <> struct NpyType<double>   { static const char* Descr() { return "<f8"; } };
+
+/**
+* @class NpyWriter
+* @brief Escribe una matriz de filas x columnas en formato .npy versión 1.0 agregando filas al final.
+*
+* El encabezado reserva espacio fijo para la cantidad de filas, que se actualiza al cerrar. Los datos
+* quedan alineados a 64 bytes y se pueden abrir sin copiar con numpy.load(path, mmap_mode='r').
+*/
+class NpyWriter
+{
+    std::fstream m_file;
+    std::string m_descr;       ///< Descriptor de tipo de NumPy.
+    std::size_t m_cols;        ///< Elementos por fila.
+    std::size_t m_item_size;   ///< Bytes por elemento.
+    std::size_t m_header_len;  ///< Bytes del encabezado, incluyendo identificador.
+    uint64_t m_rows;           ///< Filas escritas.
+
+    ///@brief Devuelve el encabezado completo para rows filas con largo total length.
+    std::string Header(const uint64_t rows, const std::size_t length) const;
+    bool OpenAppend(const std::string &filepath);
+public:
+    ///@brief Constructor.
+    ///@param filepath Ruta del archivo.
+    ///@param descr Descriptor de tipo de NumPy (ver NpyType).
+    ///@param item_size Bytes por elemento.
+    ///@param cols Elementos por fila.
+    ///@param append Si el archivo existe y es compatible se agregan filas al final en vez de reemplazarlo.
+    NpyWriter(const std::string &filepath, const std::string &descr, const std::size_t item_size,
+              const std::size_t cols, const bool append = false);
+    ~NpyWriter();
+
+    ///@brief Agrega rows filas tomadas de data (rows*Cols() elementos).
+    template <class T> void WriteRows(const T* data, const std::size_t rows)
+    {
+        if (!m_file.is_open())
+            return;
+        m_file.write(reinterpret_cast<const char*>(data), rows*m_cols*m_item_size);
+        m_rows += rows;
+    }
+
+    ///@brief Descarta las filas a partir de rows. Las siguientes filas se escriben en su lugar.
+    void Truncate(const uint64_t rows);
+
+    bool IsOpen() const;           ///< Devuelve estado del archivo.
+    uint64_t Rows() const;         ///< Devuelve filas en el archivo.
+    std::size_t Cols() const;      ///< Devuelve elementos por fila.
+    void Close();                  ///< Actualiza el encabezado y cierra el archivo.
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "RandomTrace.h"
+
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+    const char TRACE_ID[4] = { 'F', 'W', 'R', 'T' };
+    const size_t TRACE_BLOCK_WORDS = 8192;    // 64 KiB por bloque.
+}
+
+
+/****************************
+*                           *
+*     Escritor de trazas    *
+*                           *
+****************************/
+
+RandomTraceWriter::RandomTraceWriter(const string &filepath)
+{
+    m_word = 0;
+    m_count = 0;
+    m_buffer.reserve(TRACE_BLOCK_WORDS);
+
+    m_file.open(filepath.c_str(), ios::out | ios::binary);
+    if (m_file.is_open())
+    {
+        m_file.write(TRACE_ID, 4);
+        m_file.write(reinterpret_cast<const char*>(&m_count), sizeof(m_count));
+    }
+    else
+        cout << "Error: No se puede crear archivo de traza." << endl;
+}
+RandomTraceWriter::~RandomTraceWriter()
+{
+    Close();
+}
+void RandomTraceWriter::Flush()
+{
+    if (m_file.is_open() && !m_buffer.empty())
+        m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size()*sizeof(uint64_t));
+    m_buffer.clear();
+}
+bool RandomTraceWriter::IsOpen() const
+{
+    return m_file.is_open();
+}
+uint64_t RandomTraceWriter::Count() const
+{
+    return m_count;
+}
+void RandomTraceWriter::Close()
+{
+    if (!m_file.is_open())
+        return;
+
+    if ((m_count & 63) != 0)
+        m_buffer.push_back(m_word);
+    Flush();
+
+    m_file.seekp(4);
+    m_file.write(reinterpret_cast<const char*>(&m_count), sizeof(m_count));
+    m_file.close();
+}
+
+
+/****************************
+*                           *
+*      Lector de trazas     *
+*                           *
+****************************/
+
+RandomTraceReader::RandomTraceReader(const string &filepath)
+{
+    m_word_index = 0;
+    m_count = 0;
+    m_cursor = 0;
+
+    m_file.open(filepath.c_str(), ios::in | ios::binary);
+    if (m_file.is_open())
+    {
+        char id[4];
+        m_file.read(id, 4);
+        m_file.read(reinterpret_cast<char*>(&m_count), sizeof(m_count));
+        if (!m_file || !equal(id, id + 4, TRACE_ID))
+        {
+            cout << "Error: Archivo de traza invalido." << endl;
+            m_count = 0;
+            m_file.close();
+        }
+        else
+            Load();
+    }
+    else
+        cout << "Error: No se puede abrir archivo de traza." << endl;
+}
+void RandomTraceReader::Load()
+{
+    m_buffer.resize(TRACE_BLOCK_WORDS);
+    m_file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size()*sizeof(uint64_t));
+    m_buffer.resize((size_t)m_file.gcount()/sizeof(uint64_t));
+    m_word_index = 0;
+
+    // Traza truncada: se descartan las decisiones que faltan.
+    if (m_buffer.empty())
+    {
+        m_buffer.push_back(0);
+        m_count = m_cursor;
+    }
+}
+bool RandomTraceReader::IsOpen() const
+{
+    return m_file.is_open();
+}
+uint64_t RandomTraceReader::Count() const
+{
+    return m_count;
+}
+uint64_t RandomTraceReader::Position() const
+{
+    return m_cursor;
+}
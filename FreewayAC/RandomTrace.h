@@ -0,0 +1,92 @@
+/**
+* @file RandomTrace.h
+* @brief Grabación y reproducción de decisiones aleatorias del AC.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _RANDOMTRACE
+#define _RANDOMTRACE
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+* @class RandomTraceWriter
+* @brief Escribe decisiones aleatorias empaquetadas en bits a un archivo.
+*
+* Formato: identificador "FWRT", cantidad de decisiones (uint64_t) y palabras de 64 bits con
+* la decisión k en el bit k%64 de la palabra k/64. La cantidad se escribe al cerrar.
+*/
+class RandomTraceWriter
+{
+    std::ofstream m_file;
+    std::vector<uint64_t> m_buffer;  ///< Palabras completas pendientes de escribir.
+    uint64_t m_word;                 ///< Palabra en construcción.
+    uint64_t m_count;                ///< Cantidad de decisiones escritas.
+
+    void Flush();
+public:
+    ///@brief Constructor.
+    ///@param filepath Ruta del archivo a crear.
+    RandomTraceWriter(const std::string &filepath);
+    ~RandomTraceWriter();
+
+    ///@brief Añade una decisión a la traza.
+    inline void Write(const bool value)
+    {
+        m_word |= (uint64_t)value << (m_count & 63);
+        if ((++m_count & 63) == 0)
+        {
+            m_buffer.push_back(m_word);
+            m_word = 0;
+            if (m_buffer.size() == m_buffer.capacity())
+                Flush();
+        }
+    }
+
+    bool IsOpen() const;           ///< Devuelve estado del archivo.
+    uint64_t Count() const;        ///< Devuelve cantidad de decisiones escritas.
+    void Close();                  ///< Escribe datos pendientes y cierra el archivo.
+};
+
+/**
+* @class RandomTraceReader
+* @brief Lee decisiones aleatorias escritas por RandomTraceWriter.
+* El archivo se lee por bloques con un cursor, por lo que cada decisión cuesta O(1) y la memoria
+* usada no depende del largo de la traza.
+*/
+class RandomTraceReader
+{
+    std::ifstream m_file;
+    std::vector<uint64_t> m_buffer;  ///< Bloque actual.
+    std::size_t m_word_index;        ///< Palabra actual dentro del bloque.
+    uint64_t m_count;                ///< Cantidad total de decisiones en la traza.
+    uint64_t m_cursor;               ///< Siguiente decisión a leer.
+
+    void Load();
+public:
+    ///@brief Constructor.
+    ///@param filepath Ruta del archivo a leer.
+    RandomTraceReader(const std::string &filepath);
+
+    ///@brief Devuelve la siguiente decisión. Al terminar la traza devuelve falso.
+    inline bool Next()
+    {
+        if (m_cursor >= m_count)
+            return false;
+        if ((m_cursor & 63) == 0 && m_cursor != 0 && ++m_word_index == m_buffer.size())
+            Load();
+        bool ret = ((m_buffer[m_word_index] >> (m_cursor & 63)) & 1) != 0;
+        ++m_cursor;
+        return ret;
+    }
+
+    bool IsOpen() const;           ///< Devuelve estado del archivo.
+    uint64_t Count() const;        ///< Devuelve cantidad de decisiones en la traza.
+    uint64_t Position() const;     ///< Devuelve cantidad de decisiones consumidas.
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "ResultCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <atomic>
+#include <cstdio>
+using namespace std;
+
+ResultKey::ResultKey()
+{
+    iterations = 0;
+}
+string ResultKey::ToString() const
+{
+    ostringstream out;
+    out << params.ToString() << " experiment=" << experiment << " iterations=" << iterations << " observables=";
+    for (size_t i = 0; i < observables.size(); ++i)
+        out << (i == 0 ? "" : ",") << observables[i];
+    return out.str();
+}
+
+ResultCache::ResultCache(const string &dir)
+{
+    m_dir = dir;
+    if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/' && m_dir[m_dir.size() - 1] != '\\')
+        m_dir += '/';
+    if (!aux_make_dir(m_dir))
+        cout << "Error: No se puede crear directorio de resultados." << endl;
+}
+string ResultCache::EntryPath(const ResultKey &key) const
+{
+    const string text = key.ToString();
+    ostringstream out;
+    out << m_dir << "res_" << hex << setw(16) << setfill('0') << aux_fnv1a(text.data(), text.size()) << ".txt";
+    return out.str();
+}
+bool ResultCache::Load(const ResultKey &key, vector<double> &values) const
+{
+    ifstream file(EntryPath(key).c_str());
+    string stored;
+    if (!file.is_open() || !getline(file, stored) || stored != key.ToString())
+        return false;
+
+    vector<double> read(key.observables.size());
+    for (size_t i = 0; i < read.size(); ++i)
+    {
+        if (!(file >> read[i]))
+            return false;
+    }
+    values.swap(read);
+    return true;
+}
+bool ResultCache::Store(const ResultKey &key, const vector<double> &values) const
+{
+    if (values.size() != key.observables.size())
+    {
+        cout << "Error: Cantidad de valores distinta a la de observables." << endl;
+        return false;
+    }
+
+    // El archivo temporal es único por proceso y llamada, así que se escribe sin bloqueo.
+    static atomic<unsigned> counter(0);
+    const string text = key.ToString(), path = EntryPath(key);
+    ostringstream tmp_path, line;
+    tmp_path << path << "." << aux_process_id() << "_" << counter++ << ".tmp";
+    line << setprecision(numeric_limits<double>::max_digits10);
+    {
+        ofstream file(tmp_path.str().c_str(), ios::out | ios::trunc);
+        file << setprecision(numeric_limits<double>::max_digits10) << text << endl;
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            file << values[i] << endl;
+            line << "\t" << values[i];
+        }
+        file.flush();
+        if (!file)
+        {
+            cout << "Error: No se puede escribir resultado en la cache." << endl;
+            remove(tmp_path.str().c_str());
+            return false;
+        }
+    }
+
+    // Publica el resultado y lo agrega al índice con el bloqueo tomado.
+    FileLock lock(m_dir + "index.lock");
+    if (!lock.IsLocked())
+    {
+        cout << "Error: No se puede bloquear el indice de la cache." << endl;
+        remove(tmp_path.str().c_str());
+        return false;
+    }
+    if (ifstream(path.c_str()).is_open())
+    {
+        remove(tmp_path.str().c_str());
+        return true;
+    }
+    if (rename(tmp_path.str().c_str(), path.c_str()) != 0)
+    {
+        cout << "Error: No se puede guardar resultado en la cache." << endl;
+        remove(tmp_path.str().c_str());
+        return false;
+    }
+    ofstream index((m_dir + "index.txt").c_str(), ios::out | ios::app);
+    index << path.substr(m_dir.size() + 4, 16) << "\t" << text << line.str() << endl;
+    return !!index;
+}
@@ -0,0 +1,63 @@
+/**
+* @file ResultCache.h
+* @brief Caché en disco de resultados de experimentos, direccionada por contenido.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _RESULTCACHE
+#define _RESULTCACHE
+
+#include <string>
+#include <vector>
+#include "StateCache.h"
+
+/**
+* @struct ResultKey
+* @brief Todo lo que determina el resultado de un experimento: lo que determina el estado estacionario (ver
+* EquilibriumKey, incluye la versión del motor), tipo de experimento, pasos medidos y nombres de los observables pedidos.
+*/
+struct ResultKey
+{
+    EquilibriumKey params;                  ///< Parámetros del AC, semilla, generador y transitorio.
+    std::string experiment;                 ///< Tipo de experimento y sus parámetros propios.
+    CaStep iterations;                      ///< Pasos medidos después del transitorio.
+    std::vector<std::string> observables;   ///< Observables pedidos, en el orden de los valores guardados.
+
+    ResultKey();
+    std::string ToString() const;           ///< Devuelve la llave como texto, con los números reales exactos.
+};
+
+/**
+* @class ResultCache
+* @brief Guarda los observables de experimentos ya calculados para que repetirlos sea instantáneo.
+*
+* Cada resultado se guarda en res_<hash>.txt, con el texto de la llave en la primera línea (se compara al leer
+* para descartar colisiones) y un valor por línea. El archivo index.txt enumera los resultados guardados con una
+* línea por resultado: hash, llave y valores separados por tabuladores. Varios procesos pueden escribir en la misma
+* caché: cada resultado se escribe en un archivo temporal propio y se publica (renombra y agrega al índice) con el
+* bloqueo de index.lock, así que el índice no tiene líneas repetidas ni mezcladas.
+*/
+class ResultCache
+{
+    std::string m_dir;
+
+    std::string EntryPath(const ResultKey &key) const;
+public:
+    ///@brief Constructor. Crea el directorio si no existe.
+    explicit ResultCache(const std::string &dir);
+
+    ///@brief Busca un resultado guardado.
+    ///@param key Llave del experimento.
+    ///@param values Se asignan los valores de los observables de key.
+    ///@return Verdadero si el resultado existe.
+    bool Load(const ResultKey &key, std::vector<double> &values) const;
+
+    ///@brief Guarda un resultado. Si otro proceso ya lo guardó no hace nada.
+    ///@param key Llave del experimento.
+    ///@param values Un valor por observable de key.
+    ///@return Verdadero si el resultado queda guardado.
+    bool Store(const ResultKey &key, const std::vector<double> &values) const;
+};
+
+#endif
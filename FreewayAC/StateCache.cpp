@@ -0,0 +1,71 @@
+#include "StateCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+using namespace std;
+
+EquilibriumKey::EquilibriumKey()
+{
+    type = CIRCULAR_CA;
+    size = 0;
+    vmax = 0;
+    rand_prob = 0;
+    density = 0;
+    init_vel = 0;
+    aut_density = 0;
+    new_car_prob = 0;
+    new_car_speed = 0;
+    init = INIT_RANDOM;
+    seed = 0;
+    random_algorithm = MT19937;
+    warmup = 0;
+}
+string EquilibriumKey::ToString() const
+{
+    ostringstream out;
+    out << setprecision(numeric_limits<double>::max_digits10);
+    out << "engine=" << CA_ENGINE_VERSION << " type=" << type << " size=" << size << " vmax=" << vmax
+        << " rand_prob=" << rand_prob << " density=" << density << " init_vel=" << init_vel << " aut_density=" << aut_density
+        << " new_car_prob=" << new_car_prob << " new_car_speed=" << new_car_speed << " init=" << init << " seed=" << seed
+        << " random_algorithm=" << random_algorithm << " warmup=" << warmup;
+    return out.str();
+}
+
+StateCache::StateCache(const string &dir)
+{
+    m_dir = dir;
+    if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/' && m_dir[m_dir.size() - 1] != '\\')
+        m_dir += '/';
+    if (!aux_make_dir(m_dir))
+        cout << "Error: No se puede crear directorio de estados estacionarios." << endl;
+}
+string StateCache::BasePath(const EquilibriumKey &key) const
+{
+    // FNV-1a de 64 bits de la llave.
+    const string text = key.ToString();
+    const uint64_t hash = aux_fnv1a(text.data(), text.size());
+    ostringstream out;
+    out << m_dir << "eq_" << hex << setw(16) << setfill('0') << hash;
+    return out.str();
+}
+unique_ptr<CellularAutomata> StateCache::Load(const EquilibriumKey &key) const
+{
+    const string base = BasePath(key);
+    ifstream key_file((base + ".key").c_str());
+    string stored;
+    if (!key_file.is_open() || !getline(key_file, stored) || stored != key.ToString())
+        return unique_ptr<CellularAutomata>();
+    return CellularAutomata::LoadCheckpoint(base + ".ck");
+}
+bool StateCache::Store(const EquilibriumKey &key, const CellularAutomata &ca) const
+{
+    // La llave se escribe al final, así que un estado a medio guardar no se usa.
+    const string base = BasePath(key);
+    if (!ca.SaveCheckpoint(base + ".ck", true))
+        return false;
+    ofstream key_file((base + ".key").c_str());
+    key_file << key.ToString() << endl;
+    return !!key_file;
+}
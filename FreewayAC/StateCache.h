@@ -0,0 +1,66 @@
+/**
+* @file StateCache.h
+* @brief Caché en disco de estados estacionarios del AC.
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _STATECACHE
+#define _STATECACHE
+
+#include <string>
+#include <memory>
+#include "CellularAutomata.h"
+
+/**
+* @struct EquilibriumKey
+* @brief Parámetros que determinan un estado estacionario: los del AC, la disposición inicial, la semilla,
+* el generador, los pasos de transitorio evolucionados desde el estado inicial y la versión del motor
+* (CA_ENGINE_VERSION).
+*/
+struct EquilibriumKey
+{
+    CA_TYPE type;
+    CaSize size;
+    CaVelocity vmax;
+    double rand_prob;
+    double density;
+    CaVelocity init_vel;
+    double aut_density;
+    double new_car_prob;
+    CaVelocity new_car_speed;
+    INITIAL_CONDITION init;
+    int seed;
+    RandomAlgorithm random_algorithm;
+    CaStep warmup;                     ///< Pasos de transitorio.
+
+    EquilibriumKey();
+    std::string ToString() const;      ///< Devuelve la llave como texto, con los números reales exactos.
+};
+
+/**
+* @class StateCache
+* @brief Guarda estados estacionarios como checkpoints (ver Checkpoint) en un directorio para que otras
+* corridas con los mismos parámetros empiecen de ellos sin pagar el transitorio.
+*
+* Cada estado se guarda en eq_<hash>.ck junto a eq_<hash>.key con el texto de la llave, que se compara
+* al leer para descartar colisiones del hash.
+*/
+class StateCache
+{
+    std::string m_dir;
+
+    std::string BasePath(const EquilibriumKey &key) const;
+public:
+    ///@brief Constructor. Crea el directorio si no existe.
+    explicit StateCache(const std::string &dir);
+
+    ///@brief Devuelve el estado guardado para key o nullptr si no existe.
+    std::unique_ptr<CellularAutomata> Load(const EquilibriumKey &key) const;
+
+    ///@brief Guarda el estado actual de ca con la llave key.
+    ///@return Verdadero si se guardó.
+    bool Store(const EquilibriumKey &key, const CellularAutomata &ca) const;
+};
+
+#endif
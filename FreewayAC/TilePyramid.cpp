@@ -0,0 +1,179 @@
+#include "TilePyramid.h"
+#include "BmpWriter.h"
+#include "Auxiliar.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+TilePyramid::TilePyramid(const string &path, const unsigned width, const uint64_t height, const unsigned tile_size)
+{
+    m_path = path;
+    m_tile_size = max(2u, (tile_size + 1)/2*2);
+    m_rows = 0;
+    m_open = false;
+    if (width == 0 || height == 0)
+    {
+        cout << "Error: Imagen vacia." << endl;
+        return;
+    }
+
+    // Niveles hasta llegar a 1x1 pixel.
+    unsigned w = width;
+    uint64_t h = height;
+    while (true)
+    {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.rows = 0;
+        level.tile_row = 0;
+        m_levels.push_back(level);
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1)/2;
+        h = (h + 1)/2;
+    }
+
+    m_open = aux_make_dir(m_path + "_files");
+    for (size_t i = 0; i < m_levels.size() && m_open; ++i)
+    {
+        ostringstream dir;
+        dir << m_path << "_files/" << m_levels.size() - 1 - i;
+        m_open = aux_make_dir(dir.str());
+    }
+    if (!m_open)
+        cout << "Error: No se puede crear directorio de teselas." << endl;
+}
+TilePyramid::~TilePyramid()
+{
+    Close();
+}
+string TilePyramid::TilePath(const size_t level, const unsigned column, const uint64_t row) const
+{
+    ostringstream out;
+    out << m_path << "_files/" << m_levels.size() - 1 - level << "/" << column << "_" << row << ".bmp";
+    return out.str();
+}
+void TilePyramid::WriteRows(const char* data, const unsigned count)
+{
+    if (!m_open)
+        return;
+    const unsigned rows = (unsigned)min<uint64_t>(count, m_levels[0].height - m_rows);
+    Push(0, data, rows);
+    m_rows += rows;
+}
+void TilePyramid::Push(const size_t level, const char* data, const unsigned count)
+{
+    Level &lv = m_levels[level];
+    const size_t row_bytes = 3*(size_t)lv.width;
+    if (lv.strip.empty())
+        lv.strip.resize(m_tile_size*row_bytes);
+
+    unsigned done = 0;
+    while (done < count)
+    {
+        const unsigned n = min(count - done, m_tile_size - lv.rows);
+        memcpy(lv.strip.data() + lv.rows*row_bytes, data + done*row_bytes, n*row_bytes);
+        lv.rows += n;
+        done += n;
+        if (lv.rows == m_tile_size)
+            FlushStrip(level);
+    }
+}
+void TilePyramid::FlushStrip(const size_t level)
+{
+    Level &lv = m_levels[level];
+    if (lv.rows == 0)
+        return;
+
+    const unsigned width = lv.width, rows = lv.rows;
+    const size_t row_bytes = 3*(size_t)width;
+    const unsigned columns = (width + m_tile_size - 1)/m_tile_size;
+    const bool reduce = (level + 1 < m_levels.size());
+    const unsigned half_width = reduce ? m_levels[level + 1].width : 0;
+    const unsigned half_rows = (rows + 1)/2;
+    vector<char> half(reduce ? (size_t)half_rows*3*half_width : 0);
+    const char* strip = lv.strip.data();
+
+    // Cada tarea escribe una tesela y reduce sus columnas para el nivel siguiente.
+    auto task = [&](const unsigned c)
+    {
+        const unsigned x0 = c*m_tile_size;
+        const unsigned tw = min(m_tile_size, width - x0);
+        BMPWriter tile(TilePath(level, c, lv.tile_row), tw, rows);
+        if (tile.IsOpen())
+        {
+            const size_t tile_row_bytes = tile.RowBytes();
+            vector<char> buffer((size_t)rows*tile_row_bytes, 0);
+            for (unsigned r = 0; r < rows; ++r)
+                memcpy(buffer.data() + (size_t)(rows - 1 - r)*tile_row_bytes, strip + r*row_bytes + 3*(size_t)x0, 3*(size_t)tw);
+            tile.WriteRows(buffer.data(), rows);
+            tile.CloseBMP();
+        }
+
+        if (!reduce)
+            return;
+        for (unsigned y = 0; y < half_rows; ++y)
+        {
+            const unsigned ny = (2*y + 1 < rows) ? 2 : 1;
+            char* out = half.data() + (size_t)y*3*half_width;
+            for (unsigned x = x0/2; x < (x0 + tw + 1)/2; ++x)
+            {
+                const unsigned nx = (2*x + 1 < width) ? 2 : 1;
+                for (unsigned ch = 0; ch < 3; ++ch)
+                {
+                    unsigned sum = 0;
+                    for (unsigned dy = 0; dy < ny; ++dy)
+                        for (unsigned dx = 0; dx < nx; ++dx)
+                            sum += (unsigned char)strip[(2*y + dy)*row_bytes + 3*(size_t)(2*x + dx) + ch];
+                    out[3*x + ch] = (char)((sum + nx*ny/2)/(nx*ny));
+                }
+            }
+        }
+    };
+    aux_run_parallel(columns, (size_t)rows*width, task);
+
+    lv.rows = 0;
+    lv.tile_row++;
+    if (reduce)
+        Push(level + 1, half.data(), half_rows);
+}
+bool TilePyramid::IsOpen() const
+{
+    return m_open;
+}
+unsigned TilePyramid::Levels() const
+{
+    return (unsigned)m_levels.size();
+}
+unsigned TilePyramid::TileSize() const
+{
+    return m_tile_size;
+}
+void TilePyramid::Close()
+{
+    if (!m_open)
+        return;
+
+    // Las franjas incompletas se escriben del nivel más fino al más grueso, porque cada una
+    // agrega sus filas reducidas al nivel siguiente.
+    for (size_t i = 0; i < m_levels.size(); ++i)
+        FlushStrip(i);
+
+    ofstream dzi((m_path + ".dzi").c_str());
+    if (dzi.is_open())
+    {
+        dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
+        dzi << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"bmp\" Overlap=\"0\" TileSize=\""
+            << m_tile_size << "\">" << endl;
+        dzi << "  <Size Width=\"" << m_levels[0].width << "\" Height=\"" << m_levels[0].height << "\"/>" << endl;
+        dzi << "</Image>" << endl;
+    }
+    else
+        cout << "Error: No se puede crear archivo dzi." << endl;
+    m_open = false;
+}
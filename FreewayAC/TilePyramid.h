@@ -0,0 +1,69 @@
+/**
+* @file TilePyramid.h
+* @brief Escritor de pirámides de teselas en formato Deep Zoom (DZI).
+* @author Carlos Manuel Rodríguez Martínez
+* @date 19/10/2026
+*/
+
+#ifndef _TILEPYRAMID
+#define _TILEPYRAMID
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+* @class TilePyramid
+* @brief Escribe una imagen de tamaño arbitrario como pirámide Deep Zoom de teselas BMP.
+*
+* Se generan path.dzi y el directorio path_files/<nivel>/<columna>_<fila>.bmp. El nivel más alto
+* es la resolución completa y cada nivel inferior promedia bloques de 2x2 pixeles del anterior, de
+* modo que un pixel del nivel k muestra la densidad media de un bloque de 2^k x 2^k celdas.
+*
+* Las filas se reciben de arriba a abajo en una sola pasada. Cada nivel guarda solo una franja de
+* TileSize() filas; al completarse se escriben sus teselas y se reduce a la mitad en paralelo por
+* columnas de teselas. La memoria usada es del orden de 2*TileSize()*width*3 bytes sin importar el alto.
+* Las pirámides se pueden ver con visores Deep Zoom como OpenSeadragon.
+*/
+class TilePyramid
+{
+    struct Level
+    {
+        unsigned width;            ///< Pixeles por fila del nivel.
+        uint64_t height;           ///< Filas del nivel.
+        std::vector<char> strip;   ///< Franja de filas pendientes en BGR, 3 bytes por pixel.
+        unsigned rows;             ///< Filas en la franja.
+        uint64_t tile_row;         ///< Fila de teselas de la franja.
+    };
+
+    std::string m_path;            ///< Ruta base, sin extensión.
+    unsigned m_tile_size;          ///< Lado de las teselas en pixeles.
+    std::vector<Level> m_levels;   ///< m_levels[0] es la resolución completa.
+    uint64_t m_rows;               ///< Filas recibidas.
+    bool m_open;
+
+    void Push(const std::size_t level, const char* data, const unsigned count);
+    void FlushStrip(const std::size_t level);
+    std::string TilePath(const std::size_t level, const unsigned column, const uint64_t row) const;
+
+public:
+    ///@brief Constructor. Crea el directorio de teselas.
+    ///@param path Ruta base. Se crean path.dzi y path_files.
+    ///@param width Ancho de la imagen.
+    ///@param height Alto de la imagen.
+    ///@param tile_size Lado de las teselas. Se redondea a un número par.
+    TilePyramid(const std::string &path, const unsigned width, const uint64_t height, const unsigned tile_size = 256);
+    ~TilePyramid();
+
+    ///@brief Agrega filas a la imagen, de arriba a abajo.
+    ///@param data count filas consecutivas de 3*width bytes en orden BGR, sin relleno.
+    ///@param count Cantidad de filas.
+    void WriteRows(const char* data, const unsigned count);
+
+    bool IsOpen() const;            ///< Devuelve estado de la pirámide.
+    unsigned Levels() const;        ///< Devuelve cantidad de niveles.
+    unsigned TileSize() const;      ///< Devuelve lado de las teselas.
+    void Close();                   ///< Escribe las franjas pendientes y el descriptor .dzi.
+};
+
+#endif
@@ -2,6 +2,8 @@
 #include <string>
 #include <chrono>
 #include "../FreewayAC/CellularAutomata.h"
+#include "../FreewayAC/ResultCache.h"
+#include "../FreewayAC/LiveSnapshot.h"
 #include "mathlink.h"
 using namespace std;
 
@@ -63,6 +65,7 @@ void delete_ca()
 void ca_step()
 {
     ca->Step();
+    ca->SortReservoir();
     MLPutSymbol(stdlink, "Null");
 }
 void ca_evolve(int iterations)
@@ -70,6 +73,11 @@ void ca_evolve(int iterations)
     ca->Evolve(iterations);
     MLPutSymbol(stdlink, "Null");
 }
+void ca_set_density(double density)
+{
+    ca->SetDensity(density);
+    MLPutSymbol(stdlink, "Null");
+}
 int ca_count_cars()
 {
     return ca->CountCars();
@@ -91,22 +99,115 @@ void ca_get_current()
 }
 void ca_get_history()
 {
-    vector< std::vector<int> > history = ca->GetCaHistory();
     unsigned hsize = ca->GetHistorySize();
-    unsigned ca_size = ca->GetSize();
+    unsigned ca_size = ca->GetHistoryWidth();
     
-    const int dimensions[2] = {(int)history.size(), (int)ca->GetSize()};
+    const int dimensions[2] = {(int)hsize, (int)ca_size};
     const char* heads[2] = {"List", "List"};
     
-    int* out = new int[hsize*ca_size];
-    for (unsigned i = 0; i < hsize; ++i)
+    // Se copia directamente del histórico al arreglo enviado.
+    int* out = new int[(size_t)hsize*ca_size];
+    ca->ReadHistoryRows(0, hsize, out);
+    MLPutInteger32Array(stdlink, out, dimensions, heads, 2);
+    delete[] out;
+}
+void ca_export_npy(const char* path)
+{
+    ca->ExportHistoryNpy(path);
+    MLPutSymbol(stdlink, "Null");
+}
+void ca_load_lattice(const char* path, const char* classes_path)
+{
+    MLPutSymbol(stdlink, ca->LoadLattice(path, classes_path) ? "True" : "False");
+}
+void ca_cached_stats(const char* cache_dir, const char* type, int size, int vmax, double density, double rand_prob, int init_vel,
+                     double aut_density, double new_car_prob, int new_car_speed, int seed, int warmup, int iterations)
+{
+    // Mismas llaves que FreewayAC --stats --seed, así que ambos comparten la caché.
+    ResultKey key;
+    const string type_name = type;
+    key.params.type = (type_name == "OpenCA") ? OPEN_CA : (type_name == "AutonomousCircularCA") ? AUTONOMOUS_CIRCULAR_CA
+                      : (type_name == "AutonomousOpenCA") ? AUTONOMOUS_OPEN_CA : CIRCULAR_CA;
+    key.params.size = size;
+    key.params.vmax = vmax;
+    key.params.rand_prob = rand_prob;
+    key.params.density = density;
+    key.params.init_vel = init_vel;
+    key.params.aut_density = aut_density;
+    key.params.new_car_prob = new_car_prob;
+    key.params.new_car_speed = new_car_speed;
+    key.params.seed = seed;
+    key.params.random_algorithm = MT19937;
+    key.params.warmup = warmup;
+    key.experiment = "stats";
+    key.iterations = iterations;
+    key.observables.push_back("steps");
+    key.observables.push_back("mean_ocupancy");
+    key.observables.push_back("mean_flow");
+
+    ResultCache cache(cache_dir);
+    vector<double> values;
+    if (!cache.Load(key, values))
     {
-        for (unsigned j = 0; j < ca_size; ++j)
+        // El AC se simula aparte, sin tocar el que esté cargado.
+        RandomGen::SetAlgorithm(MT19937);
+        RandomGen::Seed(seed);
+        unique_ptr<CellularAutomata> sim;
+        switch (key.params.type)
         {
-            out[ca_size*i+j] = history[i][j];
+            case OPEN_CA:
+                sim.reset(new OpenCA(size, density, vmax, rand_prob, init_vel, new_car_prob, new_car_speed));
+                break;
+            case AUTONOMOUS_CIRCULAR_CA:
+                sim.reset(new AutonomousCircularCA(size, density, vmax, rand_prob, init_vel, aut_density));
+                break;
+            case AUTONOMOUS_OPEN_CA:
+                sim.reset(new AutonomousOpenCA(size, density, vmax, rand_prob, init_vel, aut_density, new_car_prob, new_car_speed));
+                break;
+            default:
+                sim.reset(new CircularCA(size, density, vmax, rand_prob, init_vel));
+                break;
         }
+        sim->SetHistoryMode(HISTORY_NONE);
+        sim->Evolve(warmup);
+
+        CellStatistics stats;
+        StepObserverAdapter<CellStatistics> observer(stats);
+        sim->SetObserver(&observer);
+        sim->Evolve(iterations);
+        sim->SetObserver(nullptr);
+
+        values.clear();
+        values.push_back((double)stats.Rows());
+        values.push_back(aux_mean(stats.Ocupancy()));
+        values.push_back(stats.MeanFlow());
+        cache.Store(key, values);
     }
-    MLPutInteger32Array(stdlink, out, dimensions, heads, 2);
+    MLPutReal64List(stdlink, &values[0], values.size());
+}
+void ca_snapshot_stats(const char* shm_name)
+{
+    // Lee el estado publicado por una simulación que corre con --snapshot_shm.
+    SnapshotReader reader;
+    LiveState state;
+    if (!reader.Open(shm_name) || !reader.Read(state))
+    {
+        MLPutSymbol(stdlink, "$Failed");
+        return;
+    }
+    const double values[5] = { (double)state.step, (double)state.cars, state.ocupancy, state.mean_flow, state.finished ? 1.0 : 0.0 };
+    MLPutReal64List(stdlink, values, 5);
+}
+void ca_snapshot_lattice(const char* shm_name)
+{
+    SnapshotReader reader;
+    LiveState state;
+    if (!reader.Open(shm_name) || !reader.Read(state))
+    {
+        MLPutSymbol(stdlink, "$Failed");
+        return;
+    }
+    MLPutInteger32List(stdlink, &state.ca[0], state.ca.size());
 }
     
 
@@ -54,6 +54,14 @@
 :ReturnType:     Manual
 :End:
 
+:Begin:
+:Function:       ca_set_density
+:Pattern:        CASetDensity[density_Real]
+:Arguments:      { density }
+:ArgumentTypes:  { Real }
+:ReturnType:     Manual
+:End:
+
 :Begin:
 :Function:       ca_count_cars
 :Pattern:        CACountCars[]
@@ -94,3 +102,43 @@
 :ArgumentTypes:  Manual
 :ReturnType:     Manual
 :End:
+
+:Begin:
+:Function:       ca_export_npy
+:Pattern:        CAExportNpy[path_String]
+:Arguments:      { path }
+:ArgumentTypes:  { String }
+:ReturnType:     Manual
+:End:
+
+:Begin:
+:Function:       ca_load_lattice
+:Pattern:        CALoadLattice[path_String, classesPath_String]
+:Arguments:      { path, classesPath }
+:ArgumentTypes:  { String, String }
+:ReturnType:     Manual
+:End:
+
+:Begin:
+:Function:       ca_cached_stats
+:Pattern:        CACachedStats[cacheDir_String, type_String, size_Integer, vmax_Integer, density_Real, randp_Real, initVel_Integer, autDensity_Real, newCarProb_Real, newCarSpeed_Integer, seed_Integer, warmup_Integer, iterations_Integer]
+:Arguments:      { cacheDir, type, size, vmax, density, randp, initVel, autDensity, newCarProb, newCarSpeed, seed, warmup, iterations }
+:ArgumentTypes:  { String, String, Integer, Integer, Real, Real, Integer, Real, Real, Integer, Integer, Integer, Integer }
+:ReturnType:     Manual
+:End:
+
+:Begin:
+:Function:       ca_snapshot_stats
+:Pattern:        CASnapshotStats[shmName_String]
+:Arguments:      { shmName }
+:ArgumentTypes:  { String }
+:ReturnType:     Manual
+:End:
+
+:Begin:
+:Function:       ca_snapshot_lattice
+:Pattern:        CASnapshotLattice[shmName_String]
+:Arguments:      { shmName }
+:ArgumentTypes:  { String }
+:ReturnType:     Manual
+:End: